@@ -35,6 +35,9 @@
 #ifdef BRICKMASK_MASKBIT_TFORM
   #undef BRICKMASK_MASKBIT_TFORM
 #endif
+#ifdef BRICKMASK_MASKBIT_WTYPE
+  #undef BRICKMASK_MASKBIT_WTYPE
+#endif
 #ifdef FITS_WRITE_SUBID_NAME
   #undef FITS_WRITE_SUBID_NAME
 #endif
@@ -48,15 +51,19 @@
 #if     BRICKMASK_WFITS_MTYPE == TBYTE
   #define BRICKMASK_MASKBIT_DTYPE       uint8_t
   #define BRICKMASK_MASKBIT_TFORM       "B"
+  #define BRICKMASK_MASKBIT_WTYPE       TBYTE
 #elif   BRICKMASK_WFITS_MTYPE == TSHORT
   #define BRICKMASK_MASKBIT_DTYPE       uint16_t
   #define BRICKMASK_MASKBIT_TFORM       "I"
+  #define BRICKMASK_MASKBIT_WTYPE       TSHORT
 #elif   BRICKMASK_WFITS_MTYPE == TINT
   #define BRICKMASK_MASKBIT_DTYPE       uint32_t
   #define BRICKMASK_MASKBIT_TFORM       "J"
+  #define BRICKMASK_MASKBIT_WTYPE       TINT
 #elif   BRICKMASK_WFITS_MTYPE == TLONG
   #define BRICKMASK_MASKBIT_DTYPE       uint64_t
   #define BRICKMASK_MASKBIT_TFORM       "K"
+  #define BRICKMASK_MASKBIT_WTYPE       TLONGLONG
 #else
   #error "unexpected definition of `BRICKMASK_WFITS_MTYPE`"
 #endif
@@ -92,7 +99,14 @@
   #undef FITS_WRITE_ABORT
 #endif
 
-#if BRICKMASK_WFITS_OVERWRITE == 1
+#if BRICKMASK_WFITS_OVERWRITE == 1 && BRICKMASK_WFITS_ALLCOL == 1
+  #define FITS_WRITE_ABORT {                                            \
+    P_ERR("cfitsio error: "); fits_report_error(stderr, status);        \
+    status = 0; if (fp) { fits_close_file(fp, &status); status = 0; }   \
+    if (rows) free(rows);                                               \
+    return BRICKMASK_ERR_FILE;                                          \
+  }
+#elif BRICKMASK_WFITS_OVERWRITE == 1
   #define FITS_WRITE_ABORT {                                            \
     P_ERR("cfitsio error: "); fits_report_error(stderr, status);        \
     status = 0; if (fp) { fits_close_file(fp, &status); status = 0; }   \
@@ -116,6 +130,99 @@
                        Function for saving a FITS catalog
 \*============================================================================*/
 
+#if BRICKMASK_WFITS_OVERWRITE == 1 && BRICKMASK_WFITS_ALLCOL == 1
+/******************************************************************************
+Function `fits_save_<BRICKMASK_MASKBIT_DTYPE><FITS_WRITE_SUBID_NAME>
+    _overwrite_all`:
+  Append additional columns to a FITS file in place, with the existing
+  columns untouched, and only the appended ones written by chunks.
+Arguments:
+  * `fname`:    filename for the output FITS file;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the data catalogue;
+  * `icat`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
+    FITS_WRITE_SUBID_NAME, FITS_WRITE_OVERWRITE_NAME, FITS_WRITE_ALLCOL_NAME)
+    (const char *fname, const CONF *conf, const DATA *data, const int icat) {
+  int status = 0;
+  fitsfile *fp = NULL;
+  long *rows = NULL;            /* list of rows to be removed */
+
+  if (fits_open_data(&fp, conf->input[icat], READWRITE, &status))
+    FITS_WRITE_ABORT;
+
+  /* Get the total number of columns and rows. */
+  int nc = 0;
+  if (fits_get_num_cols(fp, &nc, &status)) FITS_WRITE_ABORT;
+  long nr = 0;
+  if (fits_get_num_rows(fp, &nr, &status)) FITS_WRITE_ABORT;
+
+  /* Flags of the selected rows, and the number of rows to be saved. */
+  const char *sel = (data->sel) ? data->sel[icat] : NULL;
+  const long nsel = data->iidx[icat + 1] - data->iidx[icat];
+  if (nsel > nr || (!sel && nsel != nr)) {
+    P_ERR("unexpected number of objects to be saved: %ld\n", nsel);
+    fits_close_file(fp, &status);
+    return BRICKMASK_ERR_SAVE;
+  }
+
+  /* Remove rows that are not selected, at once. */
+  if (nsel < nr) {
+    if (!(rows = malloc((nr - nsel) * sizeof(long)))) {
+      P_ERR("failed to allocate memory for the rows to be removed\n");
+      fits_close_file(fp, &status);
+      return BRICKMASK_ERR_MEMORY;
+    }
+    long n = 0;
+    for (long i = 0; i < nr; i++) if (!sel[i]) rows[n++] = i + 1;
+    if (fits_delete_rowlist(fp, rows, n, &status)) FITS_WRITE_ABORT;
+    free(rows);
+    rows = NULL;
+  }
+
+  /* Append maskbit and subsample ID columns. */
+  if (fits_insert_col(fp, nc + 1, conf->mcol,
+      BRICKMASK_MASKBIT_TFORM, &status)) FITS_WRITE_ABORT;
+  #if BRICKMASK_WFITS_SUBID == 1
+  if (fits_insert_col(fp, nc + 2, BRICKMASK_FITS_SUBID, "B", &status))
+    FITS_WRITE_ABORT;
+  #endif
+
+  /* Set the number of rows to be written at once. */
+  long nstep;
+  if (fits_get_rowsize(fp, &nstep, &status)) FITS_WRITE_ABORT;
+  if (nstep < (long) (BRICKMASK_FILE_CHUNK / sizeof(BRICKMASK_MASKBIT_DTYPE)))
+    nstep = BRICKMASK_FILE_CHUNK / sizeof(BRICKMASK_MASKBIT_DTYPE);
+
+  /* Write the new columns by chunks; maskbits are stored as signed integers
+     in FITS, so the bits are passed through without conversion. */
+  BRICKMASK_MASKBIT_DTYPE *mask =
+      ((BRICKMASK_MASKBIT_DTYPE *) data->mask) + data->iidx[icat];
+  #if BRICKMASK_WFITS_SUBID == 1
+  unsigned char *subid = data->subid + data->iidx[icat];
+  #endif
+  for (long i = 0; i < nsel; i += nstep) {
+    const long nrow = (nstep < nsel - i) ? nstep : nsel - i;
+    if (fits_write_col(fp, BRICKMASK_MASKBIT_WTYPE, nc + 1, i + 1, 1, nrow,
+        mask + i, &status)) FITS_WRITE_ABORT;
+  #if BRICKMASK_WFITS_SUBID == 1
+    if (fits_write_col(fp, TBYTE, nc + 2, i + 1, 1, nrow, subid + i,
+        &status)) FITS_WRITE_ABORT;
+  #endif
+  }
+
+  if (fits_close_file(fp, &status)) {
+    P_ERR("cfitsio error: "); fits_report_error(stderr, status);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+#else
+
 /******************************************************************************
 Function `fits_save_<BRICKMASK_MASKBIT_DTYPE><FITS_WRITE_SUBID_NAME>
     <FITS_WRITE_OVERWRITE_NAME><FITS_WRITE_ALLCOL_NAME>`:
@@ -156,6 +263,13 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
   long nr = 0;
   if (fits_get_num_rows(fp, &nr, &status)) FITS_WRITE_ABORT;
 
+  /* Flags of the selected rows, and the number of rows to be saved. */
+  const char *sel = (data->sel) ? data->sel[icat] : NULL;
+  const long nsel = data->iidx[icat + 1] - data->iidx[icat];
+
+  /* Output columns of the selected rows kept from reading the file. */
+  const unsigned char *cache = (data->rows) ? data->rows[icat] : NULL;
+
   /* Compute the total length (in bytes) of input columns. */
   long iwidth = 0;
   for (int i = 1; i <= nc; i++) {
@@ -166,42 +280,38 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
 
   /* Compute the total length (in bytes) of output columns. */
 #if BRICKMASK_WFITS_ALLCOL == 1
-  long owidth = iwidth;
+  const long cwidth = iwidth;
 #else
-  long owidth = 0;
+  long cwidth = 0;
   FITS_COL_t *col = data->content;
-  for (int i = 0; i < conf->ncol; i++) owidth += col[i].w;
+  for (int i = 0; i < conf->ncol; i++) cwidth += col[i].w;
 #endif
-  owidth += sizeof(BRICKMASK_MASKBIT_DTYPE);
+  long owidth = cwidth + sizeof(BRICKMASK_MASKBIT_DTYPE);
 #if BRICKMASK_WFITS_SUBID == 1
   owidth++;
 #endif
 
 #if BRICKMASK_WFITS_OVERWRITE == 0
   /* Create the output file for receiving columns. */
-  if (fits_create_file(&ofp, fname, &status)) FITS_WRITE_ABORT;
-  /* Copy the header. */
-  if (fits_copy_hdutab(fp, ofp, 1, 0, &status)) FITS_WRITE_ABORT;
+  if (fits_create_output(&ofp, fname, &status)) FITS_WRITE_ABORT;
 
   #if BRICKMASK_WFITS_ALLCOL == 0
-  /* Duplicate columns to be saved. */
-  for (int i = 0; i < conf->ncol; i++) {
-    if (fits_copy_col(ofp, ofp, col[i].n, nc + i + 1, 1, &status))
-      FITS_WRITE_ABORT;
-  }
-  /* Remove original columns. */
-  for (int i = 0; i < nc; i++) {
-    if (fits_delete_col(ofp, 1, &status)) FITS_WRITE_ABORT;
+  /* Build the header with only the selected and appended columns. */
+  if (fits_create_subset(fp, ofp, col, conf->ncol, conf->mcol,
+      BRICKMASK_MASKBIT_TFORM, BRICKMASK_WFITS_SUBID)) {
+    fits_close_file(fp, &status); status = 0;
+    fits_close_file(ofp, &status);
+    return BRICKMASK_ERR_FILE;
   }
-  nc = conf->ncol;
-  #endif
-
-  /* Append maskbit and subsample ID columns. */
+  #else
+  /* Copy the header, and append maskbit and subsample ID columns. */
+  if (fits_copy_hdutab(fp, ofp, 1, 0, &status)) FITS_WRITE_ABORT;
   if (fits_insert_col(ofp, nc + 1, conf->mcol,
       BRICKMASK_MASKBIT_TFORM, &status)) FITS_WRITE_ABORT;
-  #if BRICKMASK_WFITS_SUBID == 1
+    #if BRICKMASK_WFITS_SUBID == 1
   if (fits_insert_col(ofp, nc + 2, BRICKMASK_FITS_SUBID, "B", &status))
     FITS_WRITE_ABORT;
+    #endif
   #endif
 #endif
 
@@ -212,13 +322,13 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
     nstep = BRICKMASK_FILE_CHUNK / iwidth;
   const long nchunk = nstep * iwidth;
 #if BRICKMASK_WFITS_OVERWRITE == 1
-  const long ntab = nr * owidth;
+  const long ntab = nsel * owidth;
 #else
   const long ntab = nstep * owidth;
 #endif
 
-  /* Allocate memory for reading data by chunks. */
-  if (!(chunk = malloc(nchunk))) {
+  /* Allocate memory for reading data by chunks, unless rows are cached. */
+  if (!cache && !(chunk = malloc(nchunk))) {
     P_ERR("failed to allocate memory for reading FITS columns\n");
     fits_close_file(fp, &status); status = 0;
 #if BRICKMASK_WFITS_OVERWRITE == 0
@@ -227,7 +337,7 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
     return BRICKMASK_ERR_MEMORY;
   }
   /* Allocate memory for the output FITS table. */
-  if (!(tab = malloc(ntab))) {
+  if (!(tab = malloc(ntab ? ntab : 1))) {
     P_ERR("failed to allocate memory for writing FITS columns\n");
     fits_close_file(fp, &status); status = 0;
 #if BRICKMASK_WFITS_OVERWRITE == 0
@@ -239,15 +349,19 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
 
   /* Copy data and append column in chunks. */
   long nread = 1;
-  long nrest = nr;
+  long nrest = (cache) ? nsel : nr;
+  size_t irow = data->iidx[icat];       /* index of the object in `data` */
 #if BRICKMASK_WFITS_OVERWRITE == 1
   size_t idx = 0;
+#else
+  long nwrite = 1;
 #endif
   while (nrest) {
     long nrow = (nstep < nrest) ? nstep : nrest;
 
     /* Read the chunk at once. */
-    if (fits_read_tblbytes(fp, nread, 1, nrow * iwidth, chunk, &status))
+    if (!cache &&
+        fits_read_tblbytes(fp, nread, 1, nrow * iwidth, chunk, &status))
       FITS_WRITE_ABORT;
 
     /* Construct the FITS table to be written. */
@@ -255,27 +369,37 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
     size_t idx = 0;
 #endif
     for (long i = 0; i < nrow; i++) {
-      /* Copy columns. */
-      unsigned char *ichunk = chunk + i * iwidth;
+      if (cache) {
+        /* Copy the cached columns, which are all selected. */
+        memcpy(tab + idx, cache, cwidth);
+        cache += cwidth;
+        idx += cwidth;
+      }
+      else {
+        /* Skip rows that are not selected. */
+        if (sel && !sel[nread - 1 + i]) continue;
+
+        /* Copy columns. */
+        unsigned char *ichunk = chunk + i * iwidth;
 #if BRICKMASK_WFITS_ALLCOL == 1
-      memcpy(tab + idx, ichunk, iwidth);
-      idx += iwidth;
+        memcpy(tab + idx, ichunk, iwidth);
+        idx += iwidth;
 #else
-      for (int j = 0; j < conf->ncol; j++) {
-        memcpy(tab + idx, ichunk + col[j].i - 1, col[j].w);
-        idx += col[j].w;
-      }
+        for (int j = 0; j < conf->ncol; j++) {
+          memcpy(tab + idx, ichunk + col[j].i - 1, col[j].w);
+          idx += col[j].w;
+        }
 #endif
+      }
 
       /* Append maskbit value with big endian. */
-      const long didx = i + nread - 1;
 #if     BRICKMASK_WFITS_MTYPE == TBYTE || defined(WITH_BIG_ENDIAN)
-      memcpy(tab + idx, ((BRICKMASK_MASKBIT_DTYPE *) data->mask) +
-          data->iidx[icat] + didx, sizeof(BRICKMASK_MASKBIT_DTYPE));
+      memcpy(tab + idx, ((BRICKMASK_MASKBIT_DTYPE *) data->mask) + irow,
+          sizeof(BRICKMASK_MASKBIT_DTYPE));
       idx += sizeof(BRICKMASK_MASKBIT_DTYPE);
 #else
       unsigned char *msk = ((unsigned char *) data->mask) +
-        (data->iidx[icat] + didx) * sizeof(BRICKMASK_MASKBIT_DTYPE);
+        irow * sizeof(BRICKMASK_MASKBIT_DTYPE);
   #if   BRICKMASK_WFITS_MTYPE == TLONG
       tab[idx++] = msk[7];
       tab[idx++] = msk[6];
@@ -291,57 +415,48 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
 #endif
       /* Append subsample ID. */
 #if BRICKMASK_WFITS_SUBID == 1
-      tab[idx++] = data->subid[data->iidx[icat] + didx];
+      tab[idx++] = data->subid[irow];
 #endif
+      irow++;
     }
 
 #if BRICKMASK_WFITS_OVERWRITE == 0
     /* Write the FITS table. */
-    if (fits_write_tblbytes(ofp, nread, 1, nrow * owidth, tab, &status))
-      FITS_WRITE_ABORT;
+    if (idx) {
+      if (fits_write_tblbytes(ofp, nwrite, 1, idx, tab, &status))
+        FITS_WRITE_ABORT;
+      nwrite += idx / owidth;
+    }
 #endif
 
     nread += nrow;
     nrest -= nrow;
   }
 
-  free(chunk);
+  if (chunk) free(chunk);
   chunk = NULL;
 
 #if BRICKMASK_WFITS_OVERWRITE == 1
-  /* Delete the existing FITS table. */
-  if (fits_delete_rows(fp, 1, nr, &status)) FITS_WRITE_ABORT;
-  #if BRICKMASK_WFITS_ALLCOL == 0
-  /* Duplicate columns to be saved. */
-  for (int i = 0; i < conf->ncol; i++) {
-    if (fits_copy_col(fp, fp, col[i].n, nc + i + 1, 1, &status))
-      FITS_WRITE_ABORT;
-  }
-  /* Remove original columns. */
-  for (int i = 0; i < nc; i++) {
-    if (fits_delete_col(fp, 1, &status)) FITS_WRITE_ABORT;
+  /* Replace the existing table by one with only the selected and appended
+     columns. */
+  if (fits_create_subset(fp, NULL, col, conf->ncol, conf->mcol,
+      BRICKMASK_MASKBIT_TFORM, BRICKMASK_WFITS_SUBID)) {
+    fits_close_file(fp, &status);
+    free(tab);
+    return BRICKMASK_ERR_FILE;
   }
-  nc = conf->ncol;
-  #endif
-
-  /* Append maskbit and subsample ID columns. */
-  if (fits_insert_col(fp, nc + 1, conf->mcol,
-      BRICKMASK_MASKBIT_TFORM, &status)) FITS_WRITE_ABORT;
-  #if BRICKMASK_WFITS_SUBID == 1
-  if (fits_insert_col(fp, nc + 2, BRICKMASK_FITS_SUBID, "B", &status))
-    FITS_WRITE_ABORT;
-  #endif
 
   /* Write the FITS table. */
-  if (fits_write_tblbytes(fp, 1, 1, ntab, tab, &status)) FITS_WRITE_ABORT;
+  if (ntab && fits_write_tblbytes(fp, 1, 1, ntab, tab, &status))
+    FITS_WRITE_ABORT;
 #endif
 
   free(tab);
   tab = NULL;
   if (fits_close_file(fp, &status)) FITS_WRITE_ABORT;
 #if BRICKMASK_WFITS_OVERWRITE == 0
-  /* Close the file directly. */
-  if (fits_close_file(ofp, &status)) {
+  /* Close the file, and compress the table if necessary. */
+  if (fits_close_output(ofp, fname, &status)) {
     P_ERR("cfitsio error: "); fits_report_error(stderr, status);
     return BRICKMASK_ERR_FILE;
   }
@@ -350,6 +465,7 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
   return 0;
 }
 
+#endif
 
 #undef BRICKMASK_WFITS_MTYPE
 #undef BRICKMASK_WFITS_SUBID
@@ -358,6 +474,7 @@ static int FITS_WRITE_FUNC(fits_save, BRICKMASK_MASKBIT_DTYPE,
 
 #undef BRICKMASK_MASKBIT_DTYPE
 #undef BRICKMASK_MASKBIT_TFORM
+#undef BRICKMASK_MASKBIT_WTYPE
 #undef FITS_WRITE_SUBID_NAME
 #undef FITS_WRITE_OVERWRITE_NAME
 #undef FITS_WRITE_ALLCOL_NAME
@@ -0,0 +1,68 @@
+/*******************************************************************************
+* hdf5_io.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#ifdef HDF5
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "hdf5_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*============================================================================*\
+                       Interfaces for accessing HDF5 files
+\*============================================================================*/
+
+/******************************************************************************
+Function `hdf5_open`:
+  Open an HDF5 file, with the automatic error printing of HDF5 disabled.
+Arguments:
+  * `fname`:    name of the file;
+  * `write`:    true for opening the file with write access.
+Return:
+  Identifier of the file on success; a negative value on error.
+******************************************************************************/
+hid_t hdf5_open(const char *fname, const bool write) {
+  /* Errors are reported with the messages of this program. */
+  H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+  hid_t fid = H5Fopen(fname, (write) ? H5F_ACC_RDWR : H5F_ACC_RDONLY,
+      H5P_DEFAULT);
+  if (fid < 0) P_ERR("cannot open the HDF5 file: `%s'\n", fname);
+  return fid;
+}
+
+/******************************************************************************
+Function `hdf5_sibling`:
+  Generate the path of a dataset in the same group as another dataset.
+Arguments:
+  * `dset`:     path of the reference dataset;
+  * `name`:     name of the new dataset.
+Return:
+  Address of the path on success; NULL on error.
+******************************************************************************/
+char *hdf5_sibling(const char *dset, const char *name) {
+  const char *end = strrchr(dset, '/');
+  const size_t len = (end) ? end - dset + 1 : 0;
+  const size_t nlen = strlen(name);
+  char *path = malloc(len + nlen + 1);
+  if (!path) {
+    P_ERR("failed to allocate memory for the path of HDF5 datasets\n");
+    return NULL;
+  }
+  memcpy(path, dset, len);
+  memcpy(path + len, name, nlen + 1);
+  return path;
+}
+
+#endif
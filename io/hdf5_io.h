@@ -0,0 +1,67 @@
+/*******************************************************************************
+* hdf5_io.h: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+*******************************************************************************/
+
+#ifndef __HDF5_IO_H__
+#define __HDF5_IO_H__
+
+#ifdef HDF5
+
+#include <stdbool.h>
+#include <hdf5.h>
+
+/*============================================================================*\
+                       Interfaces for accessing HDF5 files
+\*============================================================================*/
+
+/******************************************************************************
+Function `hdf5_open`:
+  Open an HDF5 file, with the automatic error printing of HDF5 disabled.
+Arguments:
+  * `fname`:    name of the file;
+  * `write`:    true for opening the file with write access.
+Return:
+  Identifier of the file on success; a negative value on error.
+******************************************************************************/
+hid_t hdf5_open(const char *fname, const bool write);
+
+/******************************************************************************
+Function `hdf5_sibling`:
+  Generate the path of a dataset in the same group as another dataset.
+Arguments:
+  * `dset`:     path of the reference dataset;
+  * `name`:     name of the new dataset.
+Return:
+  Address of the path on success; NULL on error.
+******************************************************************************/
+char *hdf5_sibling(const char *dset, const char *name);
+
+#endif
+#endif
@@ -0,0 +1,546 @@
+/*******************************************************************************
+* npy_io.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "npy_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fitsio.h>
+
+/* Identifier of NumPy array files. */
+#define NPY_MAGIC               "\x93NUMPY"
+#define NPY_MAGIC_LEN           6
+
+/* Byte order of the host. */
+#ifdef WITH_BIG_ENDIAN
+  #define NPY_NATIVE_ORDER      ">"
+#else
+  #define NPY_NATIVE_ORDER      "<"
+#endif
+
+/*============================================================================*\
+                    Functions for parsing NumPy array headers
+\*============================================================================*/
+
+/******************************************************************************
+Function `npy_skip`:
+  Skip whitespaces of the header.
+Arguments:
+  * `p`:        current position of the header.
+Return:
+  Address of the first non-whitespace character.
+******************************************************************************/
+static inline const char *npy_skip(const char *p) {
+  while (isspace((unsigned char) *p)) p++;
+  return p;
+}
+
+/******************************************************************************
+Function `npy_string`:
+  Parse a quoted Python string of the header, without escape sequences.
+Arguments:
+  * `p`:        current position of the header;
+  * `str`:      address for storing the starting address of the string;
+  * `len`:      address for storing the length of the string.
+Return:
+  Address after the string on success; NULL on error.
+******************************************************************************/
+static const char *npy_string(const char *p, const char **str, size_t *len) {
+  const char quote = *p;
+  if (quote != '\'' && quote != '"') return NULL;
+  const char *end = strchr(++p, quote);
+  if (!end || memchr(p, '\\', end - p)) return NULL;
+  *str = p;
+  *len = end - p;
+  return end + 1;
+}
+
+/******************************************************************************
+Function `npy_shape`:
+  Parse a Python tuple of non-negative integers of the header.
+Arguments:
+  * `p`:        current position of the header;
+  * `num`:      address for storing the product of the integers;
+  * `ndim`:     address for storing the number of integers.
+Return:
+  Address after the tuple on success; NULL on error.
+******************************************************************************/
+static const char *npy_shape(const char *p, size_t *num, int *ndim) {
+  if (*p != '(') return NULL;
+  p = npy_skip(p + 1);
+  *num = 1;
+  *ndim = 0;
+  while (*p != ')') {
+    if (!isdigit((unsigned char) *p)) return NULL;
+    char *end;
+    unsigned long long n = strtoull(p, &end, 10);
+    if (n && *num > SIZE_MAX / n) return NULL;
+    *num *= n;
+    (*ndim)++;
+    p = npy_skip(end);
+    if (*p == ',') p = npy_skip(p + 1);
+    else if (*p != ')') return NULL;
+  }
+  return p + 1;
+}
+
+/******************************************************************************
+Function `npy_dtype`:
+  Parse a quoted NumPy type descriptor of the header, e.g. '<f8'.
+Arguments:
+  * `p`:        current position of the header;
+  * `field`:    structure for storing the data type.
+Return:
+  Address after the descriptor on success; NULL on error.
+******************************************************************************/
+static const char *npy_dtype(const char *p, NPY_FIELD_t *field) {
+  const char *str;
+  size_t len;
+  if (!(p = npy_string(p, &str, &len)) || !len) return NULL;
+  const char *end = str + len;
+
+  field->order = '|';
+  if (*str == '<' || *str == '>' || *str == '=' || *str == '|')
+    field->order = *str++;
+  if (str == end || !isalpha((unsigned char) *str)) return NULL;
+  field->kind = *str++;
+  if (field->kind == 'O') return NULL;          /* Python objects */
+
+  /* Number of bytes, with optional units for date and time. */
+  size_t size = 0;
+  if (str == end || !isdigit((unsigned char) *str)) return NULL;
+  while (str < end && isdigit((unsigned char) *str)) {
+    if (size > (SIZE_MAX - 9) / 10) return NULL;
+    size = size * 10 + (*str++ - '0');
+  }
+  if (str < end && (*str != '[' || end[-1] != ']')) return NULL;
+  if (field->kind == 'U') {                     /* UCS-4 characters */
+    if (size > SIZE_MAX / 4) return NULL;
+    size *= 4;
+  }
+  field->size = size;
+  return p;
+}
+
+/******************************************************************************
+Function `npy_descr_list`:
+  Parse the list of fields of a structured array.
+Arguments:
+  * `p`:        current position of the header;
+  * `npy`:      structure for the header.
+Return:
+  Address after the list on success; NULL on error.
+******************************************************************************/
+static const char *npy_descr_list(const char *p, NPY_t *npy) {
+  if (*p != '[') return NULL;
+  p = npy_skip(p + 1);
+  int nmax = 0;
+  while (*p != ']') {
+    /* Enlarge memory for the fields if necessary. */
+    if (npy->nfield == nmax) {
+      if (nmax > INT_MAX / 2) return NULL;
+      nmax = (nmax) ? nmax * 2 : 8;
+      NPY_FIELD_t *tmp = realloc(npy->field, nmax * sizeof(NPY_FIELD_t));
+      if (!tmp) return NULL;
+      npy->field = tmp;
+    }
+    NPY_FIELD_t *field = npy->field + npy->nfield;
+    field->name = NULL;
+    field->dpos = p - npy->hdr;
+
+    /* Field name, which cannot be a (title, name) pair. */
+    if (*p != '(') return NULL;
+    p = npy_skip(p + 1);
+    const char *str;
+    size_t len;
+    if (!(p = npy_string(p, &str, &len))) return NULL;
+    if (!(field->name = malloc(len + 1))) return NULL;
+    memcpy(field->name, str, len);
+    field->name[len] = '\0';
+    npy->nfield++;
+
+    /* Data type, which cannot be a nested structure. */
+    p = npy_skip(p);
+    if (*p != ',') return NULL;
+    p = npy_skip(p + 1);
+    if (!(p = npy_dtype(p, field))) return NULL;
+
+    /* Optional shape of sub-arrays. */
+    p = npy_skip(p);
+    if (*p == ',') {
+      p = npy_skip(p + 1);
+      if (*p == '(') {
+        size_t num;
+        int ndim;
+        if (!(p = npy_shape(p, &num, &ndim))) return NULL;
+        if (num && field->size > SIZE_MAX / num) return NULL;
+        field->size *= num;
+        p = npy_skip(p);
+      }
+    }
+    if (*p != ')') return NULL;
+    p++;
+    field->dlen = p - npy->hdr - field->dpos;
+
+    field->offset = npy->width;
+    if (npy->width > SIZE_MAX - field->size) return NULL;
+    npy->width += field->size;
+
+    p = npy_skip(p);
+    if (*p == ',') p = npy_skip(p + 1);
+    else if (*p != ']') return NULL;
+  }
+  if (!npy->nfield) return NULL;
+  return p + 1;
+}
+
+/******************************************************************************
+Function `npy_parse`:
+  Parse the Python dictionary of the header.
+Arguments:
+  * `npy`:      structure for the header.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int npy_parse(NPY_t *npy) {
+  const char *p = npy_skip(npy->hdr);
+  if (*p != '{') return BRICKMASK_ERR_FILE;
+  p = npy_skip(p + 1);
+  bool descr, shape;
+  descr = shape = false;
+  while (*p != '}') {
+    const char *key;
+    size_t len;
+    if (!(p = npy_string(p, &key, &len))) return BRICKMASK_ERR_FILE;
+    p = npy_skip(p);
+    if (*p != ':') return BRICKMASK_ERR_FILE;
+    p = npy_skip(p + 1);
+
+    if (len == 5 && !strncmp(key, "descr", 5)) {
+      if (*p == '[') p = npy_descr_list(p, npy);
+      else {
+        if (!(npy->field = malloc(sizeof(NPY_FIELD_t))))
+          return BRICKMASK_ERR_MEMORY;
+        npy->field->name = NULL;
+        npy->field->offset = 0;
+        npy->field->dpos = p - npy->hdr;
+        if ((p = npy_dtype(p, npy->field))) {
+          npy->field->dlen = p - npy->hdr - npy->field->dpos;
+          npy->width = npy->field->size;
+        }
+      }
+      descr = true;
+    }
+    else if (len == 13 && !strncmp(key, "fortran_order", 13)) {
+      /* The memory layout is irrelevant for 1-D arrays. */
+      if (!strncmp(p, "True", 4)) p += 4;
+      else if (!strncmp(p, "False", 5)) p += 5;
+      else p = NULL;
+    }
+    else if (len == 5 && !strncmp(key, "shape", 5)) {
+      int ndim;
+      if ((p = npy_shape(p, &npy->n, &ndim)) && ndim != 1) p = NULL;
+      shape = true;
+    }
+    else p = NULL;
+    if (!p) return BRICKMASK_ERR_FILE;
+
+    p = npy_skip(p);
+    if (*p == ',') p = npy_skip(p + 1);
+    else if (*p != '}') return BRICKMASK_ERR_FILE;
+  }
+  if (!descr || !shape || !npy->width) return BRICKMASK_ERR_FILE;
+  return 0;
+}
+
+
+/*============================================================================*\
+                      Interfaces for NumPy array files
+\*============================================================================*/
+
+/******************************************************************************
+Function `npy_destroy`:
+  Deconstruct the structure for the header of a NumPy array file.
+Arguments:
+  * `npy`:      structure for the header.
+******************************************************************************/
+void npy_destroy(NPY_t *npy) {
+  if (!npy) return;
+  if (npy->field) {
+    for (int i = 0; i < npy->nfield; i++) {
+      if (npy->field[i].name) free(npy->field[i].name);
+    }
+    free(npy->field);
+  }
+  if (npy->hdr) free(npy->hdr);
+  free(npy);
+}
+
+/******************************************************************************
+Function `npy_open`:
+  Read and parse the header of a NumPy array file. Only 1-D plain arrays
+  and 1-D structured arrays with scalar or fixed-shape fields are supported.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  Address of the structure for the header on success; NULL on error.
+******************************************************************************/
+NPY_t *npy_open(const char *fname) {
+  FILE *fp;
+  if (!(fp = fopen(fname, "r"))) {
+    P_ERR("cannot open file for reading: `%s'\n", fname);
+    return NULL;
+  }
+
+  /* Check the identifier and version, and get the length of the header. */
+  unsigned char pre[12];
+  size_t len;
+  if (fread(pre, 1, 10, fp) != 10 ||
+      memcmp(pre, NPY_MAGIC, NPY_MAGIC_LEN)) {
+    P_ERR("not a NumPy array file: `%s'\n", fname);
+    fclose(fp);
+    return NULL;
+  }
+  NPY_t *npy = calloc(1, sizeof(NPY_t));
+  if (!npy) {
+    P_ERR("failed to allocate memory for the header of `%s'\n", fname);
+    fclose(fp);
+    return NULL;
+  }
+  npy->hdr = NULL;
+  npy->field = NULL;
+  if (pre[6] == 1) {
+    len = pre[8] | ((size_t) pre[9] << 8);
+    npy->start = 10;
+  }
+  else if ((pre[6] == 2 || pre[6] == 3) && fread(pre + 10, 1, 2, fp) == 2) {
+    len = pre[8] | ((size_t) pre[9] << 8) | ((size_t) pre[10] << 16) |
+        ((size_t) pre[11] << 24);
+    npy->start = 12;
+  }
+  else {
+    P_ERR("unsupported version (%d.%d) of NumPy array file: `%s'\n",
+        pre[6], pre[7], fname);
+    npy_destroy(npy);
+    fclose(fp);
+    return NULL;
+  }
+  npy->start += len;
+
+  /* Read and parse the header. */
+  if (!(npy->hdr = malloc(len + 1))) {
+    P_ERR("failed to allocate memory for the header of `%s'\n", fname);
+    npy_destroy(npy);
+    fclose(fp);
+    return NULL;
+  }
+  if (fread(npy->hdr, 1, len, fp) != len) {
+    P_ERR("failed to read the header of NumPy array file: `%s'\n", fname);
+    npy_destroy(npy);
+    fclose(fp);
+    return NULL;
+  }
+  npy->hdr[len] = '\0';
+  if (fclose(fp)) P_WRN("failed to close file: `%s'\n", fname);
+
+  if (npy_parse(npy)) {
+    P_ERR("unsupported header of NumPy array file: `%s'\n%s\n"
+        "only 1-D plain or structured arrays are supported\n",
+        fname, npy->hdr);
+    npy_destroy(npy);
+    return NULL;
+  }
+  return npy;
+}
+
+/******************************************************************************
+Function `npy_field`:
+  Find a field of a structured array by name.
+Arguments:
+  * `npy`:      structure for the header;
+  * `name`:     name of the field.
+Return:
+  Index of the field; -1 if it is not found.
+******************************************************************************/
+int npy_field(const NPY_t *npy, const char *name) {
+  for (int i = 0; i < npy->nfield; i++) {
+    if (!strcmp(npy->field[i].name, name)) return i;
+  }
+  return -1;
+}
+
+/******************************************************************************
+Function `npy_native`:
+  Check whether a field is stored with the native byte order.
+Arguments:
+  * `field`:    the field.
+Return:
+  False if the bytes of each element have to be swapped; true otherwise.
+******************************************************************************/
+bool npy_native(const NPY_FIELD_t *field) {
+  return field->order == '=' || field->order == '|' ||
+      field->order == NPY_NATIVE_ORDER[0];
+}
+
+/******************************************************************************
+Function `npy_path`:
+  Generate the path of a NumPy array file for a column in a directory.
+Arguments:
+  * `dir`:      name of the directory;
+  * `name`:     name of the column.
+Return:
+  Address of the path on success; NULL on error.
+******************************************************************************/
+char *npy_path(const char *dir, const char *name) {
+  const size_t dlen = strlen(dir);
+  const size_t nlen = strlen(name);
+  char *path = malloc(dlen + nlen + 1 + sizeof(BRICKMASK_NPY_SUFFIX));
+  if (!path) {
+    P_ERR("failed to allocate memory for the path of NumPy arrays\n");
+    return NULL;
+  }
+  memcpy(path, dir, dlen);
+  size_t len = dlen;
+  if (!dlen || dir[dlen - 1] != BRICKMASK_PATH_SEP)
+    path[len++] = BRICKMASK_PATH_SEP;
+  memcpy(path + len, name, nlen);
+  memcpy(path + len + nlen, BRICKMASK_NPY_SUFFIX, sizeof(BRICKMASK_NPY_SUFFIX));
+  return path;
+}
+
+/******************************************************************************
+Function `npy_map`:
+  Map the data of a NumPy array file into memory, for reading.
+Arguments:
+  * `fname`:    name of the file;
+  * `npy`:      structure for the header of the file;
+  * `map`:      address for storing the starting address of the mapping;
+  * `size`:     address for storing the size of the mapping.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int npy_map(const char *fname, const NPY_t *npy, unsigned char **map,
+    size_t *size) {
+  *map = NULL;
+  *size = 0;
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) == -1) {
+    P_ERR("cannot open file for reading: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  struct stat st;
+  if (fstat(fd, &st)) {
+    P_ERR("failed to retrieve the size of file: `%s'\n", fname);
+    close(fd);
+    return BRICKMASK_ERR_FILE;
+  }
+  if ((uintmax_t) st.st_size > SIZE_MAX ||
+      (npy->n && npy->width > (SIZE_MAX - npy->start) / npy->n) ||
+      (size_t) st.st_size < npy->start + npy->n * npy->width) {
+    P_ERR("unexpected size of NumPy array file: `%s'\n", fname);
+    close(fd);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (!npy->n) {                /* nothing to be mapped */
+    close(fd);
+    return 0;
+  }
+
+  *size = st.st_size;
+  void *base = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    P_ERR("failed to map file into memory: `%s'\n", fname);
+    *size = 0;
+    close(fd);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (close(fd)) P_WRN("failed to close file: `%s'\n", fname);
+  posix_madvise(base, *size, POSIX_MADV_SEQUENTIAL);
+  *map = base;
+  return 0;
+}
+
+/******************************************************************************
+Function `npy_mask_descr`:
+  Get the NumPy type descriptor of maskbits, with the native byte order.
+Arguments:
+  * `mtype`:    the CFITSIO data type of maskbits.
+Return:
+  The type descriptor, e.g. "<u2".
+******************************************************************************/
+const char *npy_mask_descr(const int mtype) {
+  switch (mtype) {
+    case TBYTE:  return "|u1";
+    case TSHORT: return NPY_NATIVE_ORDER "u2";
+    case TINT:   return NPY_NATIVE_ORDER "u4";
+    default:     return NPY_NATIVE_ORDER "u8";
+  }
+}
+
+/******************************************************************************
+Function `npy_write_header`:
+  Write the header of a 1-D NumPy array to a file.
+Arguments:
+  * `fp`:       pointer to the file;
+  * `descr`:    Python literal of the data type, e.g. "'<f8'";
+  * `n`:        number of rows of the array.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int npy_write_header(FILE *fp, const char *descr, const size_t n) {
+  const char *fmt = "{'descr': %s, 'fortran_order': False, 'shape': (%zu,), }";
+  const int len = snprintf(NULL, 0, fmt, descr, n);
+  if (len < 0) return BRICKMASK_ERR_FILE;
+
+  /* Pad the header with spaces and a newline, for aligned arrays. */
+  size_t start = 10;                    /* version 1.0 */
+  size_t total = (start + len + 1 + BRICKMASK_NPY_ALIGN - 1) /
+      BRICKMASK_NPY_ALIGN * BRICKMASK_NPY_ALIGN;
+  if (total - start > UINT16_MAX) {
+    start = 12;                         /* version 2.0 */
+    total = (start + len + 1 + BRICKMASK_NPY_ALIGN - 1) /
+        BRICKMASK_NPY_ALIGN * BRICKMASK_NPY_ALIGN;
+  }
+  const size_t hlen = total - start;
+
+  unsigned char *buf = malloc(total + 1);
+  if (!buf) {
+    P_ERR("failed to allocate memory for the header of NumPy arrays\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  memcpy(buf, NPY_MAGIC, NPY_MAGIC_LEN);
+  buf[6] = (start == 10) ? 1 : 2;
+  buf[7] = 0;
+  buf[8] = hlen & 0xff;
+  buf[9] = (hlen >> 8) & 0xff;
+  if (start == 12) {
+    buf[10] = (hlen >> 16) & 0xff;
+    buf[11] = (hlen >> 24) & 0xff;
+  }
+  snprintf((char *) buf + start, len + 1, fmt, descr, n);
+  memset(buf + start + len, ' ', hlen - len - 1);
+  buf[total - 1] = '\n';
+
+  int err = (fwrite(buf, 1, total, fp) != total) ? BRICKMASK_ERR_FILE : 0;
+  free(buf);
+  return err;
+}
@@ -0,0 +1,155 @@
+/*******************************************************************************
+* npy_io.h: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+*******************************************************************************/
+
+#ifndef __NPY_IO_H__
+#define __NPY_IO_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*============================================================================*\
+                       Data structures for NumPy arrays
+\*============================================================================*/
+
+/* Data structure for a field of a NumPy structured array. */
+typedef struct {
+  char *name;           /* name of the field, NULL for plain arrays     */
+  size_t dpos;          /* position of the descriptor in the header     */
+  size_t dlen;          /* length of the descriptor in the header       */
+  size_t offset;        /* offset (in bytes) of the field in a row      */
+  size_t size;          /* number of bytes of the field                 */
+  char order;           /* byte order: '<', '>', '=', or '|'            */
+  char kind;            /* type code, e.g. 'f' for floating-point       */
+} NPY_FIELD_t;
+
+/* Data structure for the header of a NumPy array file. */
+typedef struct {
+  char *hdr;            /* the header string                            */
+  size_t start;         /* starting position (in bytes) of the array    */
+  size_t n;             /* number of rows of the 1-D array              */
+  size_t width;         /* number of bytes of each row                  */
+  int nfield;           /* number of fields, 0 for plain arrays         */
+  NPY_FIELD_t *field;   /* fields, or the element type of plain arrays  */
+} NPY_t;
+
+/*============================================================================*\
+                       Interfaces for NumPy array files
+\*============================================================================*/
+
+/******************************************************************************
+Function `npy_open`:
+  Read and parse the header of a NumPy array file. Only 1-D plain arrays
+  and 1-D structured arrays with scalar or fixed-shape fields are supported.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  Address of the structure for the header on success; NULL on error.
+******************************************************************************/
+NPY_t *npy_open(const char *fname);
+
+/******************************************************************************
+Function `npy_destroy`:
+  Deconstruct the structure for the header of a NumPy array file.
+Arguments:
+  * `npy`:      structure for the header.
+******************************************************************************/
+void npy_destroy(NPY_t *npy);
+
+/******************************************************************************
+Function `npy_field`:
+  Find a field of a structured array by name.
+Arguments:
+  * `npy`:      structure for the header;
+  * `name`:     name of the field.
+Return:
+  Index of the field; -1 if it is not found.
+******************************************************************************/
+int npy_field(const NPY_t *npy, const char *name);
+
+/******************************************************************************
+Function `npy_native`:
+  Check whether a field is stored with the native byte order.
+Arguments:
+  * `field`:    the field.
+Return:
+  False if the bytes of each element have to be swapped; true otherwise.
+******************************************************************************/
+bool npy_native(const NPY_FIELD_t *field);
+
+/******************************************************************************
+Function `npy_path`:
+  Generate the path of a NumPy array file for a column in a directory.
+Arguments:
+  * `dir`:      name of the directory;
+  * `name`:     name of the column.
+Return:
+  Address of the path on success; NULL on error.
+******************************************************************************/
+char *npy_path(const char *dir, const char *name);
+
+/******************************************************************************
+Function `npy_map`:
+  Map the data of a NumPy array file into memory, for reading.
+Arguments:
+  * `fname`:    name of the file;
+  * `npy`:      structure for the header of the file;
+  * `map`:      address for storing the starting address of the mapping;
+  * `size`:     address for storing the size of the mapping.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int npy_map(const char *fname, const NPY_t *npy, unsigned char **map,
+    size_t *size);
+
+/******************************************************************************
+Function `npy_mask_descr`:
+  Get the NumPy type descriptor of maskbits, with the native byte order.
+Arguments:
+  * `mtype`:    the CFITSIO data type of maskbits.
+Return:
+  The type descriptor, e.g. "<u2".
+******************************************************************************/
+const char *npy_mask_descr(const int mtype);
+
+/******************************************************************************
+Function `npy_write_header`:
+  Write the header of a 1-D NumPy array to a file.
+Arguments:
+  * `fp`:       pointer to the file;
+  * `descr`:    Python literal of the data type, e.g. "'<f8'";
+  * `n`:        number of rows of the array.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int npy_write_header(FILE *fp, const char *descr, const size_t n);
+
+#endif
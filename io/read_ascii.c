@@ -11,13 +11,39 @@
 
 *******************************************************************************/
 
+#define _POSIX_C_SOURCE 200809L
 #include "define.h"
 #include "read_file.h"
+#include "stream_io.h"
 #include <stdio.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#ifdef OMP
+#include <omp.h>
+#endif
+
+/* Comparison operators for selecting objects. */
+typedef enum {
+  ASCII_SEL_LT, ASCII_SEL_LE, ASCII_SEL_GT, ASCII_SEL_GE, ASCII_SEL_EQ,
+  ASCII_SEL_NE
+} ASCII_SEL_op_t;
+
+/* Data structure for a comparison between a column and a number. */
+typedef struct {
+  int c;                /* index of the column                          */
+  ASCII_SEL_op_t op;    /* comparison operator                          */
+  double v;             /* the number to be compared with               */
+} ASCII_SEL_t;
 
 /* Data structure for information of the ASCII columns. */
 typedef struct {
@@ -26,8 +52,21 @@ typedef struct {
   int c[2];             /* column indices for RA and Dec                */
   int ncol;             /* number of columns to be read                 */
   int *cid;             /* indices of columns to be read                */
+  int nsel;             /* number of comparisons for the selection      */
+  ASCII_SEL_t *sel;     /* comparisons that must all be satisfied       */
 } ASCII_COL_t;
 
+#ifdef OMP
+/* Data structure for objects parsed by a thread from a range of lines. */
+typedef struct {
+  size_t n;             /* number of objects parsed                     */
+  size_t nmax;          /* number of objects allocated                  */
+  double *ra;           /* right ascension                              */
+  double *dec;          /* declination                                  */
+  size_t *cidx;         /* spans of the output columns                  */
+} ASCII_SEG_t;
+#endif
+
 /*============================================================================*\
                       Functions for reading ASCII columns
 \*============================================================================*/
@@ -42,9 +81,81 @@ static void ascii_col_destroy(ASCII_COL_t *col) {
   if (!col) return;
   if (col->idx) free(col->idx);
   if (col->cid) free(col->cid);
+  if (col->sel) free(col->sel);
   free(col);
 }
 
+/******************************************************************************
+Function `ascii_sel_parse`:
+  Parse the selection criteria for ASCII catalogues, given as comparisons
+  in the form of "$N op value" combined by "&&".
+Arguments:
+  * `str`:      string for the selection criteria;
+  * `col`:      structure for ASCII columns.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int ascii_sel_parse(const char *str, ASCII_COL_t *col) {
+  /* Count the number of comparisons. */
+  int num = 1;
+  for (const char *s = str; (s = strstr(s, "&&")); s += 2) num++;
+  if (!(col->sel = malloc(num * sizeof(ASCII_SEL_t)))) {
+    P_ERR("failed to allocate memory for the selection criteria\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+
+  const char *s = str;
+  for (int i = 0; i < num; i++) {
+    ASCII_SEL_t *sel = col->sel + i;
+    char *end = NULL;
+    /* Column number. */
+    while (isspace((unsigned char) *s)) s++;
+    long c = 0;
+    if (*s == '$' && isdigit((unsigned char) s[1])) c = strtol(s + 1, &end, 10);
+    if (c <= 0 || c > BRICKMASK_MAX_COLUMN) {
+      P_ERR("invalid column in " FMT_KEY(INPUT_SELECTION) ": `%s'\n"
+          "columns must be given by '$' followed by a number in [1, %d]\n",
+          str, BRICKMASK_MAX_COLUMN);
+      return BRICKMASK_ERR_CFG;
+    }
+    sel->c = c - 1;
+    if (col->max < c) col->max = c;
+
+    /* Comparison operator. */
+    s = end;
+    while (isspace((unsigned char) *s)) s++;
+    if (s[0] == '<' && s[1] == '=') { sel->op = ASCII_SEL_LE; s += 2; }
+    else if (s[0] == '>' && s[1] == '=') { sel->op = ASCII_SEL_GE; s += 2; }
+    else if (s[0] == '=' && s[1] == '=') { sel->op = ASCII_SEL_EQ; s += 2; }
+    else if (s[0] == '!' && s[1] == '=') { sel->op = ASCII_SEL_NE; s += 2; }
+    else if (s[0] == '<') { sel->op = ASCII_SEL_LT; s++; }
+    else if (s[0] == '>') { sel->op = ASCII_SEL_GT; s++; }
+    else {
+      P_ERR("invalid operator in " FMT_KEY(INPUT_SELECTION) ": `%s'\n"
+          "the allowed operators are '<', '<=', '>', '>=', '==', and '!='\n",
+          str);
+      return BRICKMASK_ERR_CFG;
+    }
+
+    /* The number to be compared with. */
+    sel->v = strtod(s, &end);
+    if (end == s) {
+      P_ERR("invalid number in " FMT_KEY(INPUT_SELECTION) ": `%s'\n", str);
+      return BRICKMASK_ERR_CFG;
+    }
+    s = end;
+    while (isspace((unsigned char) *s)) s++;
+    if (i < num - 1 && s[0] == '&' && s[1] == '&') s += 2;
+    else if (i != num - 1 || *s != '\0') {
+      P_ERR("invalid " FMT_KEY(INPUT_SELECTION) ": `%s'\n"
+          "comparisons must be combined by '&&'\n", str);
+      return BRICKMASK_ERR_CFG;
+    }
+  }
+  col->nsel = num;
+  return 0;
+}
+
 /******************************************************************************
 Function `ascii_col_init`:
   Initialise the structure for ASCII columns.
@@ -61,6 +172,8 @@ static ASCII_COL_t *ascii_col_init(const CONF *conf) {
   }
   col->idx = NULL;
   col->cid = NULL;
+  col->sel = NULL;
+  col->nsel = 0;
 
   col->ncol = conf->ncol;
   col->c[0] = conf->cnum[0] - 1;        /* column index starting from 0 */
@@ -79,6 +192,12 @@ static ASCII_COL_t *ascii_col_init(const CONF *conf) {
     }
   }
 
+  /* Columns required by the selection criteria. */
+  if (conf->sel && ascii_sel_parse(conf->sel, col)) {
+    ascii_col_destroy(col);
+    return NULL;
+  }
+
   if (!(col->idx = calloc(col->max + 1, sizeof(size_t)))) {
     P_ERR("failed to allocate memory for column indices\n");
     ascii_col_destroy(col);
@@ -104,6 +223,84 @@ static inline char *chunk_resize(void *chunk, size_t *size) {
   return tmp;
 }
 
+/******************************************************************************
+Function `ascii_isspace`:
+  Check whether a character is a whitespace, in the "C" locale.
+Arguments:
+  * `c`:        the character to be checked.
+Return:
+  True if the character is a whitespace; false otherwise.
+******************************************************************************/
+static inline bool ascii_isspace(const char c) {
+  return c == ' ' || (unsigned char) (c - '\t') <= '\r' - '\t';
+}
+
+/* Bit masks of whitespaces for a block of characters, starting from the
+   lowest bit. Whitespaces are ' ', and the range ['\t', '\r']. */
+#if defined(__AVX2__)
+#define ASCII_VEC_LEN   32
+static inline uint32_t space_mask(const char *p) {
+  const __m256i v = _mm256_loadu_si256((const __m256i *) p);
+  const __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+  const __m256i r = _mm256_cmpeq_epi8(t,
+      _mm256_min_epu8(t, _mm256_set1_epi8('\r' - '\t')));
+  const __m256i s = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+  return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(r, s));
+}
+#elif defined(__SSE2__)
+#define ASCII_VEC_LEN   16
+static inline uint32_t space_mask(const char *p) {
+  const __m128i v = _mm_loadu_si128((const __m128i *) p);
+  const __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  const __m128i r = _mm_cmpeq_epi8(t,
+      _mm_min_epu8(t, _mm_set1_epi8('\r' - '\t')));
+  const __m128i s = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  return (uint32_t) _mm_movemask_epi8(_mm_or_si128(r, s));
+}
+#endif
+
+/******************************************************************************
+Function `skip_token`:
+  Find the first whitespace of a string, vector by vector if possible.
+Arguments:
+  * `p`:        starting address of the string;
+  * `end`:      end of the string.
+Return:
+  Address of the first whitespace, or `end` if there is no whitespace.
+******************************************************************************/
+static inline const char *skip_token(const char *p, const char *end) {
+#ifdef ASCII_VEC_LEN
+  for (; end - p >= ASCII_VEC_LEN; p += ASCII_VEC_LEN) {
+    const uint32_t m = space_mask(p);
+    if (m) return p + __builtin_ctz(m);
+  }
+#endif
+  while (p < end && !ascii_isspace(*p)) ++p;
+  return p;
+}
+
+/******************************************************************************
+Function `skip_space`:
+  Find the first non-whitespace character of a string, vector by vector if
+  possible.
+Arguments:
+  * `p`:        starting address of the string;
+  * `end`:      end of the string.
+Return:
+  Address of the first non-whitespace character, or `end` if not found.
+******************************************************************************/
+static inline const char *skip_space(const char *p, const char *end) {
+#ifdef ASCII_VEC_LEN
+  for (; end - p >= ASCII_VEC_LEN; p += ASCII_VEC_LEN) {
+    const uint32_t m = ~space_mask(p) &
+        (uint32_t) ((1ULL << ASCII_VEC_LEN) - 1);
+    if (m) return p + __builtin_ctz(m);
+  }
+#endif
+  while (p < end && ascii_isspace(*p)) ++p;
+  return p;
+}
+
 /******************************************************************************
 Function `column_index`:
   Find column indices of a line.
@@ -116,38 +313,96 @@ Return:
 ******************************************************************************/
 static inline int column_index(const char *line, const size_t num,
     ASCII_COL_t *col) {
+  const char *end = line + num;
+  const char *p = line;         /* now we are at the first column */
   col->idx[0] = 0;
-  bool incol = true;            /* now we are at the first column */
-  int k = 1;
-  for (size_t i = 1; i < num; i++) {
-    if (incol) {
-      if (!isspace(line[i])) continue;
-      incol = false;
-    }
-    else {
-      if (isspace(line[i])) continue;
-      incol = true;
-      col->idx[k++] = i;
-      if (k == col->max) break;
+  for (int k = 1; k < col->max; k++) {
+    p = skip_space(skip_token(p, end), end);
+    if (p == end) {
+      P_ERR("too few columns of line:\n%.*s\n", (int) num, line);
+      return BRICKMASK_ERR_FILE;
     }
-  }
-  if (k != col->max || !incol) {
-    P_ERR("too few columns of line:\n%s\n", line);
-    return BRICKMASK_ERR_FILE;
+    col->idx[k] = p - line;
   }
 
   /* Find the end of the last column. */
-  col->idx[col->max] = num;
-  if (col->ncol) {
-    for (size_t i = col->idx[col->max - 1]; i < num; i++) {
-      if (isspace(line[i])) {
-        col->idx[col->max] = i;
-        break;
+  col->idx[col->max] = (col->ncol) ? (size_t) (skip_token(p, end) - line) :
+      num;
+  return 0;
+}
+
+/* The fast path requires arithmetic to be carried out in double precision,
+   without the double rounding of x87 extended precision registers. */
+#if FLT_EVAL_METHOD == 0
+#define FAST_PARSE_DOUBLE
+/******************************************************************************
+Function `parse_double`:
+  Parse a decimal floating-point number that is exactly representable by
+  the significand of a double precision number, with a power-of-ten
+  exponent up to 22. In this case, the result of a single multiplication
+  or division is correctly rounded (Clinger 1990).
+Arguments:
+  * `p`:        starting address of the number;
+  * `end`:      end of the line containing the number;
+  * `x`:        address for storing the number.
+Return:
+  Zero on success; non-zero if the fast path is not applicable.
+******************************************************************************/
+static inline int parse_double(const char *p, const char *end, double *x) {
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+  uint64_t w = 0;               /* decimal significand */
+  int ndigit = 0;               /* number of significant digits */
+  int e10 = 0;                  /* decimal exponent */
+  bool valid = false;
+  for (; p < end && (unsigned char) (*p - '0') <= 9; p++) {
+    valid = true;
+    if (w || *p != '0') {
+      if (++ndigit > 19) return 1;
+      w = w * 10 + (*p - '0');
+    }
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && (unsigned char) (*p - '0') <= 9; p++) {
+      valid = true;
+      e10--;
+      if (w || *p != '0') {
+        if (++ndigit > 19) return 1;
+        w = w * 10 + (*p - '0');
       }
     }
   }
+  if (!valid) return 1;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    bool eneg = false;
+    if (++p < end && (*p == '-' || *p == '+')) eneg = (*p++ == '-');
+    if (p == end || (unsigned char) (*p - '0') > 9) return 1;
+    int e = 0;
+    for (; p < end && (unsigned char) (*p - '0') <= 9; p++) {
+      if (e > 9999) return 1;
+      e = e * 10 + (*p - '0');
+    }
+    e10 += (eneg) ? -e : e;
+  }
+  /* Leave trailing characters to the slow path. */
+  if (p < end && !ascii_isspace(*p) && *p != '\0') return 1;
+
+  if (w > (UINT64_C(1) << 53) || e10 < -22 || e10 > 22) {
+    if (w) return 1;
+    e10 = 0;                    /* zero with any exponent */
+  }
+  double v = (double) w;
+  v = (e10 < 0) ? v / pow10[-e10] : v * pow10[e10];
+  *x = (neg) ? -v : v;
   return 0;
 }
+#endif
 
 /******************************************************************************
 Function `copy_column`:
@@ -182,6 +437,103 @@ static inline char *copy_column(char *content, size_t *size, size_t *max,
   return content;
 }
 
+/******************************************************************************
+Function `data_enlarge`:
+  Double the number of objects allocated for the input catalogue.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `data`:     structure for storing the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int data_enlarge(const char *fname, DATA *data) {
+  if (SIZE_MAX / 2 / CIDX_PER_OBJECT(data) / sizeof(size_t) < data->nmax) {
+    P_ERR("too many objects in the file: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  data->nmax *= 2;
+  double *tmp = realloc(data->ra, data->nmax * sizeof(double));
+  if (!tmp) {
+    P_ERR("failed to enlarge memory for the input catalog\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  data->ra = tmp;
+  if (!(tmp = realloc(data->dec, data->nmax * sizeof(double)))) {
+    P_ERR("failed to enlarge memory for the input catalog\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  data->dec = tmp;
+  size_t *stmp = realloc(data->cidx,
+      data->nmax * CIDX_PER_OBJECT(data) * sizeof(size_t));
+  if (!stmp) {
+    P_ERR("failed to enlarge memory for the input catalog\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  data->cidx = stmp;
+  return 0;
+}
+
+/******************************************************************************
+Function `parse_coord`:
+  Parse a coordinate from a column that is not null-terminated.
+Arguments:
+  * `p`:        starting address of the column;
+  * `end`:      end of the line containing the column;
+  * `x`:        address for storing the coordinate.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static inline int parse_coord(const char *p, const char *end, double *x) {
+#ifdef FAST_PARSE_DOUBLE
+  if (!parse_double(p, end, x)) return 0;
+#endif
+
+  /* Fall back to the C library for the rest of the cases. */
+  char num[BRICKMASK_MAX_NUM_LEN];
+  const size_t n = skip_token(p, end) - p;
+  if (n >= BRICKMASK_MAX_NUM_LEN) return BRICKMASK_ERR_FILE;
+  memcpy(num, p, n);
+  num[n] = '\0';
+  if (sscanf(num, "%lf", x) != 1) return BRICKMASK_ERR_FILE;
+  return 0;
+}
+
+/******************************************************************************
+Function `select_line`:
+  Check whether a line passes the selection criteria.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `p`:        starting address of the line, with indices of columns found;
+  * `endl`:     end of the line;
+  * `col`:      structure for columns to be read;
+  * `keep`:     indicate whether the line is selected.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static inline int select_line(const char *fname, const char *p,
+    const char *endl, const ASCII_COL_t *col, bool *keep) {
+  *keep = true;
+  for (int i = 0; i < col->nsel; i++) {
+    const ASCII_SEL_t *sel = col->sel + i;
+    double x;
+    if (parse_coord(p + col->idx[sel->c], endl, &x)) {
+      P_ERR("failed to read the column for selection from file: `%s':\n"
+          "%.*s\n", fname, (int) (endl - p), p);
+      return BRICKMASK_ERR_FILE;
+    }
+    switch (sel->op) {
+      case ASCII_SEL_LT: *keep = (x < sel->v); break;
+      case ASCII_SEL_LE: *keep = (x <= sel->v); break;
+      case ASCII_SEL_GT: *keep = (x > sel->v); break;
+      case ASCII_SEL_GE: *keep = (x >= sel->v); break;
+      case ASCII_SEL_EQ: *keep = (x == sel->v); break;
+      default:           *keep = (x != sel->v); break;
+    }
+    if (!*keep) return 0;
+  }
+  return 0;
+}
+
 /******************************************************************************
 Function `read_ascii_col`:
   Read columns of an ASCII text file.
@@ -203,10 +555,9 @@ static int read_ascii_col(const char *fname, const char comment,
     return BRICKMASK_ERR_MEMORY;
   }
 
-  /* Open the file for reading. */
-  FILE *fp;
-  if (!(fp = fopen(fname, "r"))) {
-    P_ERR("cannot open file for reading: `%s'\n", fname);
+  /* Open the file for reading, with decompression if necessary. */
+  ISTREAM *fp;
+  if (!(fp = istream_open(fname))) {
     free(chunk);
     return BRICKMASK_ERR_FILE;
   }
@@ -214,7 +565,7 @@ static int read_ascii_col(const char *fname, const char comment,
   nrest = 0;
 
   /* Start reading the file by chunk. */
-  while ((nread = fread(chunk + nrest, sizeof(char), cmax - nrest, fp))) {
+  while ((nread = istream_read(fp, chunk + nrest, cmax - nrest))) {
     char *p = chunk;
     char *end = p + nrest + nread;
     char *endl;
@@ -223,112 +574,109 @@ static int read_ascii_col(const char *fname, const char comment,
     /* Process lines in the chunk. */
     while ((endl = memchr(p, '\n', end - p))) {
       *endl = '\0';             /* replace '\n' by string terminator '\0' */
-      while (isspace(*p)) ++p;          /* omit leading whitespaces */
+      p = (char *) skip_space(p, endl); /* omit leading whitespaces */
       if (*p == comment || *p == '\0') {        /* comment or empty */
         p = endl + 1;
         continue;
       }
 
-      /* Find indices of columns. */
-      if (column_index(p, endl - p, col)) {
-        free(chunk); fclose(fp);
+      /* Find indices of columns, and apply the selection. */
+      bool keep = true;
+      if (column_index(p, endl - p, col) ||
+          select_line(fname, p, endl, col, &keep)) {
+        free(chunk); istream_close(fp);
         return BRICKMASK_ERR_FILE;
       }
+      if (!keep) {
+        p = endl + 1;
+        continue;
+      }
 
-      /* Copy output columns into memory. */
+      /* Copy output columns into memory, unless only maskbits are saved. */
       data->cidx[data->n] = data->csize;
-      if (col->ncol) {          /* copy given columns */
-        for (int i = 0; i < col->ncol; i++) {
-          const int c = col->cid[i];            /* current column number */
+      if (data->content) {
+        if (col->ncol) {        /* copy given columns */
+          for (int i = 0; i < col->ncol; i++) {
+            const int c = col->cid[i];          /* current column number */
+            char *tmp = copy_column(data->content, &data->csize, &data->cmax,
+                p + col->idx[c], col->idx[c + 1] - col->idx[c]);
+            if (!tmp) {
+              P_ERR("failed to save columns of the input file: `%s'\n", fname);
+              free(chunk); istream_close(fp);
+              return BRICKMASK_ERR_MEMORY;
+            }
+            data->content = tmp;
+            /* Append whitespace to the last column of the original file. */
+            if (c == col->max - 1) {
+              if (!(tmp = copy_column(data->content, &data->csize,
+                  &data->cmax, " ", 1))) {
+                P_ERR("failed to save columns of the input file: `%s'\n",
+                    fname);
+                free(chunk); istream_close(fp);
+                return BRICKMASK_ERR_MEMORY;
+              }
+              data->content = tmp;
+            }
+          }
+        }
+        else {                  /* copy all columns */
           char *tmp = copy_column(data->content, &data->csize, &data->cmax,
-              p + col->idx[c], col->idx[c + 1] - col->idx[c]);
+              p, endl - p);
           if (!tmp) {
             P_ERR("failed to save columns of the input file: `%s'\n", fname);
-            free(chunk); fclose(fp);
+            free(chunk); istream_close(fp);
             return BRICKMASK_ERR_MEMORY;
           }
           data->content = tmp;
-          /* Append whitespace to the last column of the original file. */
-          if (c == col->max - 1) {
-            if (!(tmp = copy_column(data->content, &data->csize, &data->cmax,
-                " ", 1))) {
-              P_ERR("failed to save columns of the input file: `%s'\n", fname);
-              free(chunk); fclose(fp);
-              return BRICKMASK_ERR_MEMORY;
-            }
-            data->content = tmp;
+          /* Append white space to the end of the line. */
+          if (!(tmp = copy_column(data->content, &data->csize, &data->cmax,
+              " ", 1))) {
+            P_ERR("failed to save columns of the input file: `%s'\n", fname);
+            free(chunk); istream_close(fp);
+            return BRICKMASK_ERR_MEMORY;
           }
+          data->content = tmp;
         }
+        /* Always append a '\0' at the end. */
+        *((char *) data->content + data->csize++) = '\0';
       }
-      else {                    /* copy all columns */
-        char *tmp = copy_column(data->content, &data->csize, &data->cmax,
-            p, endl - p);
-        if (!tmp) {
-          P_ERR("failed to save columns of the input file: `%s'\n", fname);
-          free(chunk); fclose(fp);
-          return BRICKMASK_ERR_MEMORY;
-        }
-        data->content = tmp;
-        /* Append white space to the end of the line. */
-        if (!(tmp = copy_column(data->content, &data->csize, &data->cmax,
-            " ", 1))) {
-          P_ERR("failed to save columns of the input file: `%s'\n", fname);
-          free(chunk); fclose(fp);
-          return BRICKMASK_ERR_MEMORY;
-        }
-        data->content = tmp;
-      }
-      /* Always append a '\0' at the end. */
-      *((char *) data->content + data->csize++) = '\0';
 
       /* Parse RA and Dec. */
-      if (sscanf(p + col->idx[col->c[0]], "%lf", data->ra + data->n) != 1 ||
-          sscanf(p + col->idx[col->c[1]], "%lf", data->dec + data->n) != 1) {
+      if (parse_coord(p + col->idx[col->c[0]], endl, data->ra + data->n) ||
+          parse_coord(p + col->idx[col->c[1]], endl, data->dec + data->n)) {
         P_ERR("failed to read coordinates from file: `%s':\n%s\n", fname, p);
-        free(chunk); fclose(fp);
+        free(chunk); istream_close(fp);
         return BRICKMASK_ERR_FILE;
       }
 
       /* Enlarge memory for the data if necessary. */
       if (++data->n >= data->nmax) {
-        if (SIZE_MAX / 2 < data->nmax) {
-          P_ERR("too many objects in the file: `%s'\n", fname);
-          free(chunk); fclose(fp);
-          return BRICKMASK_ERR_FILE;
-        }
-        data->nmax *= 2;
-        double *tmp = realloc(data->ra, data->nmax * sizeof(double));
-        if (!tmp) {
-          P_ERR("failed to enlarge memory for the input catalog\n");
-          free(chunk); fclose(fp);
-          return BRICKMASK_ERR_MEMORY;
+        int err = data_enlarge(fname, data);
+        if (err) {
+          free(chunk); istream_close(fp);
+          return err;
         }
-        data->ra = tmp;
-        if (!(tmp = realloc(data->dec, data->nmax * sizeof(double)))) {
-          P_ERR("failed to enlarge memory for the input catalog\n");
-          free(chunk); fclose(fp);
-          return BRICKMASK_ERR_MEMORY;
-        }
-        data->dec = tmp;
-        size_t *stmp = realloc(data->cidx, data->nmax * sizeof(size_t));
-        if (!stmp) {
-          P_ERR("failed to enlarge memory for the input catalog\n");
-          free(chunk); fclose(fp);
-          return BRICKMASK_ERR_MEMORY;
-        }
-        data->cidx = stmp;
       }
 
       /* Continue with the next line. */
       p = endl + 1;
     }
 
+    /* Report the objects that are available. */
+    if (data->hook) {
+      int err = data->hook(data->ra, data->dec, data->n, data->harg);
+      if (err) {
+        free(chunk); istream_close(fp);
+        return err;
+      }
+    }
+
     /* The chunk cannot hold a full line. */
     if (p == chunk) {
       char *tmp = chunk_resize(chunk, &cmax);
       if (!tmp) {
         P_ERR("failed to enlarge memory for reading file by chunk\n");
-        free(chunk); fclose(fp);
+        free(chunk); istream_close(fp);
         return BRICKMASK_ERR_MEMORY;
       }
       chunk = tmp;
@@ -342,13 +690,335 @@ static int read_ascii_col(const char *fname, const char comment,
   }
 
   free(chunk);
-  if (!feof(fp)) {
+  if (istream_error(fp)) {
     P_ERR("unexpected end of file: `%s'\n", fname);
-    fclose(fp);
+    istream_close(fp);
     return BRICKMASK_ERR_FILE;
   }
-  if (fclose(fp)) P_WRN("failed to close file: `%s'\n", fname);
+  istream_close(fp);
+
+  return 0;
+}
+
+
+/******************************************************************************
+Function `parse_line`:
+  Parse a line of a memory-mapped ASCII file.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `base`:     starting address of the mapped file;
+  * `p`:        starting address of the line, with no leading whitespace;
+  * `endl`:     end of the line;
+  * `col`:      structure for columns to be read;
+  * `ra`:       address for storing the right ascension;
+  * `dec`:      address for storing the declination;
+  * `span`:     address for storing spans of the output columns;
+  * `keep`:     indicate whether the line passes the selection.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static inline int parse_line(const char *fname, const char *base,
+    const char *p, const char *endl, ASCII_COL_t *col, double *ra,
+    double *dec, size_t *span, bool *keep) {
+  /* Find indices of columns, and apply the selection. */
+  if (column_index(p, endl - p, col) ||
+      select_line(fname, p, endl, col, keep)) return BRICKMASK_ERR_FILE;
+  if (!*keep) return 0;
+
+  /* Record spans of the output columns. */
+  if (col->ncol) {
+    for (int i = 0; i < col->ncol; i++) {
+      const int c = col->cid[i];                /* current column number */
+      span[2 * i] = p - base + col->idx[c];
+      span[2 * i + 1] = col->idx[c + 1] - col->idx[c];
+    }
+  }
+  else {
+    span[0] = p - base;
+    span[1] = endl - p;
+  }
+
+  /* Parse RA and Dec. */
+  if (parse_coord(p + col->idx[col->c[0]], endl, ra) ||
+      parse_coord(p + col->idx[col->c[1]], endl, dec)) {
+    P_ERR("failed to read coordinates from file: `%s':\n%.*s\n", fname,
+        (int) (endl - p), p);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+#ifdef OMP
+/******************************************************************************
+Function `parse_range`:
+  Parse a range of lines of a memory-mapped ASCII file, by a single thread.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `base`:     starting address of the mapped file;
+  * `p`:        starting address of the range, at the beginning of a line;
+  * `end`:      end of the range;
+  * `comment`:  symbol indicating lines to be skipped;
+  * `nidx`:     number of span indices per object;
+  * `col`:      structure for columns to be read;
+  * `seg`:      structure for storing the parsed objects.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int parse_range(const char *fname, const char *base, const char *p,
+    const char *end, const char comment, const size_t nidx,
+    ASCII_COL_t *col, ASCII_SEG_t *seg) {
+  seg->n = 0;
+  while (p < end) {
+    const char *endl = memchr(p, '\n', end - p);
+    if (!endl) endl = end;                      /* last line without '\n' */
+    p = skip_space(p, endl);                    /* omit leading whitespaces */
+    if (p == endl || *p == comment) {           /* comment or empty */
+      p = (endl < end) ? endl + 1 : end;
+      continue;
+    }
+
+    /* Enlarge memory for the objects if necessary. */
+    if (seg->n == seg->nmax) {
+      if (SIZE_MAX / 2 / nidx / sizeof(size_t) < seg->nmax) {
+        P_ERR("too many objects in the file: `%s'\n", fname);
+        return BRICKMASK_ERR_FILE;
+      }
+      seg->nmax *= 2;
+      double *tmp = realloc(seg->ra, seg->nmax * sizeof(double));
+      if (!tmp) {
+        P_ERR("failed to enlarge memory for the input catalog\n");
+        return BRICKMASK_ERR_MEMORY;
+      }
+      seg->ra = tmp;
+      if (!(tmp = realloc(seg->dec, seg->nmax * sizeof(double)))) {
+        P_ERR("failed to enlarge memory for the input catalog\n");
+        return BRICKMASK_ERR_MEMORY;
+      }
+      seg->dec = tmp;
+      size_t *stmp = realloc(seg->cidx, seg->nmax * nidx * sizeof(size_t));
+      if (!stmp) {
+        P_ERR("failed to enlarge memory for the input catalog\n");
+        return BRICKMASK_ERR_MEMORY;
+      }
+      seg->cidx = stmp;
+    }
+
+    /* Parse the line. */
+    bool keep;
+    if (parse_line(fname, base, p, endl, col, seg->ra + seg->n,
+        seg->dec + seg->n, seg->cidx + nidx * seg->n, &keep))
+      return BRICKMASK_ERR_FILE;
+    if (keep) seg->n++;
+
+    /* Continue with the next line. */
+    p = (endl < end) ? endl + 1 : end;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `read_map_omp`:
+  Read a memory-mapped ASCII file with multiple threads. The file is
+  processed by blocks, each split into ranges aligned to line boundaries.
+  The ranges are parsed concurrently, and the results are then appended to
+  the data in order.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `base`:     starting address of the mapped file;
+  * `fsize`:    size of the mapped file;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for storing the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int read_map_omp(const char *fname, const char *base,
+    const size_t fsize, const CONF *conf, DATA *data) {
+  const int nrange = omp_get_max_threads();
+  const size_t nidx = CIDX_PER_OBJECT(data);
+  ASCII_COL_t **col = calloc(nrange, sizeof(ASCII_COL_t *));
+  ASCII_SEG_t *seg = calloc(nrange, sizeof(ASCII_SEG_t));
+  const char **bound = malloc((nrange + 1) * sizeof(char *));
+  size_t *offset = malloc(nrange * sizeof(size_t));
+  int err = 0;
+  if (!col || !seg || !bound || !offset) {
+    P_ERR("failed to allocate memory for reading file with threads\n");
+    err = BRICKMASK_ERR_MEMORY;
+  }
+  for (int i = 0; !err && i < nrange; i++) {
+    seg[i].nmax = BRICKMASK_DATA_INIT_NUM;
+    if (!(col[i] = ascii_col_init(conf)) ||
+        !(seg[i].ra = malloc(seg[i].nmax * sizeof(double))) ||
+        !(seg[i].dec = malloc(seg[i].nmax * sizeof(double))) ||
+        !(seg[i].cidx = malloc(seg[i].nmax * nidx * sizeof(size_t)))) {
+      P_ERR("failed to allocate memory for reading file with threads\n");
+      err = BRICKMASK_ERR_MEMORY;
+    }
+  }
+
+  const char *end = base + fsize;
+  const char *p = base;
+  while (!err && p < end) {
+    /* Split the next block into ranges aligned to line boundaries. */
+    bound[0] = p;
+    for (int i = 1; i <= nrange; i++) {
+      const size_t len = BRICKMASK_OMP_PARSE_SIZE * (size_t) i;
+      const char *b = (len < (size_t) (end - p)) ? p + len : end;
+      if (b <= bound[i - 1]) b = bound[i - 1];
+      else if (b < end) {
+        const char *endl = memchr(b - 1, '\n', end - b + 1);
+        b = (endl) ? endl + 1 : end;
+      }
+      bound[i] = b;
+    }
+
+    /* Parse the ranges concurrently. */
+#pragma omp parallel for schedule(static) reduction(|:err)
+    for (int i = 0; i < nrange; i++) {
+      err |= parse_range(fname, base, bound[i], bound[i + 1], conf->comment,
+          nidx, col[i], seg + i);
+    }
+    if (err) break;
+
+    /* Append the objects in the original order. */
+    size_t num = 0;
+    for (int i = 0; i < nrange; i++) {
+      offset[i] = data->n + num;
+      num += seg[i].n;
+    }
+    while (data->n + num >= data->nmax) {
+      if ((err = data_enlarge(fname, data))) break;
+    }
+    if (err) break;
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < nrange; i++) {
+      memcpy(data->ra + offset[i], seg[i].ra, seg[i].n * sizeof(double));
+      memcpy(data->dec + offset[i], seg[i].dec, seg[i].n * sizeof(double));
+      memcpy(data->cidx + offset[i] * nidx, seg[i].cidx,
+          seg[i].n * nidx * sizeof(size_t));
+    }
+    data->n += num;
+    p = bound[nrange];
+
+    /* Report the objects that are available. */
+    if (data->hook)
+      err = data->hook(data->ra, data->dec, data->n, data->harg);
+  }
+
+  if (col) {
+    for (int i = 0; i < nrange; i++) ascii_col_destroy(col[i]);
+    free(col);
+  }
+  if (seg) {
+    for (int i = 0; i < nrange; i++) {
+      if (seg[i].ra) free(seg[i].ra);
+      if (seg[i].dec) free(seg[i].dec);
+      if (seg[i].cidx) free(seg[i].cidx);
+    }
+    free(seg);
+  }
+  if (bound) free(bound);
+  if (offset) free(offset);
+  return err;
+}
+#endif
+
+/******************************************************************************
+Function `read_ascii_map`:
+  Read columns of an ASCII text file through memory mapping. Only the
+  (offset, length) spans of the output columns are recorded, and the
+  mapping is kept alive for writing the output catalogue.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
+  * `conf`:     structure for storing configurations;
+  * `col`:      structure for columns to be read;
+  * `data`:     structure for storing the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int read_ascii_map(const char *fname, const int icat,
+    const CONF *conf, ASCII_COL_t *col, DATA *data) {
+  /* Open the file and map it into memory. */
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) == -1) {
+    P_ERR("cannot open file for reading: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  struct stat st;
+  if (fstat(fd, &st)) {
+    P_ERR("failed to retrieve the size of file: `%s'\n", fname);
+    close(fd);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (!st.st_size) {            /* nothing to be mapped */
+    close(fd);
+    return 0;
+  }
+  if ((uintmax_t) st.st_size > SIZE_MAX) {
+    P_ERR("the file is too large for memory mapping: `%s'\n", fname);
+    close(fd);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  const size_t fsize = st.st_size;
+  char *base = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    P_ERR("failed to map file into memory: `%s'\n", fname);
+    close(fd);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (close(fd)) P_WRN("failed to close file: `%s'\n", fname);
+  posix_madvise(base, fsize, POSIX_MADV_SEQUENTIAL);
 
+  /* The mapping is released by `data_destroy`. */
+  data->fmap[icat] = base;
+  data->fsize[icat] = fsize;
+
+#ifdef OMP
+  /* Files read concurrently are parsed by their own threads only. */
+  if (omp_get_max_threads() > 1 && !omp_in_parallel())
+    return read_map_omp(fname, base, fsize, conf, data);
+#endif
+
+  const char comment = conf->comment;
+  const char *end = base + fsize;
+  const char *next = base + BRICKMASK_FILE_CHUNK;       /* for the hook */
+  const char *p = base;
+  while (p < end) {
+    const char *endl = memchr(p, '\n', end - p);
+    if (!endl) endl = end;                      /* last line without '\n' */
+    p = skip_space(p, endl);                    /* omit leading whitespaces */
+    if (p == endl || *p == comment) {           /* comment or empty */
+      p = (endl < end) ? endl + 1 : end;
+      continue;
+    }
+
+    /* Parse the line. */
+    bool keep;
+    if (parse_line(fname, base, p, endl, col, data->ra + data->n,
+        data->dec + data->n, data->cidx + CIDX_PER_OBJECT(data) * data->n,
+        &keep))
+      return BRICKMASK_ERR_FILE;
+
+    /* Enlarge memory for the data if necessary. */
+    if (keep && ++data->n >= data->nmax) {
+      int err = data_enlarge(fname, data);
+      if (err) return err;
+    }
+
+    /* Continue with the next line. */
+    p = (endl < end) ? endl + 1 : end;
+
+    /* Report the objects that are available. */
+    if (data->hook && p >= next) {
+      int err = data->hook(data->ra, data->dec, data->n, data->harg);
+      if (err) return err;
+      next = p + BRICKMASK_FILE_CHUNK;
+    }
+  }
+
+  if (data->hook) return data->hook(data->ra, data->dec, data->n, data->harg);
   return 0;
 }
 
@@ -362,12 +1032,14 @@ Function `read_ascii`:
   Read data from the input ASCII catalogue.
 Arguments:
   * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
   * `conf`:     structure for storing configurations;
   * `data`:     structure for the input data catalogue.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-int read_ascii(const char *fname, const CONF *conf, DATA *data) {
+int read_ascii(const char *fname, const int icat, const CONF *conf,
+    DATA *data) {
   if (!conf) {
     P_ERR("configuration parameters are not loaded\n");
     return BRICKMASK_ERR_INIT;
@@ -379,13 +1051,13 @@ int read_ascii(const char *fname, const CONF *conf, DATA *data) {
 
   /* Check columns to be read. */
   ASCII_COL_t *col = ascii_col_init(conf);
-  if (!col) {
-    P_ERR("failed to allocate memory for ASCII columns\n");
-    return BRICKMASK_ERR_MEMORY;
-  }
+  if (!col) return BRICKMASK_ERR_MEMORY;
 
   /* Read the file. */
-  if (read_ascii_col(fname, conf->comment, col, data)) {
+  int err = (data->nspan) ?
+      read_ascii_map(fname, icat, conf, col, data) :
+      read_ascii_col(fname, conf->comment, col, data);
+  if (err) {
     ascii_col_destroy(col);
     return BRICKMASK_ERR_FILE;
   }
@@ -46,12 +46,14 @@ Function `read_ascii`:
   Read data from the input ASCII catalogue.
 Arguments:
   * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
   * `conf`:     structure for storing configurations;
   * `data`:     structure for the input data catalog.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-int read_ascii(const char *fname, const CONF *conf, DATA *data);
+int read_ascii(const char *fname, const int icat, const CONF *conf,
+    DATA *data);
 
 /******************************************************************************
 Function `read_fname`:
@@ -81,12 +83,44 @@ Function `read_fits`:
   Read data from the input FITS catalogue.
 Arguments:
   * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
   * `conf`:     structure for storing configurations;
   * `data`:     structure for the input data catalogue.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-int read_fits(const char *fname, const CONF *conf, DATA *data);
+int read_fits(const char *fname, const int icat, const CONF *conf,
+    DATA *data);
+
+/******************************************************************************
+Function `read_npy`:
+  Read data from the input NumPy array file, or directory of array files.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int read_npy(const char *fname, const int icat, const CONF *conf,
+    DATA *data);
+
+#ifdef HDF5
+/******************************************************************************
+Function `read_hdf5`:
+  Read coordinates from datasets of the input HDF5 file.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int read_hdf5(const char *fname, const int icat, const CONF *conf,
+    DATA *data);
+#endif
 
 /******************************************************************************
 Function `read_mask`:
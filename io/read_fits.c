@@ -11,6 +11,7 @@
 
 *******************************************************************************/
 
+#define _POSIX_C_SOURCE 200809L
 #include "define.h"
 #include "read_file.h"
 #include <fitsio.h>
@@ -19,6 +20,9 @@
 #include <string.h>
 #include <limits.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 /* Validate macros for data types. */
 #if TBYTE >= TSHORT
@@ -42,6 +46,20 @@
   return BRICKMASK_ERR_FILE;                                    \
 }
 
+/* Give up the raw access of tables, and clear CFITSIO errors if any. */
+#define FITS_RAW_SKIP {                                         \
+  fits_clear_errmsg();                                          \
+  return false;                                                 \
+}
+
+/* Data structure for reading coordinates from raw binary table rows. */
+typedef struct {
+  LONGLONG start;       /* starting position of the table in the file   */
+  long width;           /* number of bytes per row                      */
+  long off[2];          /* offsets of RA and Dec in a row               */
+  int size[2];          /* number of bytes of RA and Dec (E: 4, D: 8)   */
+} FITS_RAW_t;
+
 /*============================================================================*\
                      Functions for processing FITS columns
 \*============================================================================*/
@@ -106,18 +124,361 @@ static inline int get_fits_col(const CONF *conf, DATA *data, fitsfile *fp) {
   return 0;
 }
 
+/******************************************************************************
+Function `bintable_colsize`:
+  Compute the number of bytes of a binary table column from its format.
+Arguments:
+  * `tform`:    value of the TFORMn keyword.
+Return:
+  Number of bytes of the column on success; negative if unknown.
+******************************************************************************/
+static long bintable_colsize(const char *tform) {
+  const char *p = tform;
+  while (*p == ' ') p++;
+  long repeat = 1;
+  if (isdigit(*p)) {
+    repeat = 0;
+    for (; isdigit(*p); p++) {
+      if (repeat > LONG_MAX / 10 / 16) return -1;
+      repeat = repeat * 10 + (*p - '0');
+    }
+  }
+  switch (toupper(*p)) {
+    case 'X': return (repeat + 7) / 8;
+    case 'L': case 'B': case 'A': return repeat;
+    case 'I': return repeat * 2;
+    case 'J': case 'E': return repeat * 4;
+    case 'K': case 'D': case 'C': case 'P': return repeat * 8;
+    case 'M': case 'Q': return repeat * 16;
+    default: return -1;
+  }
+}
+
+/******************************************************************************
+Function `raw_coord_init`:
+  Check whether coordinates can be read from raw rows of the file, i.e.,
+  the file is an uncompressed binary table on disk, and RA and Dec are
+  unscaled scalar columns of type E or D.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `fp`:       pointer to the opened FITS file;
+  * `col`:      column numbers of RA and Dec;
+  * `raw`:      structure for the raw table access.
+Return:
+  True if the raw access is applicable; false otherwise.
+******************************************************************************/
+static bool raw_coord_init(const char *fname, fitsfile *fp, const int *col,
+    FITS_RAW_t *raw) {
+  /* The file must be a plain FITS file, not decompressed or filtered. */
+  struct stat st;
+  if (stat(fname, &st) || !S_ISREG(st.st_mode)) return false;
+  FILE *f = fopen(fname, "rb");
+  if (!f) return false;
+  char magic[6];
+  const size_t nmagic = fread(magic, sizeof(char), 6, f);
+  fclose(f);
+  if (nmagic != 6 || strncmp(magic, "SIMPLE", 6)) return false;
+
+  int status = 0;
+  int hdutype = 0;
+  if (fits_get_hdu_type(fp, &hdutype, &status) || hdutype != BINARY_TBL)
+    FITS_RAW_SKIP;
+  int ztable = 0;
+  if (!fits_read_key_log(fp, "ZTABLE", &ztable, NULL, &status) && ztable)
+    return false;                               /* tile-compressed table */
+  status = 0;
+
+  /* Check the data type and scaling of the coordinate columns. */
+  for (int i = 0; i < 2; i++) {
+    int type = 0;
+    long repeat = 0;
+    if (fits_get_coltype(fp, col[i], &type, &repeat, NULL, &status) ||
+        repeat != 1 || (type != TFLOAT && type != TDOUBLE)) FITS_RAW_SKIP;
+    raw->size[i] = (type == TFLOAT) ? 4 : 8;
+
+    char key[FLEN_KEYWORD];
+    double scale = 1, zero = 0;
+    snprintf(key, FLEN_KEYWORD, "TSCAL%d", col[i]);
+    if (fits_read_key_dbl(fp, key, &scale, NULL, &status)) {
+      if (status != KEY_NO_EXIST) FITS_RAW_SKIP;
+      status = 0;
+      scale = 1;
+    }
+    snprintf(key, FLEN_KEYWORD, "TZERO%d", col[i]);
+    if (fits_read_key_dbl(fp, key, &zero, NULL, &status)) {
+      if (status != KEY_NO_EXIST) FITS_RAW_SKIP;
+      status = 0;
+      zero = 0;
+    }
+    if (scale != 1 || zero != 0) FITS_RAW_SKIP;
+  }
+
+  /* Compute offsets of the coordinates from column formats. */
+  int nc = 0;
+  long width = 0;
+  LONGLONG nrow = 0;
+  if (fits_get_num_cols(fp, &nc, &status) ||
+      fits_get_num_rowsll(fp, &nrow, &status) ||
+      fits_read_key_lng(fp, "NAXIS1", &raw->width, NULL, &status))
+    FITS_RAW_SKIP;
+  for (int i = 1; i <= nc; i++) {
+    char key[FLEN_KEYWORD], tform[FLEN_VALUE];
+    snprintf(key, FLEN_KEYWORD, "TFORM%d", i);
+    if (fits_read_key_str(fp, key, tform, NULL, &status)) FITS_RAW_SKIP;
+    if (i == col[0]) raw->off[0] = width;
+    if (i == col[1]) raw->off[1] = width;
+    const long w = bintable_colsize(tform);
+    if (w < 0 || w > LONG_MAX - width) return false;
+    width += w;
+  }
+  if (width != raw->width || width <= 0) return false;
+
+  /* Locate the table in the file. */
+  LONGLONG head, end;
+  if (fits_get_hduaddrll(fp, &head, &raw->start, &end, &status))
+    FITS_RAW_SKIP;
+  if (nrow > (end - raw->start) / width ||
+      raw->start + nrow * width > (LONGLONG) st.st_size) return false;
+  return true;
+}
+
+/******************************************************************************
+Function `raw_column`:
+  Extract a big-endian floating-point column from raw table rows.  The
+  shifts are compiled into single byte swaps, and each value sits in a
+  different row, so the loop is bound by memory rather than instructions.
+Arguments:
+  * `buf`:      the raw table rows;
+  * `nrow`:     number of rows;
+  * `width`:    number of bytes per row;
+  * `off`:      offset of the column in a row;
+  * `size`:     number of bytes of the column (4 or 8);
+  * `x`:        array for the extracted values.
+******************************************************************************/
+static inline void raw_column(const unsigned char *buf, const size_t nrow,
+    const long width, const long off, const int size, double *x) {
+  const unsigned char *p = buf + off;
+  if (size == 4) {
+    for (size_t i = 0; i < nrow; i++, p += width) {
+      uint32_t v = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+          (uint32_t) p[2] << 8 | (uint32_t) p[3];
+      float f;
+      memcpy(&f, &v, sizeof(float));
+      x[i] = f;
+    }
+  }
+  else {
+    for (size_t i = 0; i < nrow; i++, p += width) {
+      uint64_t v = (uint64_t) p[0] << 56 | (uint64_t) p[1] << 48 |
+          (uint64_t) p[2] << 40 | (uint64_t) p[3] << 32 |
+          (uint64_t) p[4] << 24 | (uint64_t) p[5] << 16 |
+          (uint64_t) p[6] << 8 | (uint64_t) p[7];
+      memcpy(x + i, &v, sizeof(double));
+    }
+  }
+}
+
+/******************************************************************************
+Function `select_rows`:
+  Discard coordinates of rows that are not selected.
+Arguments:
+  * `ra`:       right ascensions of a block of rows;
+  * `dec`:      declinations of a block of rows;
+  * `nrow`:     number of rows in the block;
+  * `sel`:      flags of selected rows in the block.
+Return:
+  Number of selected rows.
+******************************************************************************/
+static size_t select_rows(double *ra, double *dec, const size_t nrow,
+    const char *sel) {
+  size_t n = 0;
+  for (size_t i = 0; i < nrow; i++) {
+    if (!sel[i]) continue;
+    ra[n] = ra[i];
+    dec[n] = dec[i];
+    n++;
+  }
+  return n;
+}
+
+/******************************************************************************
+Function `row_cache_init`:
+  Reserve memory for caching the output columns of the selected rows, if
+  it fits in the budget of the cache.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the input data catalogue;
+  * `icat`:     index of the input catalogue;
+  * `nsel`:     number of selected rows;
+  * `width`:    number of bytes per row of the table.
+Return:
+  Address of the cache on success; NULL if the rows are not cached.
+******************************************************************************/
+static unsigned char *row_cache_init(const CONF *conf, DATA *data,
+    const int icat, const size_t nsel, const long width) {
+  if (!data->rows) return NULL;
+  /* Existing rows are untouched when all columns are saved in place. */
+  if (!conf->ncol && conf->output &&
+      !strcmp(conf->input[icat], conf->output[icat])) return NULL;
+
+  /* Only the output columns are cached, or the full rows. */
+  size_t cwidth = width;
+  if (conf->ncol) {
+    const FITS_COL_t *col = data->content;
+    cwidth = 0;
+    for (int i = 0; i < conf->ncol; i++) cwidth += col[i].w;
+  }
+  if (!nsel || nsel > SIZE_MAX / cwidth) return NULL;
+  const size_t size = nsel * cwidth;
+
+  bool reserved = false;
+#ifdef OMP
+#pragma omp critical(brickmask_row_cache)
+#endif
+  if (size <= *data->rmem) {
+    *data->rmem -= size;
+    reserved = true;
+  }
+  if (!reserved) return NULL;
+
+  /* Release the reservation if the memory is not available. */
+  if (!(data->rows[icat] = malloc(size))) {
+#ifdef OMP
+#pragma omp atomic
+#endif
+    *data->rmem += size;
+  }
+  return data->rows[icat];
+}
+
+/******************************************************************************
+Function `row_cache_fill`:
+  Copy the output columns of the selected rows to the cache.
+Arguments:
+  * `buf`:      the raw table rows;
+  * `nrow`:     number of rows;
+  * `width`:    number of bytes per row;
+  * `sel`:      flags of selected rows, NULL for all rows;
+  * `col`:      information of the output columns, NULL for all columns;
+  * `ncol`:     number of output columns;
+  * `cache`:    address of the cache for these rows.
+Return:
+  Address of the cache for the subsequent rows.
+******************************************************************************/
+static unsigned char *row_cache_fill(const unsigned char *buf,
+    const size_t nrow, const long width, const char *sel,
+    const FITS_COL_t *col, const int ncol, unsigned char *cache) {
+  for (size_t i = 0; i < nrow; i++, buf += width) {
+    if (sel && !sel[i]) continue;
+    if (!ncol) {
+      memcpy(cache, buf, width);
+      cache += width;
+    }
+    else {
+      for (int j = 0; j < ncol; j++) {
+        memcpy(cache, buf + col[j].i - 1, col[j].w);
+        cache += col[j].w;
+      }
+    }
+  }
+  return cache;
+}
+
+/******************************************************************************
+Function `raw_coord_read`:
+  Read coordinates from raw rows of a binary table, by large blocks.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `raw`:      structure for the raw table access;
+  * `data`:     structure for the input data catalogue;
+  * `ndata`:    number of rows to be read;
+  * `sel`:      flags of selected rows, NULL for all rows;
+  * `ncol`:     number of output columns, 0 for all columns;
+  * `cache`:    cache for output columns of the selected rows, or NULL.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int raw_coord_read(const char *fname, const FITS_RAW_t *raw,
+    DATA *data, const size_t ndata, const char *sel, const int ncol,
+    unsigned char *cache) {
+  const size_t nstep = (BRICKMASK_FITS_RAW_BLOCK > raw->width) ?
+      BRICKMASK_FITS_RAW_BLOCK / raw->width : 1;
+  unsigned char *buf = malloc(nstep * raw->width);
+  if (!buf) {
+    P_ERR("failed to allocate memory for reading FITS rows\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) == -1) {
+    P_ERR("cannot open file for reading: `%s'\n", fname);
+    free(buf);
+    return BRICKMASK_ERR_FILE;
+  }
+  posix_fadvise(fd, raw->start, ndata * raw->width, POSIX_FADV_SEQUENTIAL);
+
+  off_t pos = raw->start;
+  size_t nrest = ndata;
+  while (nrest) {
+    const size_t nrow = (nstep < nrest) ? nstep : nrest;
+    const size_t size = nrow * raw->width;
+    for (size_t n = 0; n < size; ) {
+      ssize_t r = pread(fd, buf + n, size - n, pos + n);
+      if (r <= 0) {
+        P_ERR("failed to read rows of the FITS table: `%s'\n", fname);
+        free(buf); close(fd);
+        return BRICKMASK_ERR_FILE;
+      }
+      n += r;
+    }
+    raw_column(buf, nrow, raw->width, raw->off[0], raw->size[0],
+        data->ra + data->n);
+    raw_column(buf, nrow, raw->width, raw->off[1], raw->size[1],
+        data->dec + data->n);
+    if (cache) {
+      cache = row_cache_fill(buf, nrow, raw->width, sel, data->content, ncol,
+          cache);
+    }
+    size_t nsel = nrow;
+    if (sel) {
+      nsel = select_rows(data->ra + data->n, data->dec + data->n, nrow, sel);
+      sel += nrow;
+    }
+    pos += size;
+    nrest -= nrow;
+    data->n += nsel;
+
+    /* Report the objects that are available. */
+    if (data->hook) {
+      int err = data->hook(data->ra, data->dec, data->n, data->harg);
+      if (err) {
+        free(buf); close(fd);
+        return err;
+      }
+    }
+  }
+
+  free(buf);
+  if (close(fd)) P_WRN("failed to close file: `%s'\n", fname);
+  return 0;
+}
+
 /******************************************************************************
 Function `get_fits_coord`:
   Read coordinates from the FITS file.
 Arguments:
+  * `fname`:    filename of the input catalogue;
   * `conf`:     structure for storing configurations;
   * `data`:     structure for the input data catalogue;
+  * `icat`:     index of the input catalogue;
   * `ndata`:    number of rows to be read;
+  * `nsel`:     number of selected rows;
+  * `sel`:      flags of selected rows, NULL for all rows;
   * `fp`:       pointer to the opened FITS file.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-static int get_fits_coord(const CONF *conf, DATA *data, const size_t ndata,
+static int get_fits_coord(const char *fname, const CONF *conf, DATA *data,
+    const int icat, const size_t ndata, const size_t nsel, const char *sel,
     fitsfile *fp) {
   /* Get columns for RA and Dec. */
   int status = 0;
@@ -135,6 +496,17 @@ static int get_fits_coord(const CONF *conf, DATA *data, const size_t ndata,
     }
   }
 
+  /* Bypass CFITSIO for plain binary tables, whose raw rows can also be
+     kept for saving. */
+  FITS_RAW_t raw;
+  if (raw_coord_init(fname, fp, col, &raw)) {
+    unsigned char *cache = row_cache_init(conf, data, icat, nsel, raw.width);
+    int err = raw_coord_read(fname, &raw, data, ndata, sel, conf->ncol,
+        cache);
+    if (err) fits_close_file(fp, &status);
+    return err;
+  }
+
   /* Get the optimal number of rows to read at one time. */
   long nstep = 0;
   if (fits_get_rowsize(fp, &nstep, &status)) FITS_ABORT;
@@ -146,14 +518,27 @@ static int get_fits_coord(const CONF *conf, DATA *data, const size_t ndata,
   while (nrest) {
     long nrow = (nstep < nrest) ? nstep : nrest;
     if (fits_read_col_dbl(fp, col[0], nread, 1, nrow, 0,
-        data->ra + (data->n + nread - 1), &anynul, &status)) FITS_ABORT;
+        data->ra + data->n, &anynul, &status)) FITS_ABORT;
     if (fits_read_col_dbl(fp, col[1], nread, 1, nrow, 0,
-        data->dec + (data->n + nread - 1), &anynul, &status)) FITS_ABORT;
+        data->dec + data->n, &anynul, &status)) FITS_ABORT;
+    if (sel) {
+      data->n += select_rows(data->ra + data->n, data->dec + data->n, nrow,
+          sel + nread - 1);
+    }
+    else data->n += nrow;
     nread += nrow;
     nrest -= nrow;
+
+    /* Report the objects that are available. */
+    if (data->hook) {
+      int err = data->hook(data->ra, data->dec, data->n, data->harg);
+      if (err) {
+        fits_close_file(fp, &status);
+        return err;
+      }
+    }
   }
 
-  data->n += ndata;
   return 0;
 }
 
@@ -249,9 +634,6 @@ int read_brick(const char *fname, BRICK *brick) {
   /* Finished reading the file. */
   if (fits_close_file(fp, &status)) FITS_ABORT;
 
-#ifdef MPI
-  brick->nlen = nlen;
-#endif
   return 0;
 }
 
@@ -260,12 +642,14 @@ Function `read_fits`:
   Read data from the input FITS catalogue.
 Arguments:
   * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
   * `conf`:     structure for storing configurations;
   * `data`:     structure for the input data catalogue.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-int read_fits(const char *fname, const CONF *conf, DATA *data) {
+int read_fits(const char *fname, const int icat, const CONF *conf,
+    DATA *data) {
   if (!conf) {
     P_ERR("configuration parameters are not loaded\n");
     return BRICKMASK_ERR_INIT;
@@ -280,29 +664,32 @@ int read_fits(const char *fname, const CONF *conf, DATA *data) {
   fitsfile *fp = NULL;
   if (fits_open_data(&fp, fname, READONLY, &status)) FITS_ABORT;
 
-  /* Check if the maskbit and subsample ID columns are alread in the file. */
-  int col = 0;
-  if (fits_get_colnum(fp, BRICKMASK_FITS_CASESEN, conf->mcol,
-      &col, &status) != COL_NOT_FOUND) {
-    P_ERR("the maskbit column (%s) exists in the input catalog.",
-        conf->mcol);
-    status = 0;
-    fits_close_file(fp, &status);
-    return BRICKMASK_ERR_FILE;
-  }
-  status = 0;
-  fits_clear_errmsg();
-  if (conf->subid) {
-    if (fits_get_colnum(fp, BRICKMASK_FITS_CASESEN, BRICKMASK_FITS_SUBID,
+  /* Check if the maskbit and subsample ID columns are alread in the file,
+     unless only maskbits are saved. */
+  if (!conf->monly) {
+    int col = 0;
+    if (fits_get_colnum(fp, BRICKMASK_FITS_CASESEN, conf->mcol,
         &col, &status) != COL_NOT_FOUND) {
-      P_ERR("the subsample ID column (%s) exists in the input catalog.",
-          BRICKMASK_FITS_SUBID);
+      P_ERR("the maskbit column (%s) exists in the input catalog.",
+          conf->mcol);
       status = 0;
       fits_close_file(fp, &status);
       return BRICKMASK_ERR_FILE;
     }
     status = 0;
     fits_clear_errmsg();
+    if (conf->subid) {
+      if (fits_get_colnum(fp, BRICKMASK_FITS_CASESEN, BRICKMASK_FITS_SUBID,
+          &col, &status) != COL_NOT_FOUND) {
+        P_ERR("the subsample ID column (%s) exists in the input catalog.",
+            BRICKMASK_FITS_SUBID);
+        status = 0;
+        fits_close_file(fp, &status);
+        return BRICKMASK_ERR_FILE;
+      }
+      status = 0;
+      fits_clear_errmsg();
+    }
   }
 
   /* Get the number of objects. */
@@ -313,6 +700,23 @@ int read_fits(const char *fname, const CONF *conf, DATA *data) {
     return 0;
   }
 
+  /* Evaluate the row filter. */
+  long ngood = ndata;
+  char *sel = NULL;
+  if (data->sel) {
+    if (!(sel = data->sel[icat] = malloc(ndata))) {
+      P_ERR("failed to allocate memory for the row selection\n");
+      fits_close_file(fp, &status);
+      return BRICKMASK_ERR_MEMORY;
+    }
+    if (fits_find_rows(fp, conf->sel, 1, ndata, &ngood, sel, &status))
+      FITS_ABORT;
+    if (!ngood) {
+      if (fits_close_file(fp, &status)) FITS_ABORT;
+      return 0;
+    }
+  }
+
   /* Allocate memory. */
   double *tmp[2];
   if (!(tmp[0] = realloc(data->ra, (data->n + ndata) * sizeof(double))) ||
@@ -329,7 +733,8 @@ int read_fits(const char *fname, const CONF *conf, DATA *data) {
   if (!data->content && get_fits_col(conf, data, fp)) return BRICKMASK_ERR_FILE;
 
   /* Read coordinates. */
-  if (get_fits_coord(conf, data, ndata, fp)) return BRICKMASK_ERR_FILE;
+  if (get_fits_coord(fname, conf, data, icat, ndata, ngood, sel, fp))
+    return BRICKMASK_ERR_FILE;
 
   /* Close file. */
   if (fits_close_file(fp, &status)) FITS_ABORT;
@@ -424,7 +829,8 @@ int read_mask(const char *fname, MASK *mask) {
   }
 
   /* Check image dimensions and data type. */
-  if (fits_get_img_param(fp, 2, &bitpix, &naxis, mask->dim, &status)) FITS_ABORT;
+  if (fits_get_img_param(fp, 2, &bitpix, &naxis, mask->dim, &status))
+    FITS_ABORT;
   if (naxis != 2) {
     P_ERR("image dimension of the maskbit file must be 2: `%s'\n", fname);
     fits_close_file(fp, &status);
@@ -0,0 +1,235 @@
+/*******************************************************************************
+* read_hdf5.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#ifdef HDF5
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "read_file.h"
+#include "hdf5_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Data structure for a coordinate dataset of an HDF5 file. */
+typedef struct {
+  hid_t dset;           /* identifier of the dataset                    */
+  hid_t space;          /* identifier of the dataspace                  */
+  hsize_t n;            /* number of elements                           */
+  hsize_t chunk;        /* elements per chunk, 0 if not chunked         */
+} HDF5_COL_t;
+
+/*============================================================================*\
+                        Functions for reading HDF5 files
+\*============================================================================*/
+
+/******************************************************************************
+Function `hdf5_col_release`:
+  Close the coordinate datasets.
+Arguments:
+  * `col`:      the coordinate datasets.
+******************************************************************************/
+static void hdf5_col_release(HDF5_COL_t *col) {
+  for (int i = 0; i < 2; i++) {
+    if (col[i].space >= 0) H5Sclose(col[i].space);
+    if (col[i].dset >= 0) H5Dclose(col[i].dset);
+    col[i].space = col[i].dset = H5I_INVALID_HID;
+  }
+}
+
+/******************************************************************************
+Function `hdf5_open_col`:
+  Open a coordinate dataset and check its shape and data type.
+Arguments:
+  * `fid`:      identifier of the HDF5 file;
+  * `fname`:    name of the file;
+  * `cname`:    path of the dataset;
+  * `col`:      structure for the dataset.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int hdf5_open_col(const hid_t fid, const char *fname, const char *cname,
+    HDF5_COL_t *col) {
+  if ((col->dset = H5Dopen2(fid, cname, H5P_DEFAULT)) < 0) {
+    P_ERR("dataset `%s' not found in the input catalog: `%s'\n",
+        cname, fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  if ((col->space = H5Dget_space(col->dset)) < 0 ||
+      H5Sget_simple_extent_ndims(col->space) != 1 ||
+      H5Sget_simple_extent_dims(col->space, &col->n, NULL) != 1) {
+    P_ERR("the coordinate dataset `%s' must be one-dimensional: `%s'\n",
+        cname, fname);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  hid_t type = H5Dget_type(col->dset);
+  const H5T_class_t cls = (type < 0) ? H5T_NO_CLASS : H5Tget_class(type);
+  if (type >= 0) H5Tclose(type);
+  if (cls != H5T_FLOAT) {
+    P_ERR("the coordinate dataset `%s' must be floating-point numbers: "
+        "`%s'\n", cname, fname);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* Reads are aligned with chunks if the dataset is chunked. */
+  col->chunk = 0;
+  hid_t dcpl = H5Dget_create_plist(col->dset);
+  if (dcpl >= 0) {
+    if (H5Pget_layout(dcpl) == H5D_CHUNKED &&
+        H5Pget_chunk(dcpl, 1, &col->chunk) != 1) col->chunk = 0;
+    H5Pclose(dcpl);
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `hdf5_check_exist`:
+  Check whether the maskbit and subsample ID datasets are absent from the
+  input catalogue that is to be updated.
+Arguments:
+  * `fid`:      identifier of the HDF5 file;
+  * `fname`:    name of the file;
+  * `conf`:     structure for storing configurations.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int hdf5_check_exist(const hid_t fid, const char *fname,
+    const CONF *conf) {
+  const char *name[2] = {conf->mcol, BRICKMASK_FITS_SUBID};
+  const char *desc[2] = {"maskbit", "subsample ID"};
+  for (int i = 0; i < ((conf->subid) ? 2 : 1); i++) {
+    char *path = hdf5_sibling(conf->cname[0], name[i]);
+    if (!path) return BRICKMASK_ERR_MEMORY;
+    if (H5Lexists(fid, path, H5P_DEFAULT) != 0) {
+      P_ERR("the %s dataset (%s) exists in the input catalog: `%s'\n",
+          desc[i], path, fname);
+      free(path);
+      return BRICKMASK_ERR_FILE;
+    }
+    free(path);
+  }
+  return 0;
+}
+
+
+/*============================================================================*\
+                      Interface for reading HDF5 files
+\*============================================================================*/
+
+/******************************************************************************
+Function `read_hdf5`:
+  Read coordinates from datasets of the input HDF5 file.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int read_hdf5(const char *fname, const int icat, const CONF *conf,
+    DATA *data) {
+  if (!conf) {
+    P_ERR("configuration parameters are not loaded\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (!data) {
+    P_ERR("structure for the input data is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+
+  hid_t fid = hdf5_open(fname, false);
+  if (fid < 0) return BRICKMASK_ERR_FILE;
+
+  /* New datasets are added to the input file if it is also the output. */
+  int err = 0;
+  if (!conf->nshard && !conf->monly && same_file(fname, conf->output[icat]) &&
+      (err = hdf5_check_exist(fid, fname, conf))) {
+    H5Fclose(fid);
+    return err;
+  }
+
+  HDF5_COL_t col[2];
+  for (int i = 0; i < 2; i++)
+    col[i].dset = col[i].space = H5I_INVALID_HID;
+  for (int i = 0; i < 2; i++) {
+    if ((err = hdf5_open_col(fid, fname, conf->cname[i], col + i))) {
+      hdf5_col_release(col);
+      H5Fclose(fid);
+      return err;
+    }
+  }
+  if (col[0].n != col[1].n) {
+    P_ERR("different lengths of the coordinate datasets in `%s'\n", fname);
+    hdf5_col_release(col);
+    H5Fclose(fid);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* Allocate memory. */
+  const size_t ndata = col[0].n;
+  if (!ndata) {
+    hdf5_col_release(col);
+    H5Fclose(fid);
+    return 0;
+  }
+  double *tmp[2] = {NULL, NULL};
+  if (!(tmp[0] = realloc(data->ra, (data->n + ndata) * sizeof(double))) ||
+      !(tmp[1] = realloc(data->dec, (data->n + ndata) * sizeof(double)))) {
+    P_ERR("failed to allocate memory for the input data catalog\n");
+    if (tmp[0]) data->ra = tmp[0];
+    hdf5_col_release(col);
+    H5Fclose(fid);
+    return BRICKMASK_ERR_MEMORY;
+  }
+  data->ra = tmp[0];
+  data->dec = tmp[1];
+
+  /* Read blocks made of whole chunks, so that each chunk is read only once,
+     and decompressed without the chunk cache. */
+  const hsize_t chunk = (col[0].chunk > col[1].chunk) ?
+      col[0].chunk : col[1].chunk;
+  hsize_t nstep = BRICKMASK_HDF5_BLOCK;
+  if (chunk) nstep = (chunk < nstep) ? nstep / chunk * chunk : chunk;
+
+  for (hsize_t i = 0; i < ndata; i += nstep) {
+    hsize_t nrow = (nstep < ndata - i) ? nstep : ndata - i;
+    hid_t mspace = H5Screate_simple(1, &nrow, NULL);
+    double *dst[2] = {data->ra + data->n, data->dec + data->n};
+    for (int k = 0; k < 2 && !err; k++) {
+      if (mspace < 0 || H5Sselect_hyperslab(col[k].space, H5S_SELECT_SET, &i,
+          NULL, &nrow, NULL) < 0 || H5Dread(col[k].dset, H5T_NATIVE_DOUBLE,
+          mspace, col[k].space, H5P_DEFAULT, dst[k]) < 0) {
+        P_ERR("failed to read dataset `%s' from file: `%s'\n",
+            conf->cname[k], fname);
+        err = BRICKMASK_ERR_FILE;
+      }
+    }
+    if (mspace >= 0) H5Sclose(mspace);
+    if (err) break;
+    data->n += nrow;
+
+    /* Report the objects that are available. */
+    if (data->hook && (err = data->hook(data->ra, data->dec, data->n,
+        data->harg))) break;
+  }
+
+  hdf5_col_release(col);
+  if (H5Fclose(fid) < 0 && !err) {
+    P_ERR("failed to close file: `%s'\n", fname);
+    err = BRICKMASK_ERR_FILE;
+  }
+  return err;
+}
+
+#endif
@@ -0,0 +1,293 @@
+/*******************************************************************************
+* read_npy.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "read_file.h"
+#include "npy_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Data structure for a coordinate column of a mapped NumPy array file. */
+typedef struct {
+  NPY_t *npy;           /* header of the array file                     */
+  const NPY_FIELD_t *f; /* field of the coordinate                      */
+  unsigned char *map;   /* starting address of the mapped file          */
+  size_t size;          /* size of the mapped file                      */
+} NPY_COL_t;
+
+/*============================================================================*\
+                     Functions for reading NumPy array files
+\*============================================================================*/
+
+/******************************************************************************
+Function `npy_col_release`:
+  Release the mapped files and headers of coordinate columns.
+Arguments:
+  * `col`:      the coordinate columns.
+******************************************************************************/
+static void npy_col_release(NPY_COL_t *col) {
+  /* RA and Dec share the mapping of a structured array. */
+  if (col[1].map && col[1].map != col[0].map) munmap(col[1].map, col[1].size);
+  if (col[1].npy && col[1].npy != col[0].npy) npy_destroy(col[1].npy);
+  if (col[0].map) munmap(col[0].map, col[0].size);
+  if (col[0].npy) npy_destroy(col[0].npy);
+  col[0].map = col[1].map = NULL;
+  col[0].npy = col[1].npy = NULL;
+}
+
+/******************************************************************************
+Function `npy_check_coord`:
+  Check whether the data type of a coordinate column is supported.
+Arguments:
+  * `fname`:    name of the file;
+  * `cname`:    name of the column;
+  * `f`:        field of the column.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int npy_check_coord(const char *fname, const char *cname,
+    const NPY_FIELD_t *f) {
+  if (f->kind != 'f' || (f->size != 4 && f->size != 8)) {
+    P_ERR("the coordinate column `%s' must be 4- or 8-byte floating-point "
+        "numbers: `%s'\n", cname, fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `npy_open_dir`:
+  Open coordinate columns stored as NumPy arrays in a directory.
+Arguments:
+  * `dir`:      name of the directory;
+  * `conf`:     structure for storing configurations;
+  * `col`:      structure for the coordinate columns.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int npy_open_dir(const char *dir, const CONF *conf, NPY_COL_t *col) {
+  for (int i = 0; i < 2; i++) {
+    char *fname = npy_path(dir, conf->cname[i]);
+    if (!fname) return BRICKMASK_ERR_MEMORY;
+    if (!(col[i].npy = npy_open(fname))) {
+      free(fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    if (col[i].npy->nfield) {
+      P_ERR("the coordinate column must be a plain array: `%s'\n", fname);
+      free(fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    col[i].f = col[i].npy->field;
+    if (npy_check_coord(fname, conf->cname[i], col[i].f) ||
+        npy_map(fname, col[i].npy, &col[i].map, &col[i].size)) {
+      free(fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    free(fname);
+  }
+  if (col[0].npy->n != col[1].npy->n) {
+    P_ERR("different lengths of the coordinate columns in `%s'\n", dir);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `npy_open_table`:
+  Open coordinate columns stored as fields of a NumPy structured array.
+Arguments:
+  * `fname`:    name of the file;
+  * `conf`:     structure for storing configurations;
+  * `col`:      structure for the coordinate columns.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int npy_open_table(const char *fname, const CONF *conf,
+    NPY_COL_t *col) {
+  NPY_t *npy = col[0].npy = col[1].npy = npy_open(fname);
+  if (!npy) return BRICKMASK_ERR_FILE;
+  if (!npy->nfield) {
+    P_ERR("the input catalog must be a structured array, or a directory of "
+        "arrays: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* Check if the maskbit and subsample ID columns are already in the file. */
+  if (!conf->monly && npy_field(npy, conf->mcol) >= 0) {
+    P_ERR("the maskbit column (%s) exists in the input catalog: `%s'\n",
+        conf->mcol, fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (!conf->monly && conf->subid &&
+      npy_field(npy, BRICKMASK_FITS_SUBID) >= 0) {
+    P_ERR("the subsample ID column (%s) exists in the input catalog: `%s'\n",
+        BRICKMASK_FITS_SUBID, fname);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    int k = npy_field(npy, conf->cname[i]);
+    if (k < 0) {
+      P_ERR("column `%s' not found in the input catalog: `%s'\n",
+          conf->cname[i], fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    col[i].f = npy->field + k;
+    if (npy_check_coord(fname, conf->cname[i], col[i].f))
+      return BRICKMASK_ERR_FILE;
+  }
+
+  if (npy_map(fname, npy, &col[0].map, &col[0].size)) return BRICKMASK_ERR_FILE;
+  col[1].map = col[0].map;
+  col[1].size = col[0].size;
+  return 0;
+}
+
+/******************************************************************************
+Function `npy_column`:
+  Convert a block of a coordinate column to double precision.
+Arguments:
+  * `col`:      the coordinate column;
+  * `first`:    index of the first row of the block;
+  * `nrow`:     number of rows of the block;
+  * `x`:        array for storing the coordinates.
+******************************************************************************/
+static void npy_column(const NPY_COL_t *col, const size_t first,
+    const size_t nrow, double *x) {
+  const size_t width = col->npy->width;
+  const unsigned char *p = col->map + col->npy->start + first * width +
+      col->f->offset;
+  const bool swap = !npy_native(col->f);
+  if (col->f->size == 8) {
+    for (size_t i = 0; i < nrow; i++, p += width) {
+      uint64_t u;
+      memcpy(&u, p, 8);
+      if (swap) {
+        u = ((u & 0x00000000000000ffULL) << 56) |
+            ((u & 0x000000000000ff00ULL) << 40) |
+            ((u & 0x0000000000ff0000ULL) << 24) |
+            ((u & 0x00000000ff000000ULL) << 8) |
+            ((u & 0x000000ff00000000ULL) >> 8) |
+            ((u & 0x0000ff0000000000ULL) >> 24) |
+            ((u & 0x00ff000000000000ULL) >> 40) |
+            ((u & 0xff00000000000000ULL) >> 56);
+      }
+      double v;
+      memcpy(&v, &u, 8);
+      x[i] = v;
+    }
+  }
+  else {
+    for (size_t i = 0; i < nrow; i++, p += width) {
+      uint32_t u;
+      memcpy(&u, p, 4);
+      if (swap) {
+        u = ((u & 0x000000ffU) << 24) | ((u & 0x0000ff00U) << 8) |
+            ((u & 0x00ff0000U) >> 8) | ((u & 0xff000000U) >> 24);
+      }
+      float v;
+      memcpy(&v, &u, 4);
+      x[i] = v;
+    }
+  }
+}
+
+
+/*============================================================================*\
+                    Interface for reading NumPy array files
+\*============================================================================*/
+
+/******************************************************************************
+Function `read_npy`:
+  Read data from the input NumPy array file, or directory of array files.
+Arguments:
+  * `fname`:    filename of the input catalogue;
+  * `icat`:     index of the input catalogue;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int read_npy(const char *fname, const int icat, const CONF *conf,
+    DATA *data) {
+  (void) icat;
+  if (!conf) {
+    P_ERR("configuration parameters are not loaded\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (!data) {
+    P_ERR("structure for the input data is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+
+  /* Map the coordinate columns into memory. */
+  struct stat st;
+  if (stat(fname, &st)) {
+    P_ERR("cannot access the input catalog: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  NPY_COL_t col[2];
+  memset(col, 0, sizeof col);
+  int err = (S_ISDIR(st.st_mode)) ? npy_open_dir(fname, conf, col) :
+      npy_open_table(fname, conf, col);
+  if (err) {
+    npy_col_release(col);
+    return err;
+  }
+
+  /* Allocate memory. */
+  const size_t ndata = col[0].npy->n;
+  if (!ndata) {
+    npy_col_release(col);
+    return 0;
+  }
+  double *tmp[2] = {NULL, NULL};
+  if (!(tmp[0] = realloc(data->ra, (data->n + ndata) * sizeof(double))) ||
+      !(tmp[1] = realloc(data->dec, (data->n + ndata) * sizeof(double)))) {
+    P_ERR("failed to allocate memory for the input data catalog\n");
+    if (tmp[0]) data->ra = tmp[0];
+    npy_col_release(col);
+    return BRICKMASK_ERR_MEMORY;
+  }
+  data->ra = tmp[0];
+  data->dec = tmp[1];
+
+  /* Convert the coordinates by blocks. */
+  const size_t width = (col[0].npy->width > col[1].npy->width) ?
+      col[0].npy->width : col[1].npy->width;
+  const size_t nstep = (BRICKMASK_NPY_BLOCK > width) ?
+      BRICKMASK_NPY_BLOCK / width : 1;
+  for (size_t i = 0; i < ndata; i += nstep) {
+    const size_t nrow = (nstep < ndata - i) ? nstep : ndata - i;
+    npy_column(col, i, nrow, data->ra + data->n);
+    npy_column(col + 1, i, nrow, data->dec + data->n);
+    data->n += nrow;
+
+    /* Report the objects that are available. */
+    if (data->hook) {
+      if ((err = data->hook(data->ra, data->dec, data->n, data->harg))) {
+        npy_col_release(col);
+        return err;
+      }
+    }
+  }
+
+  npy_col_release(col);
+  return 0;
+}
@@ -12,31 +12,41 @@
  
 *******************************************************************************/
 
+#define _POSIX_C_SOURCE 200809L
 #include "define.h"
 #include "save_file.h"
+#include "stream_io.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
 #include <string.h>
 #include <stdbool.h>
 #include <limits.h>
 #include <inttypes.h>
-
-/* Shortcut for writing a line to the file. */
-#define WRITE_LINE(...)                                         \
-  if (output_writeline(__VA_ARGS__)) {                          \
-    output_destroy(ofile); return BRICKMASK_ERR_FILE;           \
-  }
+#include <ctype.h>
+#include <fitsio.h>
+#ifdef OMP
+#include <omp.h>
+#endif
 
 /* Data structure for writing ASCII file by chunk. */
 typedef struct {
   const char *fname;    /* name of the output file                    */
-  FILE *fp;             /* pointer to the file stream                 */
+  OSTREAM *fp;          /* pointer to the (compressed) file stream, or
+                           NULL for a buffer that is only enlarged    */
   char *chunk;          /* buffer for writing file by chunks          */
-  int size;             /* number of used characters of the buffer    */
-  int max;              /* maximum number of characters of the buffer */
+  size_t size;          /* number of used characters of the buffer    */
+  size_t max;           /* maximum number of characters of the buffer */
 } OFILE;
 
+/* Two-digit decimal representations of 0 -- 99. */
+static const char digit_pair[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233"
+  "34353637383940414243444546474849505152535455565758596061626364656667"
+  "6869707172737475767778798081828384858687888990919293949596979899";
+
+/* Maximum number of characters of a 64-bit unsigned integer. */
+#define BRICKMASK_UINT64_LEN    20
+
 /*============================================================================*\
                        Functions for writing ASCII files
 \*============================================================================*/
@@ -58,7 +68,7 @@ static OFILE *output_init(void) {
   ofile->fp = NULL;
   ofile->size = 0;
   ofile->max = BRICKMASK_FILE_CHUNK;
-  ofile->chunk = calloc(ofile->max, sizeof(char));
+  ofile->chunk = malloc(ofile->max * sizeof(char));
   if (!ofile->chunk) {
     P_ERR("failed to allocate memory for writing file by chunk\n");
     free(ofile);
@@ -68,6 +78,26 @@ static OFILE *output_init(void) {
   return ofile;
 }
 
+/******************************************************************************
+Function `output_write`:
+  Write bytes to the stream, by pieces accepted by the stream.
+Arguments:
+  * `fp`:       the stream for writing;
+  * `buf`:      the bytes to be written;
+  * `num`:      number of bytes to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int output_write(OSTREAM *fp, const char *buf, size_t num) {
+  while (num) {
+    const size_t n = (num < BRICKMASK_MAX_CHUNK) ? num : BRICKMASK_MAX_CHUNK;
+    if (ostream_write(fp, buf, n)) return BRICKMASK_ERR_FILE;
+    buf += n;
+    num -= n;
+  }
+  return 0;
+}
+
 /******************************************************************************
 Function `output_flush`:
   Write the buffer string to file.
@@ -84,10 +114,8 @@ static int output_flush(OFILE *ofile) {
 
   if (!ofile->size) return 0;
 
-  if (fwrite(ofile->chunk, ofile->size * sizeof(char), 1, ofile->fp) != 1) {
-    P_ERR("failed to write to the output file: `%s'\n", ofile->fname);
+  if (output_write(ofile->fp, ofile->chunk, ofile->size))
     return BRICKMASK_ERR_FILE;
-  }
 
   ofile->size = 0;
   return 0;
@@ -101,11 +129,11 @@ Arguments:
 ******************************************************************************/
 static void output_destroy(OFILE *ofile) {
   if (!ofile) return;
-  if (output_flush(ofile))
+  if (ofile->fp && output_flush(ofile))
     P_WRN("closing the file with unsaved buffer\n");
   free(ofile->chunk);
   if (ofile->fp) {
-    if (fclose(ofile->fp))
+    if (ostream_close(ofile->fp))
       P_WRN("failed to close file: `%s'\n", ofile->fname);
   }
   free(ofile);
@@ -116,11 +144,13 @@ Function `output_newfile`:
   Flush the buffer to the existing file and open a new file.
 Arguments:
   * `ofile`:    structure for writing ASCII files;
-  * `fname`:    name of the file to be written to.
+  * `fname`:    name of the file to be written to;
+  * `comp`:     compression format of the file.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-static int output_newfile(OFILE *ofile, const char *fname) {
+static int output_newfile(OFILE *ofile, const char *fname,
+    const BRICKMASK_comp_t comp) {
   if (!ofile) {
     P_ERR("the interface for file writing is not initialised\n");
     return BRICKMASK_ERR_INIT;
@@ -130,100 +160,248 @@ static int output_newfile(OFILE *ofile, const char *fname) {
     return BRICKMASK_ERR_INIT;
   }
 
-  if (output_flush(ofile)) {
+  if (ofile->fp && output_flush(ofile)) {
     P_ERR("failed to flush the buffer to the opened file: `%s'\n",
         ofile->fname);
     return BRICKMASK_ERR_FILE;
   }
-  if (ofile->fp && fclose(ofile->fp))
+  if (ofile->fp && ostream_close(ofile->fp))
     P_WRN("failed to close file: `%s'\n", ofile->fname);
 
   ofile->fname = fname;
-  if (!(ofile->fp = fopen(fname, "w"))) {
-    P_ERR("failed to open the file for writing: `%s'\n", fname);
-    return BRICKMASK_ERR_FILE;
-  }
+  if (!(ofile->fp = ostream_open(fname, comp))) return BRICKMASK_ERR_FILE;
   return 0;
 }
 
 /******************************************************************************
-Function `output_writeline`:
-  Write a line to the buffer and save it to the file if necessary.
+Function `output_reserve`:
+  Make room for a number of characters at the end of the buffer, by
+  flushing the buffer to the file, or enlarging it if necessary.
 Arguments:
   * `ofile`:    structure for writing ASCII files;
-  * `format`:   a string specifying how the data is interpreted;
-  * `...`:      arguments specifying data to be saved.
+  * `len`:      number of characters to be written.
 Return:
-  Zero on success; non-zero on error.
+  Address for the characters to be written on success; NULL on error.
 ******************************************************************************/
-static int output_writeline(OFILE *ofile, const char *restrict format, ...) {
-  if (!ofile) {
-    P_ERR("the interface for file writing is not initialised\n");
-    return BRICKMASK_ERR_INIT;
-  }
-  if (!ofile->fp) {
-    P_ERR("no opened file for writing the line\n");
-    return BRICKMASK_ERR_FILE;
-  }
-  if (!format || !(*format)) {
-    P_ERR("the formatter string is not given for writing files\n");
-    return BRICKMASK_ERR_INIT;
-  }
-
-  if (ofile->size == ofile->max) {
-    if (output_flush(ofile)) return BRICKMASK_ERR_FILE;
+static inline char *output_reserve(OFILE *ofile, const size_t len) {
+  if (len <= ofile->max - ofile->size) return ofile->chunk + ofile->size;
+
+  if (ofile->fp && output_flush(ofile)) return NULL;
+  if (len > ofile->max - ofile->size) {
+    if (len > SIZE_MAX / 2 - ofile->size) {
+      P_ERR("the line to be saved is too long\n");
+      return NULL;
+    }
+    size_t max = ofile->max;
+    while (len > max - ofile->size) max <<= 1;
+    char *tmp = realloc(ofile->chunk, max * sizeof(char));
+    if (!tmp) {
+      P_ERR("failed to allocate memory for saving the line\n");
+      return NULL;
+    }
+    ofile->chunk = tmp;
+    ofile->max = max;
   }
+  return ofile->chunk + ofile->size;
+}
 
-  va_list args;
-  va_start(args, format);
-  int size = vsnprintf(ofile->chunk + ofile->size, ofile->max - ofile->size,
-      format, args);
-  va_end(args);
 
-  if (size < 0) {
-    P_ERR("failed to save the result in format: `%s'\n", format);
-    return BRICKMASK_ERR_FILE;
+/******************************************************************************
+Function `write_uint`:
+  Write the decimal representation of an unsigned integer, by pairs of
+  digits.
+Arguments:
+  * `p`:        address for the characters to be written;
+  * `v`:        the integer.
+Return:
+  Address next to the last character written.
+******************************************************************************/
+static inline char *write_uint(char *p, uint64_t v) {
+  char buf[BRICKMASK_UINT64_LEN];
+  char *q = buf + BRICKMASK_UINT64_LEN;
+  while (v >= 100) {
+    const unsigned int r = (v % 100) * 2;
+    v /= 100;
+    q -= 2;
+    memcpy(q, digit_pair + r, 2);
   }
-  if (size >= BRICKMASK_MAX_CHUNK) {
-    P_ERR("the line to be saved is too long\n");
-    return BRICKMASK_ERR_FILE;
+  if (v >= 10) {
+    q -= 2;
+    memcpy(q, digit_pair + v * 2, 2);
   }
+  else *(--q) = '0' + v;
 
-  /* Check if the buffer is full. */
-  if (size >= ofile->max - ofile->size) {
-    bool enlarge = false;
-    /* Enlarge the size of the buffer if necessary. */
-    while (size >= ofile->max) {
-      if (BRICKMASK_MAX_CHUNK / 2 < ofile->max) ofile->max = size + 1;
-      else ofile->max <<= 1;
-      enlarge = true;
+  const size_t len = buf + BRICKMASK_UINT64_LEN - q;
+  memcpy(p, q, len);
+  return p + len;
+}
+
+/******************************************************************************
+Function `format_rows`:
+  Write a range of objects with maskbits to the buffer, and save it to the
+  file if necessary.
+Arguments:
+  * `ofile`:    structure for writing ASCII files;
+  * `data`:     structure for the data catalogue;
+  * `map`:      the memory-mapped input catalogue, or NULL;
+  * `imin`:     index of the first object to be written;
+  * `imax`:     index of the object next to the last one to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int format_rows(OFILE *ofile, const DATA *data, const char *map,
+    const size_t imin, const size_t imax) {
+  const char *content = data->content;
+  const size_t nidx = CIDX_PER_OBJECT(data);
+  /* Maximum length of the maskbit, subsample ID, and newline. */
+  const size_t nextra = BRICKMASK_UINT64_LEN + 2 + ((data->subid) ? 4 : 0);
+
+  for (size_t i = imin; i < imax; i++) {
+    /* Compute the maximum length of the line. */
+    const size_t *span = data->cidx + nidx * i;
+    const char *str = NULL;
+    size_t len = nextra;
+    if (map) {
+      for (int k = 0; k < data->nspan; k++) len += span[2 * k + 1] + 1;
     }
+    else {
+      str = content + data->cidx[i];
+      len += strlen(str);
+    }
+
+    char *p = output_reserve(ofile, len);
+    if (!p) return BRICKMASK_ERR_FILE;
+    char *const start = p;
 
-    if (enlarge) {
-      char *tmp = realloc(ofile->chunk, ofile->max * sizeof(char));
-      if (!tmp) {
-        P_ERR("failed to allocate memory for saving the line\n");
-        return BRICKMASK_ERR_MEMORY;
+    /* Write columns of the original file. */
+    if (map) {
+      for (int k = 0; k < data->nspan; k++) {
+        const char *c = map + span[2 * k];
+        const size_t n = span[2 * k + 1];
+        memcpy(p, c, n);
+        p += n;
+        /* Separate the last column of a line from the next one. */
+        if (!n || !isspace((unsigned char) c[n - 1])) *p++ = ' ';
       }
-      ofile->chunk = tmp;
+    }
+    else {
+      const size_t n = len - nextra;
+      memcpy(p, str, n);
+      p += n;
     }
 
-    if (output_flush(ofile)) return BRICKMASK_ERR_FILE;
+    /* Write maskbits, and subsample IDs if applicable. */
+    p = write_uint(p, get_mask(data->mask, data->mtype, i));
+    if (data->subid) {
+      *p++ = ' ';
+      p = write_uint(p, data->subid[i]);
+    }
+    *p++ = '\n';
 
-    va_start(args, format);
-    size = vsnprintf(ofile->chunk, ofile->max, format, args);
-    va_end(args);
+    ofile->size += p - start;
+  }
+  return 0;
+}
 
-    if (size >= ofile->max) {
-      P_ERR("failed to detect the size of the line\n");
-      return BRICKMASK_ERR_UNKNOWN;
+#ifdef OMP
+/******************************************************************************
+Function `output_rows_omp`:
+  Write a range of objects with maskbits to the file, with lines formatted
+  by multiple threads into their own buffers, which are then written to the
+  file in order.  For gzip outputs, each buffer is compressed by the thread
+  as well, into a separate gzip member.
+Arguments:
+  * `ofile`:    structure for writing ASCII files;
+  * `data`:     structure for the data catalogue;
+  * `map`:      the memory-mapped input catalogue, or NULL;
+  * `imin`:     index of the first object to be written;
+  * `imax`:     index of the object next to the last one to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int output_rows_omp(OFILE *ofile, const DATA *data, const char *map,
+    const size_t imin, const size_t imax) {
+  const int nbuf = omp_get_max_threads();
+  const bool zip = ostream_members(ofile->fp);
+  OFILE *buf = calloc(nbuf, sizeof(OFILE));
+  void **zbuf = calloc(nbuf, sizeof(void *));
+  size_t *zsize = calloc((size_t) nbuf * 2, sizeof(size_t));
+  int err = 0;
+  if (!buf || !zbuf || !zsize) {
+    P_ERR("failed to allocate memory for writing file with threads\n");
+    if (buf) free(buf);
+    if (zbuf) free(zbuf);
+    if (zsize) free(zsize);
+    return BRICKMASK_ERR_MEMORY;
+  }
+  size_t *zlen = zsize + nbuf;
+  for (int k = 0; k < nbuf; k++) {
+    buf[k].max = BRICKMASK_FILE_CHUNK;
+    if (!(buf[k].chunk = malloc(buf[k].max * sizeof(char)))) {
+      P_ERR("failed to allocate memory for writing file with threads\n");
+      err = BRICKMASK_ERR_MEMORY;
+      break;
+    }
+  }
+
+  /* Write the previous lines first. */
+  if (!err) err = output_flush(ofile);
+
+  const size_t nstep = (size_t) nbuf * BRICKMASK_OMP_WRITE_NUM;
+  for (size_t i = imin; !err && i < imax; i += nstep) {
+#pragma omp parallel for schedule(static) reduction(|:err)
+    for (int k = 0; k < nbuf; k++) {
+      const size_t lo = i + (size_t) k * BRICKMASK_OMP_WRITE_NUM;
+      if (lo >= imax) continue;
+      const size_t hi = (imax - lo > BRICKMASK_OMP_WRITE_NUM) ?
+          lo + BRICKMASK_OMP_WRITE_NUM : imax;
+      buf[k].size = 0;
+      int e = format_rows(buf + k, data, map, lo, hi);
+      if (!e && zip) e = ostream_deflate(ofile->fp, buf[k].chunk,
+          buf[k].size, zbuf + k, zsize + k, zlen + k);
+      err |= e;
     }
 
-    ofile->size = size;
+    for (int k = 0; !err && k < nbuf; k++) {
+      if (i + (size_t) k * BRICKMASK_OMP_WRITE_NUM >= imax) break;
+      err = (zip) ? ostream_write_member(ofile->fp, zbuf[k], zlen[k]) :
+          output_write(ofile->fp, buf[k].chunk, buf[k].size);
+    }
   }
-  else ofile->size += size;
 
-  return 0;
+  for (int k = 0; k < nbuf; k++) {
+    if (buf[k].chunk) free(buf[k].chunk);
+    if (zbuf[k]) free(zbuf[k]);
+  }
+  free(buf);
+  free(zbuf);
+  free(zsize);
+  return (err) ? BRICKMASK_ERR_FILE : 0;
+}
+#endif
+
+/******************************************************************************
+Function `output_rows`:
+  Write a range of objects with maskbits to the file.
+Arguments:
+  * `ofile`:    structure for writing ASCII files;
+  * `data`:     structure for the data catalogue;
+  * `map`:      the memory-mapped input catalogue, or NULL;
+  * `imin`:     index of the first object to be written;
+  * `imax`:     index of the object next to the last one to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int output_rows(OFILE *ofile, const DATA *data, const char *map,
+    const size_t imin, const size_t imax) {
+#ifdef OMP
+  /* Large catalogues are formatted with threads, unless files are already
+     written concurrently. */
+  if (imax - imin > BRICKMASK_OMP_WRITE_NUM && omp_get_max_threads() > 1 &&
+      !omp_in_parallel())
+    return output_rows_omp(ofile, data, map, imin, imax);
+#endif
+  return format_rows(ofile, data, map, imin, imax);
 }
 
 
@@ -251,29 +429,91 @@ int save_ascii(const CONF *conf, const DATA *data, const int idx) {
     return BRICKMASK_ERR_INIT;
   }
 
+  /* Truncating a memory-mapped input catalogue is fatal, so write to a
+     temporary file and rename it afterwards. */
+  const char *map = (data->nspan) ? data->fmap[idx] : NULL;
+  char *tmpname = NULL;
+  if (map && same_file(conf->input[idx], conf->output[idx])) {
+    const size_t len = strlen(conf->output[idx]);
+    if (!(tmpname = malloc(len + sizeof(BRICKMASK_TMP_SUFFIX)))) {
+      P_ERR("failed to allocate memory for the temporary filename\n");
+      return BRICKMASK_ERR_MEMORY;
+    }
+    memcpy(tmpname, conf->output[idx], len);
+    memcpy(tmpname + len, BRICKMASK_TMP_SUFFIX, sizeof(BRICKMASK_TMP_SUFFIX));
+  }
+
   /* Initialise the interface for writing files. */
   OFILE *ofile = output_init();
-  if (!ofile) return BRICKMASK_ERR_FILE;
-  if (output_newfile(ofile, conf->output[idx])) {
+  if (!ofile) {
+    if (tmpname) free(tmpname);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (output_newfile(ofile, (tmpname) ? tmpname : conf->output[idx],
+      output_compression(conf->output[idx]))) {
     output_destroy(ofile);
+    if (tmpname) free(tmpname);
     return BRICKMASK_ERR_FILE;
   }
 
   /* Write the catalog. */
-  const char *content = data->content;
-  for (size_t i = data->iidx[idx]; i < data->iidx[idx + 1]; i++) {
-    /* Write columns of the original file. */
-    WRITE_LINE(ofile, "%s", content + data->cidx[i]);
-
-    /* Write maskbits. */
-    WRITE_LINE(ofile, "%" PRIu64, data->mask[i]);
+  if (output_rows(ofile, data, map, data->iidx[idx], data->iidx[idx + 1])) {
+    output_destroy(ofile);
+    if (tmpname) free(tmpname);
+    return BRICKMASK_ERR_FILE;
+  }
 
-    /* Write subsample IDs if applicable. */
-    if (data->subid) WRITE_LINE(ofile, " %" PRIu8, data->subid[i]);
+  /* Flush and close the file, which completes the compression if any. */
+  int err = output_flush(ofile);
+  if (ostream_close(ofile->fp)) err = BRICKMASK_ERR_FILE;
+  ofile->fp = NULL;
+  output_destroy(ofile);
+  if (err) {
+    if (tmpname) free(tmpname);
+    return err;
+  }
+  if (tmpname) {
+    if (rename(tmpname, conf->output[idx])) {
+      P_ERR("failed to rename the temporary file `%s' to `%s'\n", tmpname,
+          conf->output[idx]);
+      free(tmpname);
+      return BRICKMASK_ERR_FILE;
+    }
+    free(tmpname);
+  }
+  return 0;
+}
 
-    WRITE_LINE(ofile, "\n");
+/******************************************************************************
+Function `save_ascii_stream`:
+  Write the first objects of the data catalogue to an opened stream, which
+  is kept open for subsequent objects.
+Arguments:
+  * `fp`:       the stream for writing;
+  * `data`:     structure for the the data catalogue, with copied columns;
+  * `n`:        number of objects to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_ascii_stream(OSTREAM *fp, const DATA *data, const size_t n) {
+  if (!fp) {
+    P_ERR("no opened stream for writing\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (!data) {
+    P_ERR("the data catalog is not read\n");
+    return BRICKMASK_ERR_INIT;
   }
 
+  OFILE *ofile = output_init();
+  if (!ofile) return BRICKMASK_ERR_FILE;
+  ofile->fp = fp;
+
+  int err = output_rows(ofile, data, NULL, 0, n);
+  if (!err) err = output_flush(ofile);
+
+  /* Detach the stream, which is closed by the caller. */
+  ofile->fp = NULL;
   output_destroy(ofile);
-  return 0;
+  return (err) ? BRICKMASK_ERR_FILE : 0;
 }
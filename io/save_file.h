@@ -33,6 +33,7 @@
 #define __SAVE_RES_H__
 
 #include "data_io.h"
+#include "stream_io.h"
 
 /*============================================================================*\
                     Interfaces for saving output catalogues
@@ -50,6 +51,19 @@ Return:
 ******************************************************************************/
 int save_ascii(const CONF *conf, const DATA *data, const int idx);
 
+/******************************************************************************
+Function `save_ascii_stream`:
+  Write the first objects of the data catalogue to an opened stream, which
+  is kept open for subsequent objects.
+Arguments:
+  * `fp`:       the stream for writing;
+  * `data`:     structure for the the data catalogue, with copied columns;
+  * `n`:        number of objects to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_ascii_stream(OSTREAM *fp, const DATA *data, const size_t n);
+
 /******************************************************************************
 Function `save_fits`:
   Write the data catalogue to a FITS file.
@@ -62,4 +76,44 @@ Return:
 ******************************************************************************/
 int save_fits(const CONF *conf, const DATA *data, const int idx);
 
+/******************************************************************************
+Function `save_npy`:
+  Write the data catalogue to a NumPy array file, or a directory of arrays.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_npy(const CONF *conf, const DATA *data, const int idx);
+
+/******************************************************************************
+Function `save_mask`:
+  Write only maskbits and subsample IDs of the data catalogue, in the order
+  of the input catalogue, to a FITS table, NumPy array, or binary file.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_mask(const CONF *conf, const DATA *data, const int idx);
+
+#ifdef HDF5
+/******************************************************************************
+Function `save_hdf5`:
+  Write maskbits and subsample IDs as datasets of an HDF5 file, which is
+  either the input catalogue, or a new file.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_hdf5(const CONF *conf, const DATA *data, const int idx);
+#endif
+
 #endif
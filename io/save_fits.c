@@ -15,7 +15,10 @@
 #include "read_file.h"
 #include <fitsio.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
 
 #define FITS_ABORT_SINGLE {                                     \
   P_ERR("cfitsio error: ");                                     \
@@ -69,6 +72,211 @@ static inline char *force_output(const char *fname) {
   return output;
 }
 
+/******************************************************************************
+Function `fits_tile_compressed`:
+  Check whether tables are to be tile-compressed for an output FITS file,
+  from the suffix of the filename.
+Arguments:
+  * `fname`:    filename of the output FITS file.
+Return:
+  True if the tables are to be tile-compressed; false otherwise.
+******************************************************************************/
+static inline bool fits_tile_compressed(const char *fname) {
+  const size_t len = strlen(fname);
+  const size_t slen = strlen(BRICKMASK_FZ_SUFFIX);
+  return len > slen && !strcmp(fname + len - slen, BRICKMASK_FZ_SUFFIX);
+}
+
+/******************************************************************************
+Function `fits_create_output`:
+  Create an output FITS file, which is kept in memory if the table is to be
+  tile-compressed.  Files with the suffix `.gz` are compressed by CFITSIO
+  when they are closed.
+Arguments:
+  * `fp`:       address of the pointer to the output FITS file;
+  * `fname`:    filename of the output FITS file;
+  * `status`:   the CFITSIO status.
+Return:
+  The CFITSIO status.
+******************************************************************************/
+static int fits_create_output(fitsfile **fp, const char *fname, int *status) {
+  return fits_create_file(fp,
+      fits_tile_compressed(fname) ? BRICKMASK_FITS_MEMFILE : fname, status);
+}
+
+/******************************************************************************
+Function `fits_close_output`:
+  Close an output FITS file created by `fits_create_output`, after writing
+  the tile-compressed table to disk if necessary.
+Arguments:
+  * `fp`:       pointer to the output FITS file;
+  * `fname`:    filename of the output FITS file;
+  * `status`:   the CFITSIO status.
+Return:
+  The CFITSIO status.
+******************************************************************************/
+static int fits_close_output(fitsfile *fp, const char *fname, int *status) {
+  if (fits_tile_compressed(fname)) {
+    /* Compressed tables follow an empty primary image. */
+    fitsfile *cfp = NULL;
+    if (!fits_create_file(&cfp, fname, status) &&
+        !fits_create_img(cfp, BYTE_IMG, 0, NULL, status))
+      fits_compress_table(fp, cfp, status);
+    if (cfp) fits_close_file(cfp, status);
+  }
+  fits_close_file(fp, status);
+  return *status;
+}
+
+/******************************************************************************
+Function `column_key_index`:
+  Get the column number of a column-specific keyword, i.e., 'T' followed by
+  capital letters and a column number, such as `TUNIT3` or `TNULL12`.
+Arguments:
+  * `card`:     the header card;
+  * `root`:     length of the keyword without the column number.
+Return:
+  The column number if the keyword is column-specific; 0 otherwise.
+******************************************************************************/
+static int column_key_index(const char *card, int *root) {
+  if (card[0] != 'T') return 0;
+  int i = 1;
+  while (i < 8 && isupper((unsigned char) card[i])) i++;
+  if (i == 8 || card[i] < '1' || card[i] > '9') return 0;
+  *root = i;
+  int n = 0;
+  while (i < 8 && isdigit((unsigned char) card[i]))
+    n = n * 10 + card[i++] - '0';
+  if (i < 8 && card[i] != ' ' && card[i] != '=' && card[i] != '\0') return 0;
+  return n;
+}
+
+/******************************************************************************
+Function `fits_create_subset`:
+  Create the header of a binary table with only specific columns of an
+  existing table, followed by the maskbit and subsample ID columns, without
+  copying or deleting columns.  Column-specific keywords of the selected
+  columns are renumbered; the other keywords are copied, except for the
+  structural ones and checksums.
+Arguments:
+  * `ifp`:      pointer to the input FITS file, at the table HDU;
+  * `ofp`:      pointer to the output FITS file, or NULL for replacing the
+                current HDU of `ifp`;
+  * `col`:      information of the selected columns;
+  * `ncol`:     number of selected columns;
+  * `mcol`:     name of the maskbit column;
+  * `mform`:    TFORM of the maskbit column;
+  * `subid`:    true for appending the subsample ID column.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int fits_create_subset(fitsfile *ifp, fitsfile *ofp,
+    const FITS_COL_t *col, const int ncol, const char *mcol,
+    const char *mform, const bool subid) {
+  int status = 0;
+  int nkey = 0;
+  if (fits_get_hdrspace(ifp, &nkey, NULL, &status)) {
+    P_ERR("cfitsio error: "); fits_report_error(stderr, status);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* Allocate memory for the header cards and column names/formats. */
+  const int nnew = ncol + ((subid) ? 2 : 1);
+  char *cards = malloc(((size_t) nkey * FLEN_CARD +
+      (size_t) nnew * 2 * FLEN_VALUE) * sizeof(char));
+  char **ttype = malloc((size_t) nnew * 2 * sizeof(char *));
+  if (!cards || !ttype) {
+    P_ERR("failed to allocate memory for the FITS header\n");
+    if (cards) free(cards);
+    if (ttype) free(ttype);
+    return BRICKMASK_ERR_MEMORY;
+  }
+  char **tform = ttype + nnew;
+  for (int i = 0; i < nnew; i++) {
+    ttype[i] = cards + (size_t) nkey * FLEN_CARD + (size_t) i * FLEN_VALUE;
+    tform[i] = ttype[i] + (size_t) nnew * FLEN_VALUE;
+  }
+
+  /* Read names and formats of the selected columns, and all header cards
+     before the input table is possibly removed. */
+  char key[FLEN_KEYWORD];
+  for (int i = 0; i < ncol; i++) {
+    fits_make_keyn("TTYPE", col[i].n, key, &status);
+    fits_read_key(ifp, TSTRING, key, ttype[i], NULL, &status);
+    fits_make_keyn("TFORM", col[i].n, key, &status);
+    fits_read_key(ifp, TSTRING, key, tform[i], NULL, &status);
+  }
+  snprintf(ttype[ncol], FLEN_VALUE, "%s", mcol);
+  snprintf(tform[ncol], FLEN_VALUE, "%s", mform);
+  if (subid) {
+    snprintf(ttype[ncol + 1], FLEN_VALUE, "%s", BRICKMASK_FITS_SUBID);
+    snprintf(tform[ncol + 1], FLEN_VALUE, "B");
+  }
+  for (int k = 0; k < nkey; k++)
+    fits_read_record(ifp, k + 1, cards + (size_t) k * FLEN_CARD, &status);
+
+  /* Create the table with an empty data unit. */
+  if (ofp) {
+    fits_create_tbl(ofp, BINARY_TBL, 0, nnew, ttype, tform, NULL, NULL,
+        &status);
+  }
+  else {
+    /* The table is replaced at the same HDU, which is never primary. */
+    int ihdu = 0;
+    fits_get_hdu_num(ifp, &ihdu);
+    fits_delete_hdu(ifp, NULL, &status);
+    fits_movabs_hdu(ifp, ihdu - 1, NULL, &status);
+    fits_insert_btbl(ifp, 0, nnew, ttype, tform, NULL, NULL, 0, &status);
+    ofp = ifp;
+  }
+
+  /* Copy the remaining keywords. */
+  bool skip = false;
+  for (int k = 0; !status && k < nkey; k++) {
+    const char *card = cards + (size_t) k * FLEN_CARD;
+    switch (fits_get_keyclass((char *) card)) {
+      case TYP_STRUC_KEY:
+      case TYP_CMPRS_KEY:
+      case TYP_CKSUM_KEY:
+      case TYP_WCS_KEY:
+        skip = true;
+        continue;
+      case TYP_CONT_KEY:
+        /* Keep the continued long strings with their keywords. */
+        if (skip) continue;
+        break;
+      default:
+        skip = false;
+    }
+
+    int root = 0;
+    const int n = column_key_index(card, &root);
+    if (n) {
+      /* Renumber keywords of the selected columns. */
+      int j;
+      for (j = 0; j < ncol; j++) if (col[j].n == n) break;
+      if (j == ncol) {
+        skip = true;
+        continue;
+      }
+      char ncard[FLEN_CARD];
+      const size_t len = strlen(card);
+      snprintf(key, FLEN_KEYWORD, "%.*s%d", root, card, j + 1);
+      snprintf(ncard, FLEN_CARD, "%-8s%s", key, card + ((len < 8) ? len : 8));
+      fits_write_record(ofp, ncard, &status);
+    }
+    else fits_write_record(ofp, (char *) card, &status);
+  }
+
+  free(cards);
+  free(ttype);
+  if (status) {
+    P_ERR("cfitsio error: "); fits_report_error(stderr, status);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
 
 /*============================================================================*\
                   Template function for saving a FITS catalog
@@ -324,12 +532,17 @@ int save_fits(const CONF *conf, const DATA *data, const int idx) {
   char *output = force_output(conf->output[idx]);
   if (!output) return BRICKMASK_ERR_MEMORY;
 
+  /* Tile-compressed tables cannot be modified in place, so they are always
+     written as new files. */
+  const bool overwrite = !strcmp(conf->input[idx], conf->output[idx]) &&
+      !fits_tile_compressed(conf->output[idx]);
+
   /* Choose the function for saving the FITS catalogue. */
   int (*save_fits_func) (const char *, const CONF *, const DATA *, const int) =
       NULL;
   switch (data->mtype) {
     case TBYTE:
-      if (strcmp(conf->input[idx], conf->output[idx])) {
+      if (!overwrite) {
         if (data->subid) {
           save_fits_func = (conf->ncol) ? fits_save_uint8_t_subid :
               fits_save_uint8_t_subid_all;
@@ -351,7 +564,7 @@ int save_fits(const CONF *conf, const DATA *data, const int idx) {
       }
       break;
     case TSHORT:
-      if (strcmp(conf->input[idx], conf->output[idx])) {
+      if (!overwrite) {
         if (data->subid) {
           save_fits_func = (conf->ncol) ? fits_save_uint16_t_subid :
               fits_save_uint16_t_subid_all;
@@ -373,7 +586,7 @@ int save_fits(const CONF *conf, const DATA *data, const int idx) {
       }
       break;
     case TINT:
-      if (strcmp(conf->input[idx], conf->output[idx])) {
+      if (!overwrite) {
         if (data->subid) {
           save_fits_func = (conf->ncol) ? fits_save_uint32_t_subid :
               fits_save_uint32_t_subid_all;
@@ -395,7 +608,7 @@ int save_fits(const CONF *conf, const DATA *data, const int idx) {
       }
       break;
     case TLONG:
-      if (strcmp(conf->input[idx], conf->output[idx])) {
+      if (!overwrite) {
         if (data->subid) {
           save_fits_func = (conf->ncol) ? fits_save_uint64_t_subid :
               fits_save_uint64_t_subid_all;
@@ -0,0 +1,196 @@
+/*******************************************************************************
+* save_hdf5.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#ifdef HDF5
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "save_file.h"
+#include "hdf5_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fitsio.h>
+
+/*============================================================================*\
+                        Functions for writing HDF5 files
+\*============================================================================*/
+
+/******************************************************************************
+Function `hdf5_write_dset`:
+  Write a 1-D array to a new dataset of an HDF5 file.
+Arguments:
+  * `fid`:      identifier of the HDF5 file;
+  * `fname`:    name of the file;
+  * `path`:     path of the dataset;
+  * `ftype`:    data type of the dataset in the file;
+  * `mtype`:    data type of the array in memory;
+  * `n`:        number of elements;
+  * `arr`:      the array to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int hdf5_write_dset(const hid_t fid, const char *fname,
+    const char *path, const hid_t ftype, const hid_t mtype, const size_t n,
+    const void *arr) {
+  const hsize_t dim = n;
+  hid_t lcpl, space, dset;
+  lcpl = space = dset = H5I_INVALID_HID;
+  int err = 0;
+  /* Groups of the coordinate datasets are created in new files. */
+  if ((lcpl = H5Pcreate(H5P_LINK_CREATE)) < 0 ||
+      H5Pset_create_intermediate_group(lcpl, 1) < 0 ||
+      (space = H5Screate_simple(1, &dim, NULL)) < 0 ||
+      (dset = H5Dcreate2(fid, path, ftype, space, lcpl, H5P_DEFAULT,
+      H5P_DEFAULT)) < 0) {
+    P_ERR("failed to create dataset `%s' in file: `%s'\n", path, fname);
+    err = BRICKMASK_ERR_FILE;
+  }
+  else if (n && H5Dwrite(dset, mtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, arr) < 0) {
+    P_ERR("failed to write dataset `%s' to file: `%s'\n", path, fname);
+    err = BRICKMASK_ERR_FILE;
+  }
+  if (dset >= 0) H5Dclose(dset);
+  if (space >= 0) H5Sclose(space);
+  if (lcpl >= 0) H5Pclose(lcpl);
+  return err;
+}
+
+/******************************************************************************
+Function `hdf5_copy_cols`:
+  Copy datasets of the input HDF5 file to the output one, without
+  converting the data.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `idx`:      index of the output catalogue;
+  * `fid`:      identifier of the output file.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int hdf5_copy_cols(const CONF *conf, const int idx, const hid_t fid) {
+  hid_t ifid = hdf5_open(conf->input[idx], false);
+  if (ifid < 0) return BRICKMASK_ERR_FILE;
+  hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+  if (lcpl < 0 || H5Pset_create_intermediate_group(lcpl, 1) < 0) {
+    P_ERR("failed to initialise the copy of HDF5 datasets\n");
+    if (lcpl >= 0) H5Pclose(lcpl);
+    H5Fclose(ifid);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  int err = 0;
+  for (int i = 0; i < conf->ncol; i++) {
+    if (H5Ocopy(ifid, conf->ocol[i], fid, conf->ocol[i], H5P_DEFAULT, lcpl)
+        < 0) {
+      P_ERR("failed to copy dataset `%s' from the input catalog: `%s'\n",
+          conf->ocol[i], conf->input[idx]);
+      err = BRICKMASK_ERR_FILE;
+      break;
+    }
+  }
+  H5Pclose(lcpl);
+  H5Fclose(ifid);
+  return err;
+}
+
+
+/*============================================================================*\
+                 Interface for saving the HDF5-format catalogue
+\*============================================================================*/
+
+/******************************************************************************
+Function `save_hdf5`:
+  Write maskbits and subsample IDs as datasets of an HDF5 file, which is
+  either the input catalogue, or a new file.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_hdf5(const CONF *conf, const DATA *data, const int idx) {
+  if (!conf) {
+    P_ERR("configuration parameters are not loaded\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (!data) {
+    P_ERR("the data catalog is not read\n");
+    return BRICKMASK_ERR_INIT;
+  }
+
+  const char *fname = conf->output[idx];
+  const size_t n = data->iidx[idx + 1] - data->iidx[idx];
+  int err = 0;
+  hid_t fid;
+
+  /* Datasets are added to the input file, without rewriting the others. */
+  if (same_file(conf->input[idx], fname)) {
+    if (conf->ncol) {
+      P_WRN(FMT_KEY(OUTPUT_COLUMN) " is omitted for updating the input "
+          "catalog: `%s'\n", fname);
+    }
+    if ((fid = hdf5_open(fname, true)) < 0) return BRICKMASK_ERR_FILE;
+    hid_t dset = H5Dopen2(fid, conf->cname[0], H5P_DEFAULT);
+    hid_t space = (dset < 0) ? H5I_INVALID_HID : H5Dget_space(dset);
+    hsize_t num = 0;
+    if (space < 0 || H5Sget_simple_extent_dims(space, &num, NULL) != 1 ||
+        num != n) {
+      P_ERR("the input catalog has been modified: `%s'\n", fname);
+      err = BRICKMASK_ERR_FILE;
+    }
+    if (space >= 0) H5Sclose(space);
+    if (dset >= 0) H5Dclose(dset);
+  }
+  else {
+    H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+    if ((fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT))
+        < 0) {
+      P_ERR("cannot open file for writing: `%s'\n", fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    if (conf->ncol) err = hdf5_copy_cols(conf, idx, fid);
+  }
+
+  /* Maskbits are stored with the minimum unsigned integer type. */
+  hid_t ftype, mtype;
+  switch (data->mtype) {
+    case TBYTE:  ftype = H5T_STD_U8LE;  mtype = H5T_NATIVE_UINT8;  break;
+    case TSHORT: ftype = H5T_STD_U16LE; mtype = H5T_NATIVE_UINT16; break;
+    case TINT:   ftype = H5T_STD_U32LE; mtype = H5T_NATIVE_UINT32; break;
+    default:     ftype = H5T_STD_U64LE; mtype = H5T_NATIVE_UINT64; break;
+  }
+  const size_t msize = mask_size(data->mtype);
+
+  const char *name[2] = {conf->mcol, BRICKMASK_FITS_SUBID};
+  const void *arr[2] = {(const unsigned char *) data->mask +
+      data->iidx[idx] * msize,
+      (data->subid) ? data->subid + data->iidx[idx] : NULL};
+  for (int i = 0; !err && i < ((data->subid) ? 2 : 1); i++) {
+    char *path = hdf5_sibling(conf->cname[0], name[i]);
+    if (!path) {
+      err = BRICKMASK_ERR_MEMORY;
+      break;
+    }
+    err = hdf5_write_dset(fid, fname, path, (i) ? H5T_STD_U8LE : ftype,
+        (i) ? H5T_NATIVE_UINT8 : mtype, n, arr[i]);
+    free(path);
+  }
+
+  if (H5Fclose(fid) < 0 && !err) {
+    P_ERR("failed to write to file: `%s'\n", fname);
+    err = BRICKMASK_ERR_FILE;
+  }
+  return err;
+}
+
+#endif
@@ -0,0 +1,206 @@
+/*******************************************************************************
+* save_mask.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#include "define.h"
+#include "save_file.h"
+#include "npy_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fitsio.h>
+
+/*============================================================================*\
+                 Functions for writing maskbits without catalogs
+\*============================================================================*/
+
+/******************************************************************************
+Function `save_mask_fits`:
+  Write maskbits and subsample IDs as columns of a FITS table.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int save_mask_fits(const CONF *conf, const DATA *data, const int idx) {
+  /* Generate the filename for force overwriting. */
+  const size_t len = strlen(conf->output[idx]);
+  char *fname = malloc(len + 2);
+  if (!fname) {
+    P_ERR("failed to allocate memory for the output filename\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  fname[0] = '!';
+  memcpy(fname + 1, conf->output[idx], len + 1);
+
+  /* Maskbits are stored as signed integers in FITS, so the bits are passed
+     through without conversion. */
+  char *tform[2] = {NULL, "B"};
+  int wtype;
+  switch (data->mtype) {
+    case TBYTE:  tform[0] = "B"; wtype = TBYTE;     break;
+    case TSHORT: tform[0] = "I"; wtype = TSHORT;    break;
+    case TINT:   tform[0] = "J"; wtype = TINT;      break;
+    default:     tform[0] = "K"; wtype = TLONGLONG; break;
+  }
+  char *ttype[2] = {conf->mcol, BRICKMASK_FITS_SUBID};
+  const int ncol = (data->subid) ? 2 : 1;
+
+  const size_t n = data->iidx[idx + 1] - data->iidx[idx];
+  const size_t msize = mask_size(data->mtype);
+  int status = 0;
+  fitsfile *fp = NULL;
+  if (!fits_create_file(&fp, fname, &status) &&
+      !fits_create_tbl(fp, BINARY_TBL, n, ncol, ttype, tform, NULL, NULL,
+      &status) && n) {
+    if (!fits_write_col(fp, wtype, 1, 1, 1, n,
+        (unsigned char *) data->mask + data->iidx[idx] * msize, &status) &&
+        data->subid) {
+      fits_write_col(fp, TBYTE, 2, 1, 1, n, data->subid + data->iidx[idx],
+          &status);
+    }
+  }
+  free(fname);
+
+  if (status) {
+    P_ERR("cfitsio error: "); fits_report_error(stderr, status);
+    status = 0;
+    if (fp) fits_close_file(fp, &status);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (fits_close_file(fp, &status)) {
+    P_ERR("cfitsio error: "); fits_report_error(stderr, status);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `save_mask_rows`:
+  Write maskbits and subsample IDs as packed binary rows, with the native
+  byte order, optionally preceded by the header of a NumPy array.
+Arguments:
+  * `fp`:       pointer to the output file;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue;
+  * `npy`:      true for writing the NumPy array header.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int save_mask_rows(FILE *fp, const CONF *conf, const DATA *data,
+    const int idx, const bool npy) {
+  const size_t n = data->iidx[idx + 1] - data->iidx[idx];
+  const size_t msize = mask_size(data->mtype);
+  const unsigned char *mask =
+      (unsigned char *) data->mask + data->iidx[idx] * msize;
+
+  if (npy) {
+    /* A plain array for maskbits, or a structured one with subsample IDs. */
+    const char *mtype = npy_mask_descr(data->mtype);
+    const char *fmt = (data->subid) ? "[('%s', '%s'), ('%s', '|u1')]" :
+        "'%s'";
+    char *descr;
+    int len = (data->subid) ?
+        snprintf(NULL, 0, fmt, conf->mcol, mtype, BRICKMASK_FITS_SUBID) :
+        snprintf(NULL, 0, fmt, mtype);
+    if (len < 0 || !(descr = malloc(len + 1))) {
+      P_ERR("failed to allocate memory for the header of NumPy arrays\n");
+      return BRICKMASK_ERR_MEMORY;
+    }
+    if (data->subid)
+      snprintf(descr, len + 1, fmt, conf->mcol, mtype, BRICKMASK_FITS_SUBID);
+    else snprintf(descr, len + 1, fmt, mtype);
+    int err = npy_write_header(fp, descr, n);
+    free(descr);
+    if (err) return err;
+  }
+
+  /* Maskbits are contiguous if there is no subsample ID. */
+  if (!data->subid) {
+    return (fwrite(mask, msize, n, fp) != n) ? BRICKMASK_ERR_FILE : 0;
+  }
+
+  /* Interleave maskbits and subsample IDs by chunks. */
+  const size_t width = msize + 1;
+  const size_t nstep = BRICKMASK_FILE_CHUNK / width;
+  unsigned char *chunk = malloc(nstep * width);
+  if (!chunk) {
+    P_ERR("failed to allocate memory for writing maskbits\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  const unsigned char *subid = data->subid + data->iidx[idx];
+  for (size_t i = 0; i < n; i += nstep) {
+    const size_t nrow = (nstep < n - i) ? nstep : n - i;
+    unsigned char *p = chunk;
+    for (size_t j = i; j < i + nrow; j++) {
+      memcpy(p, mask + j * msize, msize);
+      p[msize] = subid[j];
+      p += width;
+    }
+    if (fwrite(chunk, width, nrow, fp) != nrow) {
+      free(chunk);
+      return BRICKMASK_ERR_FILE;
+    }
+  }
+  free(chunk);
+  return 0;
+}
+
+
+/*============================================================================*\
+                  Interface for saving maskbits without catalogs
+\*============================================================================*/
+
+/******************************************************************************
+Function `save_mask`:
+  Write only maskbits and subsample IDs of the data catalogue, in the order
+  of the input catalogue, to a FITS table, NumPy array, or binary file.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_mask(const CONF *conf, const DATA *data, const int idx) {
+  if (!conf) {
+    P_ERR("configuration parameters are not loaded\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (!data) {
+    P_ERR("the data catalog is not read\n");
+    return BRICKMASK_ERR_INIT;
+  }
+
+  if (conf->monly == BRICKMASK_MONLY_FITS) {
+    if (save_mask_fits(conf, data, idx)) return BRICKMASK_ERR_SAVE;
+    return 0;
+  }
+
+  FILE *fp;
+  if (!(fp = fopen(conf->output[idx], "w"))) {
+    P_ERR("cannot open file for writing: `%s'\n", conf->output[idx]);
+    return BRICKMASK_ERR_FILE;
+  }
+  int err = save_mask_rows(fp, conf, data, idx,
+      conf->monly == BRICKMASK_MONLY_NPY);
+  if (fclose(fp) && !err) err = BRICKMASK_ERR_FILE;
+  if (err) {
+    P_ERR("failed to write to file: `%s'\n", conf->output[idx]);
+    return BRICKMASK_ERR_SAVE;
+  }
+  return 0;
+}
@@ -0,0 +1,347 @@
+/*******************************************************************************
+* save_npy.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "save_file.h"
+#include "npy_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fitsio.h>
+
+/*============================================================================*\
+                     Functions for writing NumPy array files
+\*============================================================================*/
+
+/******************************************************************************
+Function `save_npy_array`:
+  Write a 1-D plain array to a NumPy array file.
+Arguments:
+  * `fname`:    name of the output file;
+  * `type`:     NumPy type descriptor of the elements;
+  * `n`:        number of elements;
+  * `size`:     number of bytes of each element;
+  * `arr`:      the array to be written.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int save_npy_array(const char *fname, const char *type, const size_t n,
+    const size_t size, const void *arr) {
+  char descr[8];
+  snprintf(descr, sizeof descr, "'%s'", type);
+  FILE *fp;
+  if (!(fp = fopen(fname, "w"))) {
+    P_ERR("cannot open file for writing: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (npy_write_header(fp, descr, n) || fwrite(arr, size, n, fp) != n) {
+    P_ERR("failed to write to file: `%s'\n", fname);
+    fclose(fp);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (fclose(fp)) {
+    P_ERR("failed to write to file: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `save_npy_dir`:
+  Write maskbits and subsample IDs as NumPy arrays to a directory.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int save_npy_dir(const CONF *conf, const DATA *data, const int idx) {
+  const char *dir = conf->output[idx];
+  if (mkdir(dir, 0777) && errno != EEXIST) {
+    P_ERR("cannot create the output directory: `%s'\n", dir);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  const size_t n = data->iidx[idx + 1] - data->iidx[idx];
+  const size_t msize = mask_size(data->mtype);
+  char *fname = npy_path(dir, conf->mcol);
+  if (!fname) return BRICKMASK_ERR_MEMORY;
+  if (save_npy_array(fname, npy_mask_descr(data->mtype), n, msize,
+      (unsigned char *) data->mask + data->iidx[idx] * msize)) {
+    free(fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  free(fname);
+
+  if (data->subid) {
+    if (!(fname = npy_path(dir, BRICKMASK_FITS_SUBID)))
+      return BRICKMASK_ERR_MEMORY;
+    if (save_npy_array(fname, "|u1", n, 1, data->subid + data->iidx[idx])) {
+      free(fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    free(fname);
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `save_npy_descr`:
+  Generate the type descriptor of the output structured array.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `npy`:      header of the input array file;
+  * `fid`:      indices of the fields to be saved.
+Return:
+  Address of the descriptor on success; NULL on error.
+******************************************************************************/
+static char *save_npy_descr(const CONF *conf, const DATA *data,
+    const NPY_t *npy, const int *fid) {
+  const int nf = (conf->ncol) ? conf->ncol : npy->nfield;
+  const char *mtype = npy_mask_descr(data->mtype);
+  const char *fmt = ", ('%s', '%s')";
+  size_t len = snprintf(NULL, 0, fmt, conf->mcol, mtype) + 3;
+  if (data->subid) len += snprintf(NULL, 0, fmt, BRICKMASK_FITS_SUBID, "|u1");
+  for (int i = 0; i < nf; i++) len += npy->field[fid[i]].dlen + 2;
+
+  char *descr = malloc(len);
+  if (!descr) {
+    P_ERR("failed to allocate memory for the header of NumPy arrays\n");
+    return NULL;
+  }
+  char *p = descr;
+  *p++ = '[';
+  for (int i = 0; i < nf; i++) {
+    const NPY_FIELD_t *f = npy->field + fid[i];
+    if (i) {
+      *p++ = ',';
+      *p++ = ' ';
+    }
+    memcpy(p, npy->hdr + f->dpos, f->dlen);
+    p += f->dlen;
+  }
+  p += sprintf(p, fmt, conf->mcol, mtype);
+  if (data->subid) p += sprintf(p, fmt, BRICKMASK_FITS_SUBID, "|u1");
+  *p++ = ']';
+  *p = '\0';
+  return descr;
+}
+
+/******************************************************************************
+Function `save_npy_rows`:
+  Write rows of the output structured array, by chunks.
+Arguments:
+  * `fp`:       pointer to the output file;
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue;
+  * `npy`:      header of the input array file;
+  * `map`:      the mapped input array file;
+  * `fid`:      indices of the fields to be saved.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int save_npy_rows(FILE *fp, const CONF *conf, const DATA *data,
+    const int idx, const NPY_t *npy, const unsigned char *map,
+    const int *fid) {
+  const size_t msize = mask_size(data->mtype);
+  size_t owidth = msize + ((data->subid) ? 1 : 0);
+  if (conf->ncol) {
+    for (int i = 0; i < conf->ncol; i++) owidth += npy->field[fid[i]].size;
+  }
+  else owidth += npy->width;
+
+  const size_t nstep = (BRICKMASK_FILE_CHUNK > owidth) ?
+      BRICKMASK_FILE_CHUNK / owidth : 1;
+  unsigned char *chunk = malloc(nstep * owidth);
+  if (!chunk) {
+    P_ERR("failed to allocate memory for writing NumPy arrays\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+
+  const unsigned char *row = map + npy->start;
+  const unsigned char *mask = (const unsigned char *) data->mask;
+  for (size_t i = data->iidx[idx]; i < data->iidx[idx + 1]; ) {
+    const size_t nrow = (nstep < data->iidx[idx + 1] - i) ? nstep :
+        data->iidx[idx + 1] - i;
+    unsigned char *p = chunk;
+    for (size_t j = 0; j < nrow; j++, i++, row += npy->width) {
+      /* Copy columns of the input array. */
+      if (conf->ncol) {
+        for (int k = 0; k < conf->ncol; k++) {
+          const NPY_FIELD_t *f = npy->field + fid[k];
+          memcpy(p, row + f->offset, f->size);
+          p += f->size;
+        }
+      }
+      else {
+        memcpy(p, row, npy->width);
+        p += npy->width;
+      }
+      /* Append maskbits and subsample IDs with the native byte order. */
+      memcpy(p, mask + i * msize, msize);
+      p += msize;
+      if (data->subid) *p++ = data->subid[i];
+    }
+    if (fwrite(chunk, owidth, nrow, fp) != nrow) {
+      free(chunk);
+      return BRICKMASK_ERR_FILE;
+    }
+  }
+
+  free(chunk);
+  return 0;
+}
+
+/******************************************************************************
+Function `save_npy_table`:
+  Write columns of the input structured array, as well as maskbits and
+  subsample IDs, to a NumPy structured array file.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int save_npy_table(const CONF *conf, const DATA *data, const int idx) {
+  const char *fname = conf->input[idx];
+  NPY_t *npy = npy_open(fname);
+  if (!npy) return BRICKMASK_ERR_FILE;
+  if (npy->n != data->iidx[idx + 1] - data->iidx[idx]) {
+    P_ERR("the input catalog has been modified: `%s'\n", fname);
+    npy_destroy(npy);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* Find the fields to be saved. */
+  const int nf = (conf->ncol) ? conf->ncol : npy->nfield;
+  int *fid = malloc(nf * sizeof(int));
+  if (!fid) {
+    P_ERR("failed to allocate memory for writing NumPy arrays\n");
+    npy_destroy(npy);
+    return BRICKMASK_ERR_MEMORY;
+  }
+  for (int i = 0; i < nf; i++) {
+    if (!conf->ncol) fid[i] = i;
+    else if ((fid[i] = npy_field(npy, conf->ocol[i])) < 0) {
+      P_ERR("column `%s' not found in the input catalog: `%s'\n",
+          conf->ocol[i], fname);
+      free(fid);
+      npy_destroy(npy);
+      return BRICKMASK_ERR_FILE;
+    }
+  }
+
+  char *descr = save_npy_descr(conf, data, npy, fid);
+  unsigned char *map = NULL;
+  size_t msize = 0;
+  if (!descr || npy_map(fname, npy, &map, &msize)) {
+    if (descr) free(descr);
+    free(fid);
+    npy_destroy(npy);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* Overwriting the mapped input file is fatal, so write to a temporary
+     file and rename it afterwards. */
+  char *tmpname = NULL;
+  if (same_file(fname, conf->output[idx])) {
+    const size_t len = strlen(conf->output[idx]);
+    if (!(tmpname = malloc(len + sizeof(BRICKMASK_TMP_SUFFIX)))) {
+      P_ERR("failed to allocate memory for the temporary filename\n");
+      if (map) munmap(map, msize);
+      free(descr); free(fid); npy_destroy(npy);
+      return BRICKMASK_ERR_MEMORY;
+    }
+    memcpy(tmpname, conf->output[idx], len);
+    memcpy(tmpname + len, BRICKMASK_TMP_SUFFIX, sizeof(BRICKMASK_TMP_SUFFIX));
+  }
+  const char *oname = (tmpname) ? tmpname : conf->output[idx];
+
+  /* Write the output array. */
+  int err = 0;
+  FILE *fp;
+  if (!(fp = fopen(oname, "w"))) {
+    P_ERR("cannot open file for writing: `%s'\n", oname);
+    err = BRICKMASK_ERR_FILE;
+  }
+  else {
+    if (npy_write_header(fp, descr, npy->n) ||
+        (npy->n && save_npy_rows(fp, conf, data, idx, npy, map, fid))) {
+      P_ERR("failed to write to file: `%s'\n", oname);
+      err = BRICKMASK_ERR_FILE;
+    }
+    if (fclose(fp) && !err) {
+      P_ERR("failed to write to file: `%s'\n", oname);
+      err = BRICKMASK_ERR_FILE;
+    }
+  }
+
+  if (map) munmap(map, msize);
+  free(descr);
+  free(fid);
+  npy_destroy(npy);
+
+  if (tmpname) {
+    if (!err && rename(tmpname, conf->output[idx])) {
+      P_ERR("failed to rename the temporary file `%s' to `%s'\n", tmpname,
+          conf->output[idx]);
+      err = BRICKMASK_ERR_FILE;
+    }
+    free(tmpname);
+  }
+  return err;
+}
+
+
+/*============================================================================*\
+                Interface for saving the NumPy-format catalogue
+\*============================================================================*/
+
+/******************************************************************************
+Function `save_npy`:
+  Write the data catalogue to a NumPy array file, or a directory of arrays.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `data`:     structure for the the data catalogue;
+  * `idx`:      index of the output catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_npy(const CONF *conf, const DATA *data, const int idx) {
+  if (!conf) {
+    P_ERR("configuration parameters are not loaded\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (!data) {
+    P_ERR("the data catalog is not read\n");
+    return BRICKMASK_ERR_INIT;
+  }
+
+  /* The output layout follows that of the input catalogue. */
+  struct stat st;
+  if (stat(conf->input[idx], &st)) {
+    P_ERR("cannot access the input catalog: `%s'\n", conf->input[idx]);
+    return BRICKMASK_ERR_FILE;
+  }
+  return (S_ISDIR(st.st_mode)) ? save_npy_dir(conf, data, idx) :
+      save_npy_table(conf, data, idx);
+}
@@ -0,0 +1,693 @@
+/*******************************************************************************
+* stream_io.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "stream_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef ZLIB
+#include <zlib.h>
+#endif
+#ifdef ZSTD
+#include <zstd.h>
+#endif
+#ifdef OMP
+#include <omp.h>
+#endif
+
+/* Data structure for reading a (compressed) file. */
+struct ISTREAM {
+  BRICKMASK_comp_t comp;        /* compression format                   */
+  const char *fname;            /* name of the file                     */
+  FILE *fp;                     /* uncompressed or zstd stream          */
+  bool err;                     /* indicator of errors                  */
+#ifdef ZLIB
+  gzFile gz;                    /* gzip stream                          */
+#endif
+#ifdef ZSTD
+  ZSTD_DCtx *dctx;              /* zstd decompression context           */
+  ZSTD_inBuffer in;             /* buffer for compressed bytes          */
+  size_t isize;                 /* size allocated for the buffer        */
+  size_t zret;                  /* zero if a frame is complete          */
+#endif
+};
+
+/* Data structure for writing a (compressed) file. */
+struct OSTREAM {
+  BRICKMASK_comp_t comp;        /* compression format                   */
+  const char *fname;            /* name of the file                     */
+  FILE *fp;                     /* the file being written               */
+  void *obuf;                   /* buffer for compressed bytes          */
+  size_t osize;                 /* size allocated for the buffer        */
+#ifdef ZLIB
+  z_stream zs;                  /* gzip compression stream              */
+  bool zdirty;                  /* true if the gzip member is open      */
+#endif
+#ifdef ZSTD
+  ZSTD_CCtx *cctx;              /* zstd compression context             */
+#endif
+};
+
+/*============================================================================*\
+                    Functions for detecting compression formats
+\*============================================================================*/
+
+/******************************************************************************
+Function `input_compression`:
+  Detect the compression format of a file, from the magic bytes.  Only
+  regular files are checked, as bytes of pipes cannot be read twice.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  The compression format; BRICKMASK_COMP_NONE if the file cannot be read.
+******************************************************************************/
+BRICKMASK_comp_t input_compression(const char *fname) {
+  static const unsigned char gzip[2] = {0x1f, 0x8b};
+  static const unsigned char zstd[4] = {0x28, 0xb5, 0x2f, 0xfd};
+  unsigned char magic[4];
+  struct stat st;
+  FILE *fp;
+  if (!fname || stat(fname, &st) || !S_ISREG(st.st_mode) ||
+      !(fp = fopen(fname, "rb"))) return BRICKMASK_COMP_NONE;
+  const size_t n = fread(magic, sizeof(unsigned char), 4, fp);
+  fclose(fp);
+
+  if (n >= 2 && !memcmp(magic, gzip, 2)) return BRICKMASK_COMP_GZIP;
+  if (n == 4 && !memcmp(magic, zstd, 4)) return BRICKMASK_COMP_ZSTD;
+  return BRICKMASK_COMP_NONE;
+}
+
+/******************************************************************************
+Function `has_suffix`:
+  Check whether a string ends with the given suffix.
+Arguments:
+  * `str`:      the string to be checked;
+  * `suffix`:   the suffix.
+Return:
+  True if the suffix is found; false otherwise.
+******************************************************************************/
+static inline bool has_suffix(const char *str, const char *suffix) {
+  const size_t len = strlen(str);
+  const size_t slen = strlen(suffix);
+  return len >= slen && !strcmp(str + len - slen, suffix);
+}
+
+/******************************************************************************
+Function `output_compression`:
+  Decide the compression format of a file to be written, from the suffix.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  The compression format.
+******************************************************************************/
+BRICKMASK_comp_t output_compression(const char *fname) {
+  if (!fname) return BRICKMASK_COMP_NONE;
+  if (has_suffix(fname, BRICKMASK_GZIP_SUFFIX)) return BRICKMASK_COMP_GZIP;
+  if (has_suffix(fname, BRICKMASK_ZSTD_SUFFIX)) return BRICKMASK_COMP_ZSTD;
+  return BRICKMASK_COMP_NONE;
+}
+
+/******************************************************************************
+Function `compression_supported`:
+  Check whether a compression format is enabled at compilation.
+Arguments:
+  * `comp`:     the compression format.
+Return:
+  True if the format is supported; false otherwise.
+******************************************************************************/
+bool compression_supported(const BRICKMASK_comp_t comp) {
+  switch (comp) {
+    case BRICKMASK_COMP_NONE: return true;
+#ifdef ZLIB
+    case BRICKMASK_COMP_GZIP: return true;
+#endif
+#ifdef ZSTD
+    case BRICKMASK_COMP_ZSTD: return true;
+#endif
+    default: return false;
+  }
+}
+
+
+/*============================================================================*\
+                        Functions for reading file streams
+\*============================================================================*/
+
+/******************************************************************************
+Function `istream_open`:
+  Open a file for reading, with transparent decompression.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  Address of the stream on success; NULL on error.
+******************************************************************************/
+ISTREAM *istream_open(const char *fname) {
+  ISTREAM *s = calloc(1, sizeof(ISTREAM));
+  if (!s) {
+    P_ERR("failed to allocate memory for reading file: `%s'\n", fname);
+    return NULL;
+  }
+  s->fname = fname;
+  s->fp = NULL;
+  s->err = false;
+  s->comp = input_compression(fname);
+  if (!compression_supported(s->comp)) {
+    P_ERR("compressed file is not supported by this build: `%s'\n", fname);
+    free(s);
+    return NULL;
+  }
+
+  switch (s->comp) {
+#ifdef ZLIB
+    case BRICKMASK_COMP_GZIP:
+      if (!(s->gz = gzopen(fname, "rb"))) {
+        P_ERR("cannot open file for reading: `%s'\n", fname);
+        free(s);
+        return NULL;
+      }
+      gzbuffer(s->gz, BRICKMASK_FILE_CHUNK);
+      return s;
+#endif
+#ifdef ZSTD
+    case BRICKMASK_COMP_ZSTD:
+      s->isize = ZSTD_DStreamInSize();
+      s->in.src = NULL;
+      s->in.size = s->in.pos = 0;
+      s->zret = 0;
+      if (!(s->dctx = ZSTD_createDCtx()) ||
+          !(s->in.src = malloc(s->isize))) {
+        P_ERR("failed to initialise the decompression of file: `%s'\n",
+            fname);
+        istream_close(s);
+        return NULL;
+      }
+      break;
+#endif
+    default:
+      break;
+  }
+
+  if (!(s->fp = fopen(fname, "r"))) {
+    P_ERR("cannot open file for reading: `%s'\n", fname);
+    istream_close(s);
+    return NULL;
+  }
+  return s;
+}
+
+/******************************************************************************
+Function `istream_read`:
+  Read decompressed bytes from a stream.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      buffer for the bytes read;
+  * `num`:      maximum number of bytes to be read, up to INT_MAX.
+Return:
+  Number of bytes read; zero on end of file or error.
+******************************************************************************/
+size_t istream_read(ISTREAM *s, void *buf, const size_t num) {
+  if (!s || s->err || !num) return 0;
+  switch (s->comp) {
+#ifdef ZLIB
+    case BRICKMASK_COMP_GZIP:
+    {
+      const int n = gzread(s->gz, buf, (unsigned int) num);
+      if (n < 0) {
+        P_ERR("failed to decompress file: `%s'\n", s->fname);
+        s->err = true;
+        return 0;
+      }
+      return n;
+    }
+#endif
+#ifdef ZSTD
+    case BRICKMASK_COMP_ZSTD:
+    {
+      ZSTD_outBuffer out = {buf, num, 0};
+      while (out.pos < out.size) {
+        /* Refill the buffer of compressed bytes if it is consumed. */
+        if (s->in.pos == s->in.size && !feof(s->fp)) {
+          s->in.size = fread((void *) s->in.src, 1, s->isize, s->fp);
+          s->in.pos = 0;
+          if (ferror(s->fp)) {
+            P_ERR("failed to read file: `%s'\n", s->fname);
+            s->err = true;
+            return 0;
+          }
+        }
+        /* All frames are complete, and fully flushed. */
+        if (s->in.pos == s->in.size && feof(s->fp) && !s->zret) break;
+        const size_t pos = out.pos;
+        const size_t ret = ZSTD_decompressStream(s->dctx, &out, &s->in);
+        if (ZSTD_isError(ret)) {
+          P_ERR("failed to decompress file: `%s': %s\n", s->fname,
+              ZSTD_getErrorName(ret));
+          s->err = true;
+          return 0;
+        }
+        s->zret = ret;
+        /* No more output can be flushed. */
+        if (out.pos == pos && s->in.pos == s->in.size && feof(s->fp)) break;
+      }
+      return out.pos;
+    }
+#endif
+    default:
+    {
+      const size_t n = fread(buf, sizeof(char), num, s->fp);
+      if (n < num && ferror(s->fp)) {
+        P_ERR("failed to read file: `%s'\n", s->fname);
+        s->err = true;
+      }
+      return n;
+    }
+  }
+}
+
+/******************************************************************************
+Function `istream_error`:
+  Check whether an error occurred, or the stream ended unexpectedly.
+Arguments:
+  * `s`:        the stream.
+Return:
+  True on error; false otherwise.
+******************************************************************************/
+bool istream_error(const ISTREAM *s) {
+  if (!s) return true;
+  if (s->err) return true;
+#ifdef ZSTD
+  if (s->comp == BRICKMASK_COMP_ZSTD && s->zret) {
+    P_ERR("truncated compressed file: `%s'\n", s->fname);
+    return true;
+  }
+#endif
+  return false;
+}
+
+/******************************************************************************
+Function `istream_close`:
+  Close a stream for reading.
+Arguments:
+  * `s`:        the stream.
+******************************************************************************/
+void istream_close(ISTREAM *s) {
+  if (!s) return;
+#ifdef ZLIB
+  if (s->comp == BRICKMASK_COMP_GZIP && gzclose(s->gz) != Z_OK)
+    P_WRN("failed to close file: `%s'\n", s->fname);
+#endif
+#ifdef ZSTD
+  if (s->comp == BRICKMASK_COMP_ZSTD) {
+    if (s->dctx) ZSTD_freeDCtx(s->dctx);
+    if (s->in.src) free((void *) s->in.src);
+  }
+#endif
+  if (s->fp && fclose(s->fp)) P_WRN("failed to close file: `%s'\n", s->fname);
+  free(s);
+}
+
+
+/*============================================================================*\
+                        Functions for writing file streams
+\*============================================================================*/
+
+/******************************************************************************
+Function `ostream_open`:
+  Open a file for writing, with the given compression format.
+Arguments:
+  * `fname`:    name of the file;
+  * `comp`:     compression format, see `output_compression`.
+Return:
+  Address of the stream on success; NULL on error.
+******************************************************************************/
+OSTREAM *ostream_open(const char *fname, const BRICKMASK_comp_t comp) {
+  OSTREAM *s = calloc(1, sizeof(OSTREAM));
+  if (!s) {
+    P_ERR("failed to allocate memory for writing file: `%s'\n", fname);
+    return NULL;
+  }
+  s->fname = fname;
+  s->fp = NULL;
+  s->comp = comp;
+  if (!compression_supported(s->comp)) {
+    P_ERR("compressed file is not supported by this build: `%s'\n", fname);
+    free(s);
+    return NULL;
+  }
+
+  switch (s->comp) {
+#ifdef ZLIB
+    case BRICKMASK_COMP_GZIP:
+      /* Deflate with gzip wrappers, so that members compressed separately
+         by `ostream_deflate` can be appended to the file. */
+      s->osize = BRICKMASK_FILE_CHUNK;
+      if (!(s->obuf = malloc(s->osize)) ||
+          deflateInit2(&s->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+          BRICKMASK_GZIP_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        P_ERR("failed to initialise the compression of file: `%s'\n", fname);
+        free(s->obuf);
+        free(s);
+        return NULL;
+      }
+      s->zdirty = true;
+      break;
+#endif
+#ifdef ZSTD
+    case BRICKMASK_COMP_ZSTD:
+      s->osize = ZSTD_CStreamOutSize();
+      if (!(s->cctx = ZSTD_createCCtx()) || !(s->obuf = malloc(s->osize))) {
+        P_ERR("failed to initialise the compression of file: `%s'\n", fname);
+        if (s->cctx) ZSTD_freeCCtx(s->cctx);
+        free(s);
+        return NULL;
+      }
+#ifdef OMP
+      /* Compress with worker threads if the library supports it. */
+      if (omp_get_max_threads() > 1)
+        ZSTD_CCtx_setParameter(s->cctx, ZSTD_c_nbWorkers,
+            omp_get_max_threads());
+#endif
+      break;
+#endif
+    default:
+      break;
+  }
+
+  if (!(s->fp = fopen(fname, "w"))) {
+    P_ERR("failed to open the file for writing: `%s'\n", fname);
+#ifdef ZLIB
+    if (s->comp == BRICKMASK_COMP_GZIP) deflateEnd(&s->zs);
+#endif
+#ifdef ZSTD
+    if (s->comp == BRICKMASK_COMP_ZSTD) ZSTD_freeCCtx(s->cctx);
+#endif
+    free(s->obuf);
+    free(s);
+    return NULL;
+  }
+  /* Plain outputs are flushed by large chunks already, which go straight to
+     the file without being copied to the stdio buffer. */
+  if (s->comp == BRICKMASK_COMP_NONE) setvbuf(s->fp, NULL, _IONBF, 0);
+  return s;
+}
+
+/******************************************************************************
+Function `ostream_fdopen`:
+  Open an uncompressed stream for writing to a file descriptor.
+Arguments:
+  * `fd`:       the file descriptor, which is closed with the stream;
+  * `name`:     name of the stream for messages.
+Return:
+  Address of the stream on success; NULL on error.
+******************************************************************************/
+OSTREAM *ostream_fdopen(const int fd, const char *name) {
+  OSTREAM *s = calloc(1, sizeof(OSTREAM));
+  if (!s) {
+    P_ERR("failed to allocate memory for writing file: `%s'\n", name);
+    return NULL;
+  }
+  s->fname = name;
+  s->comp = BRICKMASK_COMP_NONE;
+  if (!(s->fp = fdopen(fd, "w"))) {
+    P_ERR("failed to open the stream for writing: `%s'\n", name);
+    free(s);
+    return NULL;
+  }
+  return s;
+}
+
+/******************************************************************************
+Function `stdout_detach`:
+  Reserve the standard output for data, by duplicating its file descriptor,
+  and redirecting messages printed to it to the standard error.
+Return:
+  The duplicated file descriptor on success; -1 on error.
+******************************************************************************/
+int stdout_detach(void) {
+  fflush(stdout);
+  const int fd = dup(STDOUT_FILENO);
+  if (fd < 0) {
+    P_ERR("failed to duplicate the standard output\n");
+    return -1;
+  }
+  if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+    P_ERR("failed to redirect the standard output\n");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+#ifdef ZLIB
+/******************************************************************************
+Function `gzip_compress`:
+  Compress bytes and write them to the current member of a gzip stream.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      the bytes to be compressed;
+  * `num`:      number of bytes to be compressed, up to UINT_MAX;
+  * `flush`:    Z_NO_FLUSH for ordinary writes, Z_FINISH for ending members.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int gzip_compress(OSTREAM *s, const void *buf, const size_t num,
+    const int flush) {
+  s->zs.next_in = (Bytef *) buf;
+  s->zs.avail_in = (uInt) num;
+  int ret;
+  do {
+    s->zs.next_out = s->obuf;
+    s->zs.avail_out = (uInt) s->osize;
+    if ((ret = deflate(&s->zs, flush)) == Z_STREAM_ERROR) {
+      P_ERR("failed to compress file: `%s'\n", s->fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    const size_t n = s->osize - s->zs.avail_out;
+    if (n && fwrite(s->obuf, n, 1, s->fp) != 1) {
+      P_ERR("failed to write to the output file: `%s'\n", s->fname);
+      return BRICKMASK_ERR_FILE;
+    }
+  }
+  while ((flush == Z_FINISH) ? ret != Z_STREAM_END : s->zs.avail_out == 0);
+  s->zdirty = (flush != Z_FINISH);
+  return 0;
+}
+#endif
+
+#ifdef ZSTD
+/******************************************************************************
+Function `zstd_compress`:
+  Compress bytes and write them to a zstd stream.
+Arguments:
+  * `s`:        the stream;
+  * `in`:       buffer for the bytes to be compressed;
+  * `mode`:     ZSTD_e_continue for ordinary writes, ZSTD_e_end for closing.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int zstd_compress(OSTREAM *s, ZSTD_inBuffer *in,
+    const ZSTD_EndDirective mode) {
+  size_t ret;
+  do {
+    ZSTD_outBuffer out = {s->obuf, s->osize, 0};
+    ret = ZSTD_compressStream2(s->cctx, &out, in, mode);
+    if (ZSTD_isError(ret)) {
+      P_ERR("failed to compress file: `%s': %s\n", s->fname,
+          ZSTD_getErrorName(ret));
+      return BRICKMASK_ERR_FILE;
+    }
+    if (out.pos && fwrite(s->obuf, out.pos, 1, s->fp) != 1) {
+      P_ERR("failed to write to the output file: `%s'\n", s->fname);
+      return BRICKMASK_ERR_FILE;
+    }
+  }
+  while ((mode == ZSTD_e_end) ? ret != 0 : in->pos < in->size);
+  return 0;
+}
+#endif
+
+/******************************************************************************
+Function `ostream_write`:
+  Write bytes to a stream.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      the bytes to be written;
+  * `num`:      number of bytes to be written, up to INT_MAX.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_write(OSTREAM *s, const void *buf, const size_t num) {
+  if (!s) {
+    P_ERR("no opened file for writing\n");
+    return BRICKMASK_ERR_FILE;
+  }
+  if (!num) return 0;
+  switch (s->comp) {
+#ifdef ZLIB
+    case BRICKMASK_COMP_GZIP:
+      return gzip_compress(s, buf, num, Z_NO_FLUSH);
+#endif
+#ifdef ZSTD
+    case BRICKMASK_COMP_ZSTD:
+    {
+      ZSTD_inBuffer in = {buf, num, 0};
+      return zstd_compress(s, &in, ZSTD_e_continue);
+    }
+#endif
+    default:
+      if (fwrite(buf, num, 1, s->fp) != 1) {
+        P_ERR("failed to write to the output file: `%s'\n", s->fname);
+        return BRICKMASK_ERR_FILE;
+      }
+      return 0;
+  }
+}
+
+/******************************************************************************
+Function `ostream_members`:
+  Check whether blocks of bytes can be compressed independently for a
+  stream, by `ostream_deflate`, which is the case for gzip streams.
+Arguments:
+  * `s`:        the stream.
+Return:
+  True if blocks can be compressed independently; false otherwise.
+******************************************************************************/
+bool ostream_members(const OSTREAM *s) {
+  return s && s->comp == BRICKMASK_COMP_GZIP;
+}
+
+/******************************************************************************
+Function `ostream_deflate`:
+  Compress a block of bytes as a complete gzip member, which does not alter
+  the stream, so blocks can be compressed by multiple threads at once.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      the bytes to be compressed;
+  * `num`:      number of bytes to be compressed, up to INT_MAX;
+  * `dst`:      address of the buffer for the member, enlarged if necessary;
+  * `dsize`:    size allocated for the buffer;
+  * `len`:      length of the compressed member.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_deflate(const OSTREAM *s, const void *buf, const size_t num,
+    void **dst, size_t *dsize, size_t *len) {
+  if (!ostream_members(s)) {
+    P_ERR("blocks cannot be compressed separately for the stream\n");
+    return BRICKMASK_ERR_FILE;
+  }
+#ifdef ZLIB
+  z_stream zs;
+  memset(&zs, 0, sizeof(z_stream));
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+      BRICKMASK_GZIP_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    P_ERR("failed to initialise the compression of file: `%s'\n", s->fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  /* The buffer is large enough for compressing all bytes at once. */
+  const size_t bound = deflateBound(&zs, (uLong) num);
+  if (*dsize < bound) {
+    void *tmp = realloc(*dst, bound);
+    if (!tmp) {
+      P_ERR("failed to allocate memory for compressing file: `%s'\n",
+          s->fname);
+      deflateEnd(&zs);
+      return BRICKMASK_ERR_MEMORY;
+    }
+    *dst = tmp;
+    *dsize = bound;
+  }
+  zs.next_in = (Bytef *) buf;
+  zs.avail_in = (uInt) num;
+  zs.next_out = *dst;
+  zs.avail_out = (uInt) bound;
+  const int ret = deflate(&zs, Z_FINISH);
+  deflateEnd(&zs);
+  if (ret != Z_STREAM_END) {
+    P_ERR("failed to compress file: `%s'\n", s->fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  *len = bound - zs.avail_out;
+#else
+  (void) buf; (void) num; (void) dst; (void) dsize; (void) len;
+#endif
+  return 0;
+}
+
+/******************************************************************************
+Function `ostream_write_member`:
+  Write a gzip member compressed by `ostream_deflate` to a stream, after
+  ending the member of bytes written by `ostream_write`, if any.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      the compressed member;
+  * `num`:      length of the member.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_write_member(OSTREAM *s, const void *buf, const size_t num) {
+  if (!ostream_members(s)) {
+    P_ERR("blocks cannot be compressed separately for the stream\n");
+    return BRICKMASK_ERR_FILE;
+  }
+#ifdef ZLIB
+  if (s->zdirty && s->zs.total_in) {
+    if (gzip_compress(s, NULL, 0, Z_FINISH)) return BRICKMASK_ERR_FILE;
+    deflateReset(&s->zs);
+  }
+  s->zdirty = false;
+#endif
+  if (num && fwrite(buf, num, 1, s->fp) != 1) {
+    P_ERR("failed to write to the output file: `%s'\n", s->fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `ostream_close`:
+  Finish the compression and close a stream for writing.
+Arguments:
+  * `s`:        the stream.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_close(OSTREAM *s) {
+  if (!s) return 0;
+  int err = 0;
+#ifdef ZLIB
+  if (s->comp == BRICKMASK_COMP_GZIP) {
+    /* End the last member, which is empty if nothing is written. */
+    if (s->zdirty) err = gzip_compress(s, NULL, 0, Z_FINISH);
+    deflateEnd(&s->zs);
+  }
+#endif
+#ifdef ZSTD
+  if (s->comp == BRICKMASK_COMP_ZSTD) {
+    ZSTD_inBuffer in = {NULL, 0, 0};
+    err = zstd_compress(s, &in, ZSTD_e_end);
+    ZSTD_freeCCtx(s->cctx);
+  }
+#endif
+  free(s->obuf);
+  if (s->fp && fclose(s->fp)) {
+    P_ERR("failed to close file: `%s'\n", s->fname);
+    err = BRICKMASK_ERR_FILE;
+  }
+  free(s);
+  return err;
+}
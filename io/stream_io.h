@@ -0,0 +1,222 @@
+/*******************************************************************************
+* stream_io.h: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+*******************************************************************************/
+
+#ifndef __STREAM_IO_H__
+#define __STREAM_IO_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*============================================================================*\
+                  Data structures for (compressed) file streams
+\*============================================================================*/
+
+/* Compression formats of ASCII files. */
+typedef enum {
+  BRICKMASK_COMP_NONE = 0,
+  BRICKMASK_COMP_GZIP = 1,
+  BRICKMASK_COMP_ZSTD = 2
+} BRICKMASK_comp_t;
+
+/* Opaque structures for reading and writing streams. */
+typedef struct ISTREAM ISTREAM;
+typedef struct OSTREAM OSTREAM;
+
+/*============================================================================*\
+                  Interfaces for (compressed) file streams
+\*============================================================================*/
+
+/******************************************************************************
+Function `input_compression`:
+  Detect the compression format of a file, from the magic bytes.  Only
+  regular files are checked, as bytes of pipes cannot be read twice.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  The compression format; BRICKMASK_COMP_NONE if the file cannot be read.
+******************************************************************************/
+BRICKMASK_comp_t input_compression(const char *fname);
+
+/******************************************************************************
+Function `output_compression`:
+  Decide the compression format of a file to be written, from the suffix.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  The compression format.
+******************************************************************************/
+BRICKMASK_comp_t output_compression(const char *fname);
+
+/******************************************************************************
+Function `compression_supported`:
+  Check whether a compression format is enabled at compilation.
+Arguments:
+  * `comp`:     the compression format.
+Return:
+  True if the format is supported; false otherwise.
+******************************************************************************/
+bool compression_supported(const BRICKMASK_comp_t comp);
+
+/******************************************************************************
+Function `istream_open`:
+  Open a file for reading, with transparent decompression.
+Arguments:
+  * `fname`:    name of the file.
+Return:
+  Address of the stream on success; NULL on error.
+******************************************************************************/
+ISTREAM *istream_open(const char *fname);
+
+/******************************************************************************
+Function `istream_read`:
+  Read decompressed bytes from a stream.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      buffer for the bytes read;
+  * `num`:      maximum number of bytes to be read, up to INT_MAX.
+Return:
+  Number of bytes read; zero on end of file or error.
+******************************************************************************/
+size_t istream_read(ISTREAM *s, void *buf, const size_t num);
+
+/******************************************************************************
+Function `istream_error`:
+  Check whether an error occurred, or the stream ended unexpectedly.
+Arguments:
+  * `s`:        the stream.
+Return:
+  True on error; false otherwise.
+******************************************************************************/
+bool istream_error(const ISTREAM *s);
+
+/******************************************************************************
+Function `istream_close`:
+  Close a stream for reading.
+Arguments:
+  * `s`:        the stream.
+******************************************************************************/
+void istream_close(ISTREAM *s);
+
+/******************************************************************************
+Function `ostream_open`:
+  Open a file for writing, with the given compression format.
+Arguments:
+  * `fname`:    name of the file;
+  * `comp`:     compression format, see `output_compression`.
+Return:
+  Address of the stream on success; NULL on error.
+******************************************************************************/
+OSTREAM *ostream_open(const char *fname, const BRICKMASK_comp_t comp);
+
+/******************************************************************************
+Function `ostream_fdopen`:
+  Open an uncompressed stream for writing to a file descriptor.
+Arguments:
+  * `fd`:       the file descriptor, which is closed with the stream;
+  * `name`:     name of the stream for messages.
+Return:
+  Address of the stream on success; NULL on error.
+******************************************************************************/
+OSTREAM *ostream_fdopen(const int fd, const char *name);
+
+/******************************************************************************
+Function `stdout_detach`:
+  Reserve the standard output for data, by duplicating its file descriptor,
+  and redirecting messages printed to it to the standard error.
+Return:
+  The duplicated file descriptor on success; -1 on error.
+******************************************************************************/
+int stdout_detach(void);
+
+/******************************************************************************
+Function `ostream_write`:
+  Write bytes to a stream.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      the bytes to be written;
+  * `num`:      number of bytes to be written, up to INT_MAX.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_write(OSTREAM *s, const void *buf, const size_t num);
+
+/******************************************************************************
+Function `ostream_members`:
+  Check whether blocks of bytes can be compressed independently for a
+  stream, by `ostream_deflate`, which is the case for gzip streams.
+Arguments:
+  * `s`:        the stream.
+Return:
+  True if blocks can be compressed independently; false otherwise.
+******************************************************************************/
+bool ostream_members(const OSTREAM *s);
+
+/******************************************************************************
+Function `ostream_deflate`:
+  Compress a block of bytes as a complete gzip member, which does not alter
+  the stream, so blocks can be compressed by multiple threads at once.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      the bytes to be compressed;
+  * `num`:      number of bytes to be compressed, up to INT_MAX;
+  * `dst`:      address of the buffer for the member, enlarged if necessary;
+  * `dsize`:    size allocated for the buffer;
+  * `len`:      length of the compressed member.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_deflate(const OSTREAM *s, const void *buf, const size_t num,
+    void **dst, size_t *dsize, size_t *len);
+
+/******************************************************************************
+Function `ostream_write_member`:
+  Write a gzip member compressed by `ostream_deflate` to a stream, after
+  ending the member of bytes written by `ostream_write`, if any.
+Arguments:
+  * `s`:        the stream;
+  * `buf`:      the compressed member;
+  * `num`:      length of the member.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_write_member(OSTREAM *s, const void *buf, const size_t num);
+
+/******************************************************************************
+Function `ostream_close`:
+  Finish the compression and close a stream for writing.
+Arguments:
+  * `s`:        the stream.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ostream_close(OSTREAM *s);
+
+#endif
@@ -14,12 +14,16 @@
 #include "define.h"
 #include "assign_mask.h"
 #include "read_file.h"
+#include "checkpoint.h"
 #include <fitsio.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef OMP
+#include <omp.h>
+#endif
 #ifdef MPI
 #include <mpi.h>
 #define BRICKMASK_QUIT(status)  MPI_Abort(MPI_COMM_WORLD, status); exit(status);
@@ -74,26 +78,22 @@ static inline MASK *mask_init(uint32_t mnull) {
 
 /******************************************************************************
 Function `get_maskbit_fname`:
-  Find maskbit files containing a given brick name.
+  Get maskbit files of a given brick.
 Arguments:
   * `brick`:    structure for bricks;
-  * `bname`:    name of the brick to be found;
+  * `bid`:      index of the brick;
   * `fname`:    pointers to maskbit filenames that are found;
-  * `nsp`:      number of subsamples containing the brick name.
+  * `subid`:    subsample IDs of the maskbit files that are found;
+  * `nsp`:      number of subsamples containing the brick.
 ******************************************************************************/
-static void get_maskbit_fname(const BRICK *brick, const char *bname,
+static void get_maskbit_fname(const BRICK *brick, const size_t bid,
     char **fname, unsigned char *subid, int *nsp) {
   int n = 0;
+  const long *fidx = brick->fidx + bid * brick->nsp;
   for (int i = 0; i < brick->nsp; i++) {
-    for (size_t j = 0; j < brick->nmask[i]; j++) {
-      char *fcheck = brick->fmask[i][j];
-      if (!(*fcheck)) continue;         /* the file has been visited */
-      if (strstr(fcheck, bname)) {      /* the file is found */
-        if (brick->subid) subid[n] = brick->subid[i];
-        fname[n++] = fcheck;
-        break;                          /* stop searching this subsample */
-      }
-    }
+    if (fidx[i] < 0) continue;          /* no file for this subsample */
+    if (brick->subid) subid[n] = brick->subid[i];
+    fname[n++] = brick->fmask[i][fidx[i]];
   }
   *nsp = n;
 }
@@ -150,6 +150,38 @@ static inline int num_digit(size_t num) {
   return n;
 }
 
+/******************************************************************************
+Function `pack_mask`:
+  Narrow maskbits in place to the data type given by `mtype`.
+Arguments:
+  * `data`:     structure for the data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int pack_mask(DATA *data) {
+  /* Element `i` of the narrowed array never overlaps unread elements. */
+  switch (data->mtype) {
+    case TBYTE:
+      for (size_t i = 0; i < data->n; i++)
+        ((uint8_t *) data->mask)[i] = data->mask[i];
+      break;
+    case TSHORT:
+      for (size_t i = 0; i < data->n; i++)
+        ((uint16_t *) data->mask)[i] = data->mask[i];
+      break;
+    case TINT:
+      for (size_t i = 0; i < data->n; i++)
+        ((uint32_t *) data->mask)[i] = data->mask[i];
+      break;
+    case TLONG:
+      break;
+    default:
+      P_ERR("unexpected data type for maskbits: %d\n", data->mtype);
+      return BRICKMASK_ERR_MASK;
+  }
+  return 0;
+}
+
 
 /*============================================================================*\
                    Template functions for assigning maskbits
@@ -186,191 +218,311 @@ Return:
 
 
 /*============================================================================*\
-                        Interface for assigning maskbits
+                    Function for assigning maskbits to data
 \*============================================================================*/
 
 /******************************************************************************
-Function `assign_mask`:
-  Assign maskbits to the data catalogue.
+Function `assign_brick`:
+  Assign maskbits to the data sorted by bricks, and set the data type
+  required by the maskbits.  With OpenMP, bricks are processed by threads
+  with private maskbit buffers.  Results of finished bricks are appended to
+  the checkpoint file if `ckdir` is set.
 Arguments:
   * `brick`:    structure for bricks;
   * `data`:     structure for the data catalogue;
-  * `verbose`:  indicate whether to show detailed standard outputs.
+  * `ckdir`:    directory for checkpoint files, or NULL;
+  * `shard`:    index and number of shards, for naming checkpoint files;
+  * `resume`:   indicate whether to skip bricks finished by a previous run;
+  * `verbose`:  indicate whether to show the progress.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-int assign_mask(const BRICK *brick, DATA *data, const bool verbose) {
-#ifdef MPI
-  int size, rank;
-  size = rank = 0;
-  if (MPI_Comm_size(MPI_COMM_WORLD, &size) ||
-      MPI_Comm_rank(MPI_COMM_WORLD, &rank))
-    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
-
-  if (rank == BRICKMASK_MPI_ROOT) {
-#endif
-    printf("Assigning maskbits to the data ...");
-    if (verbose) printf("\n");
-    fflush(stdout);
-#ifdef MPI
+static int assign_brick(const BRICK *brick, DATA *data, const char *ckdir,
+    const int *shard, const bool resume, const bool verbose) {
+  /* Get the index ranges of data sharing the same bricks. */
+  size_t nrun = 1;
+  for (size_t i = 1; i < data->n; i++)
+    if (data->id[i] != data->id[i - 1]) nrun++;
+  size_t *run = malloc((nrun + 1) * sizeof(size_t));
+  if (!run) {
+    P_ERR("failed to allocate memory for index ranges of bricks\n");
+    return BRICKMASK_ERR_MEMORY;
   }
-#endif
+  run[0] = 0;
+  nrun = 1;
+  for (size_t i = 1; i < data->n; i++)
+    if (data->id[i] != data->id[i - 1]) run[nrun++] = i;
+  run[nrun] = data->n;
 
-  if (!brick || ! data) {
-    P_ERR("the bricks or input data catalogue is not initialised\n");
-    BRICKMASK_QUIT(BRICKMASK_ERR_INIT);
+  /* Load results of finished bricks from the checkpoint. */
+  bool has_null = false;
+  int dtype = 0;                        /* widest data type of maskbits */
+  size_t cnt = 0;
+  bool *done = NULL;
+  CKPT *ckpt = NULL;
+  if (ckdir) {
+    if (!(done = calloc(nrun, sizeof(bool)))) {
+      P_ERR("failed to allocate memory for the status of bricks\n");
+      free(run);
+      return BRICKMASK_ERR_MEMORY;
+    }
+    if (!(ckpt = ckpt_init(ckdir, shard[0], shard[1], resume, data, nrun,
+        run, done, &has_null, &dtype, &cnt))) {
+      free(run);
+      free(done);
+      return BRICKMASK_ERR_FILE;
+    }
   }
 
   /* Initialise progress printing. */
-  size_t cnt = 0;
   size_t next = data->nbrick / BRICKMASK_PROGRESS_NUM;
   if (!next) next = 1;
   size_t step = next;
   int ndg = num_digit(data->nbrick);
   int wcol = ndg * 2 + 3;               /* column width of the progress */
 
+  if (verbose) {
+    if (cnt) printf("  Bricks loaded from the checkpoint: %zu\n", cnt);
 #ifdef MPI
-  if (verbose && rank == BRICKMASK_MPI_ROOT) {
     printf("  Bricks processed by root task: %*zu / %zu",
         ndg, cnt, data->nbrick);
-    fflush(stdout);
-  }
 #else
-  if (verbose) {
     printf("  Bricks processed: %*zu / %zu", ndg, cnt, data->nbrick);
+#endif
     fflush(stdout);
   }
+
+#ifdef OMP
+  /* Maskbit files are read one at a time, unless CFITSIO is thread-safe. */
+  const bool reentrant = fits_is_reentrant();
 #endif
+  int err = 0;
 
-  if (!brick->n || !data->n) {
-#ifndef MPI
-    P_WRN("no brick or data is available\n");
-    printf(FMT_DONE);
+#ifdef OMP
+#pragma omp parallel reduction(||:has_null) reduction(max:dtype) \
+  reduction(|:err)
 #endif
-    return 0;
-  }
+  {
+    /* Pointers to maskbit filenames, subsample IDs, and maskbits. */
+    char **fname = malloc(brick->nsp * sizeof(char *));
+    unsigned char *subid = calloc(brick->nsp, sizeof(unsigned char));
+    MASK *mask = mask_init(brick->mnull);
+    int nsp = 0;
+    if (!fname || !subid || !mask) {
+      P_ERR("failed to allocate memory for reading maskbits\n");
+      err = 1;
+    }
 
-  /* Allocate memory for pointers to maskbit filenames, and subsample IDs. */
-  char **fname = malloc(brick->nsp * sizeof(char *));
-  if (!fname) {
-    P_ERR("failed to allocate memory for maskbit file pointers\n");
-    BRICKMASK_QUIT(BRICKMASK_ERR_MEMORY);
-  }
-  unsigned char *subid = calloc(brick->nsp, sizeof(unsigned char));
-  if (!subid) {
-    P_ERR("failed to allocate memory for subsample IDs\n");
-    free(fname);
-    BRICKMASK_QUIT(BRICKMASK_ERR_MEMORY);
-  }
-  int nsp = 0;
+    /* Read and assign maskbits. */
+#ifdef OMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (size_t r = 0; r < nrun; r++) {
+      if (err || (done && done[r])) continue;
+      const size_t imin = run[r];
+      const size_t imax = run[r + 1];
+      size_t bid = data->id[imin];      /* ID of the corresponding brick. */
+      int bdtype = 0;                   /* widest data type of the brick */
+
+      /* Get maskbit filenames corresponding to this brick. */
+      get_maskbit_fname(brick, bid, fname, subid, &nsp);
+      if (!nsp) {               /* no maskbit file for this object */
+        has_null = true;
+        for (size_t i = imin; i < imax; i++) data->mask[i] = mask->mnull;
+      }
 
-  /* Initialise maskbits. */
-  MASK *mask = mask_init(brick->mnull);
-  if (!mask) {
-    free(fname); free(subid);
-    BRICKMASK_QUIT(BRICKMASK_ERR_MEMORY);
-  }
+      for (int i = 0; i < nsp; i++) {
+        /* Check if the maskbit file exists. */
+        if (access(fname[i], R_OK)) {
+          P_WRN("cannot access maskbit file: `%s'\n", fname[i]);
+          continue;
+        }
 
-  /* Read and assign maskbits. */
-  bool has_null = false;
-  size_t imin, imax;
-  imin = 0;
-  while (imin < data->n) {
-    /* Get the index range of data sharing the same brick. */
-    for (imax = imin + 1; imax < data->n; imax++) {
-      if (data->id[imax] != data->id[imin]) break;
-    }
-    size_t bid = data->id[imin];        /* ID of the corresponding brick. */
-
-    /* Erase maskbit filenames for the previous brick. */
-    for (int i = 0; i < nsp; i++) fname[i][0] = '\0';
-    /* Get maskbit filenames corresponding to this brick. */
-    get_maskbit_fname(brick, brick->name[bid], fname, subid, &nsp);
-    if (!nsp) {                 /* no maskbit file for this object */
-      has_null = true;
-      for (size_t i = imin; i < imax; i++) data->mask[i] = mask->mnull;
-      imin = imax;
-#ifdef MPI
-      if (verbose && rank == BRICKMASK_MPI_ROOT)
+        /* Read maskbits for each subsample. */
+#ifdef OMP
+        int rerr;
+        if (reentrant) rerr = read_mask(fname[i], mask);
+        else {
+#pragma omp critical(brickmask_read_mask)
+          rerr = read_mask(fname[i], mask);
+        }
+        if (rerr) {
 #else
-      if (verbose)
+        if (read_mask(fname[i], mask)) {
 #endif
-      {
-        if (++cnt >= next) {
-          next += step;
-          printf("\x1B[%dD%*zu / %zu", wcol, ndg, cnt, data->nbrick);
-          fflush(stdout);
+          err = 1;
+          break;
         }
-      }
-      continue;
-    }
 
-    for (int i = 0; i < nsp; i++) {
-      /* Check if the maskbit file exists. */
-      if (access(fname[i], R_OK)) {
-        P_WRN("cannot access maskbit file: `%s'\n", fname[i]);
-        continue;
-      }
+        /* Choose the maskbit code assigning function given the data type. */
+        int (*assign_bitcode_func) (const MASK *, DATA *, const size_t,
+            const size_t, const uint8_t) = NULL;
+        switch (mask->dtype) {
+          case TBYTE:  assign_bitcode_func = assign_bitcode_uint8_t;  break;
+          case TSHORT: assign_bitcode_func = assign_bitcode_uint16_t; break;
+          case TINT:   assign_bitcode_func = assign_bitcode_uint32_t; break;
+          case TLONG:  assign_bitcode_func = assign_bitcode_uint64_t; break;
+          default:
+            P_ERR("unexpected data type for maskbits: %d\n", mask->dtype);
+            err = 1;
+        }
+        if (err) break;
+        if (bdtype < mask->dtype) bdtype = mask->dtype;
 
-      /* Read maskbits for each subsample. */
-      if (read_mask(fname[i], mask)) {
-        free(fname); free(subid); mask_destroy(mask);
-        BRICKMASK_QUIT(BRICKMASK_ERR_MASK);
+        /* Assign maskbits. */
+        if (assign_bitcode_func(mask, data, imin, imax, subid[i])) {
+          err = 1;
+          break;
+        }
       }
-
-      /* Choose the maskbit code assigning function given the data type. */
-      int (*assign_bitcode_func) (const MASK *, DATA *, const size_t,
-          const size_t, const uint8_t) = NULL;
-      switch (mask->dtype) {
-        case TBYTE:  assign_bitcode_func = assign_bitcode_uint8_t;  break;
-        case TSHORT: assign_bitcode_func = assign_bitcode_uint16_t; break;
-        case TINT:   assign_bitcode_func = assign_bitcode_uint32_t; break;
-        case TLONG:  assign_bitcode_func = assign_bitcode_uint64_t; break;
-        default:
-          P_ERR("unexpected data type for maskbits: %d\n", mask->dtype);
-          free(fname); free(subid); mask_destroy(mask);
-          BRICKMASK_QUIT(BRICKMASK_ERR_MASK);
+      if (err) continue;
+      if (dtype < bdtype) dtype = bdtype;
+
+      /* Save results of the brick. */
+      if (ckpt) {
+        int cerr;
+#ifdef OMP
+#pragma omp critical(brickmask_ckpt_save)
+#endif
+        cerr = ckpt_save(ckpt, data, imin, imax, bdtype, !nsp);
+        if (cerr) err = 1;
       }
 
-      /* Assign maskbits. */
-      if (assign_bitcode_func(mask, data, imin, imax, subid[i])) {
-        free(fname); free(subid); mask_destroy(mask);
-        BRICKMASK_QUIT(BRICKMASK_ERR_MASK);
+      /* Print the reading progress, only by the master thread. */
+      if (verbose) {
+        size_t num;
+#ifdef OMP
+#pragma omp atomic capture
+        num = ++cnt;
+        if (omp_get_thread_num() == 0 && num >= next) {
+#else
+        num = ++cnt;
+        if (num >= next) {
+#endif
+          next = num + step;
+          printf("\x1B[%dD%*zu / %zu", wcol, ndg, num, data->nbrick);
+          fflush(stdout);
+        }
       }
     }
-    imin = imax;
 
-    /* Print the reading progress. */
+    if (fname) free(fname);
+    if (subid) free(subid);
+    mask_destroy(mask);
+  }
+
+  free(run);
+  if (done) free(done);
+  ckpt_close(ckpt);
+  if (err) return BRICKMASK_ERR_MASK;
+  if (verbose) printf("\x1B[%dD%*zu / %zu\n", wcol, ndg, cnt, data->nbrick);
+
+  /* Keep the width required by `mnull` if no maskbit file is read. */
+  if (!has_null && dtype) data->mtype = dtype;
+  else if (data->mtype < dtype) data->mtype = dtype;
+  return 0;
+}
+
+
+/*============================================================================*\
+                       Interfaces for assigning maskbits
+\*============================================================================*/
+
+/******************************************************************************
+Function `assign_mask`:
+  Assign maskbits to the data catalogue.
+Arguments:
+  * `brick`:    structure for bricks;
+  * `data`:     structure for the data catalogue;
+  * `ckdir`:    directory for checkpoint files, or NULL;
+  * `shard`:    index and number of shards, for naming checkpoint files;
+  * `resume`:   indicate whether to skip bricks finished by a previous run;
+  * `verbose`:  indicate whether to show detailed standard outputs.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int assign_mask(const BRICK *brick, DATA *data, const char *ckdir,
+    const int *shard, const bool resume, const bool verbose) {
 #ifdef MPI
-    if (verbose && rank == BRICKMASK_MPI_ROOT)
-#else
-    if (verbose)
+  int size, rank;
+  size = rank = 0;
+  if (MPI_Comm_size(MPI_COMM_WORLD, &size) ||
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank))
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+
+  if (rank == BRICKMASK_MPI_ROOT) {
 #endif
-    {
-      if (++cnt >= next) {
-        next += step;
-        printf("\x1B[%dD%*zu / %zu", wcol, ndg, cnt, data->nbrick);
-        fflush(stdout);
-      }
-    }
+    printf("Assigning maskbits to the data ...");
+    if (verbose) printf("\n");
+    fflush(stdout);
+#ifdef MPI
   }
+#endif
 
+  if (!brick || ! data) {
+    P_ERR("the bricks or input data catalogue is not initialised\n");
+    BRICKMASK_QUIT(BRICKMASK_ERR_INIT);
+  }
+
+  if (!brick->n || !data->n) {
+#ifdef MPI
+    data->mtype = 0;                    /* do not widen maskbits of others */
+#else
+    P_WRN("no brick or data is available\n");
+    printf(FMT_DONE);
+    return 0;
+#endif
+  }
 #ifdef MPI
-  if (verbose && rank == BRICKMASK_MPI_ROOT)
+  else if (assign_brick(brick, data, ckdir, shard, resume,
+      verbose && rank == BRICKMASK_MPI_ROOT)) {
 #else
-  if (verbose)
+  else if (assign_brick(brick, data, ckdir, shard, resume, verbose)) {
 #endif
-    printf("\x1B[%dD%*zu / %zu\n", wcol, ndg, cnt, data->nbrick);
+    BRICKMASK_QUIT(BRICKMASK_ERR_MASK);
+  }
 
-  if (!has_null) data->mtype = mask->dtype;
-  else if (data->mtype < mask->dtype) data->mtype = mask->dtype;
+#ifdef MPI
+  /* Get the largest mask width of all tasks. */
+  if (MPI_Allreduce(MPI_IN_PLACE, &data->mtype, 1, MPI_INT, MPI_MAX,
+      MPI_COMM_WORLD)) {
+    P_ERR("failed to gather the data type of maskbits\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+  /* All tasks are empty, so only the null bit code is relevant. */
+  if (!data->mtype) data->mtype = mask_type(brick->mnull);
+#endif
+
+  /* Reduce the memory cost of maskbits for the subsequent steps. */
+  if (pack_mask(data)) {
+    BRICKMASK_QUIT(BRICKMASK_ERR_MASK);
+  }
 
-  free(fname);
-  free(subid);
-  mask_destroy(mask);
 #ifdef MPI
   if (rank == BRICKMASK_MPI_ROOT)
 #endif
   printf(FMT_DONE);
   return 0;
 }
+
+/******************************************************************************
+Function `assign_mask_chunk`:
+  Assign maskbits to a chunk of the data catalogue, and pack them to the
+  data type required by this chunk alone.
+Arguments:
+  * `brick`:    structure for bricks of the chunk;
+  * `data`:     structure for the data chunk.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int assign_mask_chunk(const BRICK *brick, DATA *data) {
+  if (!brick || !data) {
+    P_ERR("the bricks or input data chunk is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (brick->n && data->n) {
+    int err = assign_brick(brick, data, NULL, NULL, false, false);
+    if (err) return err;
+  }
+  return pack_mask(data);
+}
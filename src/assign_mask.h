@@ -61,7 +61,7 @@ typedef struct {
 
 
 /*============================================================================*\
-                        Interface for assigning maskbits
+                       Interfaces for assigning maskbits
 \*============================================================================*/
 
 /******************************************************************************
@@ -70,10 +70,26 @@ Function `assign_mask`:
 Arguments:
   * `brick`:    structure for bricks;
   * `data`:     structure for the data catalogue;
+  * `ckdir`:    directory for checkpoint files, or NULL;
+  * `shard`:    index and number of shards, for naming checkpoint files;
+  * `resume`:   indicate whether to skip bricks finished by a previous run;
   * `verbose`:  indicate whether to show detailed standard outputs.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-int assign_mask(const BRICK *brick, DATA *data, const bool verbose);
+int assign_mask(const BRICK *brick, DATA *data, const char *ckdir,
+    const int *shard, const bool resume, const bool verbose);
+
+/******************************************************************************
+Function `assign_mask_chunk`:
+  Assign maskbits to a chunk of the data catalogue, and pack them to the
+  data type required by this chunk alone.
+Arguments:
+  * `brick`:    structure for bricks of the chunk;
+  * `data`:     structure for the data chunk.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int assign_mask_chunk(const BRICK *brick, DATA *data);
 
 #endif
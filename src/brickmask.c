@@ -18,6 +18,9 @@
 #include "sort_data.h"
 #include "assign_mask.h"
 #include "save_file.h"
+#include "checkpoint.h"
+#include "shard.h"
+#include "stdio_stream.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -31,10 +34,23 @@
 
 int main(int argc, char *argv[]) {
 #ifdef MPI
+#ifdef OMP
+  /* Only the master thread makes MPI calls. */
+  int provided = 0;
+  if (MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided)) {
+    P_EXT("failed to initialise MPI\n");
+    return BRICKMASK_ERR_MPI;
+  }
+  if (provided < MPI_THREAD_FUNNELED) {
+    P_EXT("the MPI library does not support threads\n");
+    BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
+  }
+#else
   if (MPI_Init(NULL, NULL)) {
     P_EXT("failed to initialise MPI\n");
     return BRICKMASK_ERR_MPI;
   }
+#endif
   int rank;
   if (MPI_Comm_rank(MPI_COMM_WORLD, &rank)) {
     P_ERR("failed to obtain MPI ranks\n");
@@ -43,6 +59,11 @@ int main(int argc, char *argv[]) {
 #endif
 
   bool verbose = false;
+  bool merge = false;
+  bool resume = false;
+  bool stdio = false;
+  char *ckdir = NULL;
+  int shard[2] = {0, 0};        /* index and number of shards */
   CONF *conf = NULL;
   BRICK *brick = NULL;
   DATA *data = NULL;
@@ -78,75 +99,197 @@ int main(int argc, char *argv[]) {
       P_EXT("failed to load configuration parameters\n");
       BRICKMASK_QUIT(BRICKMASK_ERR_CFG);
     }
-    else verbose = conf->verbose;
+    else {
+      verbose = conf->verbose;
+      merge = conf->merge;
+      resume = conf->resume;
+      stdio = conf->stdio;
+      ckdir = (merge) ? NULL : conf->ckdir;
+      shard[0] = conf->ishard;
+      shard[1] = conf->nshard;
+    }
 
-    if (!(brick = get_brick(conf))) {
+    /* Merge results of shards, without processing bricks. */
+    if (merge) {
+      if (!(data = read_data(conf, NULL, NULL))) {
+        printf(FMT_FAIL);
+        P_EXT("failed to read the input data catalogs\n");
+        conf_destroy(conf);
+        BRICKMASK_QUIT(BRICKMASK_ERR_FILE);
+      }
+
+      if (merge_shard(conf->shdir, data, verbose)) {
+        printf(FMT_FAIL);
+        P_EXT("failed to merge results of shards\n");
+        conf_destroy(conf); data_destroy(data);
+        BRICKMASK_QUIT(BRICKMASK_ERR_FILE);
+      }
+    }
+    else if (!(brick = get_brick(conf))) {
       printf(FMT_FAIL);
       P_EXT("failed to get information of the bricks\n");
       conf_destroy(conf);
       BRICKMASK_QUIT(BRICKMASK_ERR_BRICK);
     }
 
-    if (!(data = read_data(conf))) {
-      printf(FMT_FAIL);
-      P_EXT("failed to read the input data catalogs\n");
-      conf_destroy(conf); brick_destroy(brick);
-      BRICKMASK_QUIT(BRICKMASK_ERR_FILE);
-    }
-
-    if (sort_data(brick, data, verbose)) {
-      printf(FMT_FAIL);
-      P_EXT("failed to sort the input data\n");
-      conf_destroy(conf); brick_destroy(brick); data_destroy(data);
-      BRICKMASK_QUIT(BRICKMASK_ERR_BRICK);
-    }
 #ifdef MPI
   }
 
-  /* Broadcast verbose. */
-  if (MPI_Bcast(&verbose, 1, MPI_C_BOOL, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
+  /* Broadcast verbose, and check whether to stream data to workers, to
+     merge shards, or to filter the standard input on the root task. */
+  int size = 0;
+  bool stream = (rank == BRICKMASK_MPI_ROOT && conf->nchunk) ? true : false;
+  if (MPI_Comm_size(MPI_COMM_WORLD, &size) ||
+      MPI_Bcast(&verbose, 1, MPI_C_BOOL, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD) ||
+      MPI_Bcast(&stream, 1, MPI_C_BOOL, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD) ||
+      MPI_Bcast(&merge, 1, MPI_C_BOOL, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD) ||
+      MPI_Bcast(&stdio, 1, MPI_C_BOOL, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
     P_ERR("failed to communicate between MPI tasks\n");
     BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
   }
-  mpi_init_worker(&brick, &data, verbose);
 #endif
 
-  if (assign_mask(brick, data, verbose)) {
-    printf(FMT_FAIL);
-    P_EXT("failed to assign maskbits to the data\n");
-    conf_destroy(conf); brick_destroy(brick); data_destroy(data);
-    BRICKMASK_QUIT(BRICKMASK_ERR_MASK);
+  /* Objects from the standard input are processed by a single task. */
+  if (stdio) {
+#ifdef MPI
+    if (rank == BRICKMASK_MPI_ROOT) {
+#endif
+      if (stdio_stream(conf, brick)) {
+        printf(FMT_FAIL);
+        P_EXT("failed to process objects from the standard input\n");
+        conf_destroy(conf); brick_destroy(brick);
+        BRICKMASK_QUIT(BRICKMASK_ERR_FILE);
+      }
+      conf_destroy(conf); brick_destroy(brick);
+#ifdef MPI
+    }
+    if (MPI_Finalize()) {
+      P_ERR("failed to finalize MPI tasks\n");
+      BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
+    }
+#endif
+    return 0;
   }
 
 #ifdef MPI
-  if (MPI_Barrier(MPI_COMM_WORLD)) {
-    P_ERR("failed to set MPI barrier\n");
-    BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
+  if (size < 2) stream = false;
+
+  /* Share checkpoint settings, which are not used for streamed data. */
+  if (!stream) {
+    if (MPI_Bcast(&resume, 1, MPI_C_BOOL, BRICKMASK_MPI_ROOT,
+        MPI_COMM_WORLD) || MPI_Bcast(shard, 2, MPI_INT, BRICKMASK_MPI_ROOT,
+        MPI_COMM_WORLD)) {
+      P_ERR("failed to communicate between MPI tasks\n");
+      BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
+    }
+    mpi_bcast_str(&ckdir);
+  }
+  else ckdir = NULL;
+
+  if (stream) {
+    data = mpi_stream_data(conf, brick);
+    if (rank != BRICKMASK_MPI_ROOT) {
+      if (MPI_Finalize()) {
+        P_ERR("failed to finalize MPI tasks\n");
+        BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
+      }
+      return 0;
+    }
+  }
+  else if (!merge) {
+    if (rank == BRICKMASK_MPI_ROOT) {
+#else
+  if (!merge) {
+#endif
+      if (!(data = read_data(conf, NULL, NULL))) {
+        printf(FMT_FAIL);
+        P_EXT("failed to read the input data catalogs\n");
+        conf_destroy(conf); brick_destroy(brick);
+        BRICKMASK_QUIT(BRICKMASK_ERR_FILE);
+      }
+
+      /* Shards process only objects in their own bricks. */
+      if ((conf->nshard) ?
+          sort_shard(brick, data, conf->ishard, conf->nshard, verbose) :
+          sort_data(brick, data, verbose)) {
+        printf(FMT_FAIL);
+        P_EXT("failed to sort the input data\n");
+        conf_destroy(conf); brick_destroy(brick); data_destroy(data);
+        BRICKMASK_QUIT(BRICKMASK_ERR_BRICK);
+      }
+#ifdef MPI
+    }
+    mpi_init_worker(&brick, &data, verbose);
+#endif
+
+    if (assign_mask(brick, data, ckdir, shard, resume, verbose)) {
+      printf(FMT_FAIL);
+      P_EXT("failed to assign maskbits to the data\n");
+      conf_destroy(conf); brick_destroy(brick); data_destroy(data);
+      BRICKMASK_QUIT(BRICKMASK_ERR_MASK);
+    }
+
+#ifdef MPI
+    if (MPI_Barrier(MPI_COMM_WORLD)) {
+      P_ERR("failed to set MPI barrier\n");
+      BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
+    }
+    mpi_gather_data(brick, data);
   }
-  mpi_gather_data(brick, data);
 
   if (rank == BRICKMASK_MPI_ROOT) {
+#else
+  }
 #endif
     brick_destroy(brick);
 
-    if (reorder_data(data)) {
-      printf(FMT_FAIL);
-      P_EXT("failed to restore the order of the input data\n");
-      conf_destroy(conf); data_destroy(data);
-      BRICKMASK_QUIT(BRICKMASK_ERR_MEMORY);
+    /* Results of a shard are saved in the sorted order. */
+    if (conf->nshard) {
+      if (save_shard(conf->shdir, conf->ishard, conf->nshard, data)) {
+        printf(FMT_FAIL);
+        P_EXT("failed to save results of the shard\n");
+        conf_destroy(conf); data_destroy(data);
+        BRICKMASK_QUIT(BRICKMASK_ERR_SAVE);
+      }
+      data_destroy(data);
     }
+    else {
+      /* Streamed or merged data is already in the original order. */
+#ifdef MPI
+      if (!stream && !merge && reorder_data(data)) {
+#else
+      if (!merge && reorder_data(data)) {
+#endif
+        printf(FMT_FAIL);
+        P_EXT("failed to restore the order of the input data\n");
+        conf_destroy(conf); data_destroy(data);
+        BRICKMASK_QUIT(BRICKMASK_ERR_MEMORY);
+      }
 
-    if (save_data(conf, data)) {
-      printf(FMT_FAIL);
-      P_EXT("failed to save the output data catalogs\n");
-      conf_destroy(conf); data_destroy(data);
-      BRICKMASK_QUIT(BRICKMASK_ERR_SAVE);
+      if (save_data(conf, data)) {
+        printf(FMT_FAIL);
+        P_EXT("failed to save the output data catalogs\n");
+        conf_destroy(conf); data_destroy(data);
+        BRICKMASK_QUIT(BRICKMASK_ERR_SAVE);
+      }
     }
 
+    /* Results are saved, so checkpoints are no longer needed. */
+    ckpt_remove(ckdir, shard[0], shard[1]);
     conf_destroy(conf);
 #ifdef MPI
   }
 
+  /* Workers remove checkpoints only after the root task saves results. */
+  if (!stream && MPI_Barrier(MPI_COMM_WORLD)) {
+    P_ERR("failed to set MPI barrier\n");
+    BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
+  }
+  if (rank != BRICKMASK_MPI_ROOT && ckdir) {
+    ckpt_remove(ckdir, shard[0], shard[1]);
+    free(ckdir);
+  }
+
   if (MPI_Finalize()) {
     P_ERR("failed to finalize MPI tasks\n");
     BRICKMASK_QUIT(BRICKMASK_ERR_MPI);
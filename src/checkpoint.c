@@ -0,0 +1,394 @@
+/*******************************************************************************
+* checkpoint.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L
+#include "define.h"
+#include "checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef MPI
+#include <mpi.h>
+#endif
+
+/*============================================================================*\
+  Format of checkpoint files (native byte order):
+  * header: BRICKMASK_CKPT_MAGIC, number of MPI tasks (int32), rank (int32),
+            number of shards (int32), index of the shard (int32),
+            number of objects (uint64), number of bricks (uint64),
+            flag for subsample IDs (uint8);
+  * records for finished bricks: starting index (uint64), number of objects
+            (uint64), hash of the coordinates (uint64), widest data type of
+            maskbits (int32), flag for no maskbit file (int32), followed by
+            the maskbits (uint64) and optionally subsample IDs (uint8).
+\*============================================================================*/
+
+#define CKPT_MAGIC_LEN  (sizeof(BRICKMASK_CKPT_MAGIC) - 1)
+
+/*============================================================================*\
+                     Functions for processing checkpoints
+\*============================================================================*/
+
+/******************************************************************************
+Function `ckpt_fname`:
+  Construct the name of the checkpoint file of the current task, which is
+  tagged by the shard if applicable, so that shards sharing the directory
+  do not overwrite checkpoints of each other.
+Arguments:
+  * `dir`:      directory for checkpoint files;
+  * `ishard`:   index of the shard;
+  * `nshard`:   number of shards, 0 for no sharding;
+  * `size`:     number of MPI tasks;
+  * `rank`:     ID of the current task.
+Return:
+  The filename on success; NULL on error.
+******************************************************************************/
+static char *ckpt_fname(const char *dir, const int ishard, const int nshard,
+    int *size, int *rank) {
+  *size = 1;
+  *rank = 0;
+#ifdef MPI
+  if (MPI_Comm_size(MPI_COMM_WORLD, size) ||
+      MPI_Comm_rank(MPI_COMM_WORLD, rank)) {
+    P_ERR("failed to retrieve MPI ranks\n");
+    return NULL;
+  }
+#endif
+  size_t len = strlen(dir) + strlen(BRICKMASK_CKPT_FNAME) + 40;
+  char *fname = malloc(len * sizeof(char));
+  if (!fname) {
+    P_ERR("failed to allocate memory for the checkpoint filename\n");
+    return NULL;
+  }
+  int n = snprintf(fname, len, "%s%c" BRICKMASK_CKPT_FNAME, dir,
+      BRICKMASK_PATH_SEP);
+  if (nshard) n += snprintf(fname + n, len - n, ".%dof%d", ishard, nshard);
+#ifdef MPI
+  snprintf(fname + n, len - n, ".%d", *rank);
+#endif
+  return fname;
+}
+
+/******************************************************************************
+Function `ckpt_hash`:
+  Compute the FNV-1a hash of coordinates, for identifying bricks.
+Arguments:
+  * `data`:     structure for the data catalogue;
+  * `imin`:     starting index of the data;
+  * `imax`:     ending index of the data.
+Return:
+  The hash value.
+******************************************************************************/
+static uint64_t ckpt_hash(const DATA *data, const size_t imin,
+    const size_t imax) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  const unsigned char *c[2];
+  c[0] = (const unsigned char *) (data->ra + imin);
+  c[1] = (const unsigned char *) (data->dec + imin);
+  const size_t len = (imax - imin) * sizeof(double);
+  for (int k = 0; k < 2; k++) {
+    for (size_t i = 0; i < len; i++) {
+      h ^= c[k][i];
+      h *= 0x100000001b3ULL;
+    }
+  }
+  return h;
+}
+
+/******************************************************************************
+Function `ckpt_write_head`:
+  Write the header of a checkpoint file.
+Arguments:
+  * `ckpt`:     structure for the checkpoint;
+  * `size`:     number of MPI tasks;
+  * `rank`:     ID of the current task;
+  * `shard`:    number of shards and index of the shard;
+  * `n`:        number of objects;
+  * `nrun`:     number of bricks.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int ckpt_write_head(CKPT *ckpt, const int32_t size, const int32_t rank,
+    const int32_t *shard, const uint64_t n, const uint64_t nrun) {
+  const uint8_t subid = ckpt->subid;
+  if (fwrite(BRICKMASK_CKPT_MAGIC, CKPT_MAGIC_LEN, 1, ckpt->fp) != 1 ||
+      fwrite(&size, sizeof(int32_t), 1, ckpt->fp) != 1 ||
+      fwrite(&rank, sizeof(int32_t), 1, ckpt->fp) != 1 ||
+      fwrite(shard, sizeof(int32_t), 2, ckpt->fp) != 2 ||
+      fwrite(&n, sizeof(uint64_t), 1, ckpt->fp) != 1 ||
+      fwrite(&nrun, sizeof(uint64_t), 1, ckpt->fp) != 1 ||
+      fwrite(&subid, sizeof(uint8_t), 1, ckpt->fp) != 1 ||
+      fflush(ckpt->fp)) {
+    P_ERR("failed to write to the checkpoint file: `%s'\n", ckpt->fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `ckpt_check_head`:
+  Check whether the header of a checkpoint file matches the current task.
+Arguments:
+  * `ckpt`:     structure for the checkpoint;
+  * `size`:     number of MPI tasks;
+  * `rank`:     ID of the current task;
+  * `shard`:    number of shards and index of the shard;
+  * `n`:        number of objects;
+  * `nrun`:     number of bricks.
+Return:
+  True if the header matches; false otherwise.
+******************************************************************************/
+static bool ckpt_check_head(CKPT *ckpt, const int32_t size,
+    const int32_t rank, const int32_t *shard, const uint64_t n,
+    const uint64_t nrun) {
+  char magic[CKPT_MAGIC_LEN];
+  int32_t fsize, frank, fshard[2];
+  uint64_t fn, fnrun;
+  uint8_t subid;
+  if (fread(magic, CKPT_MAGIC_LEN, 1, ckpt->fp) != 1 ||
+      fread(&fsize, sizeof(int32_t), 1, ckpt->fp) != 1 ||
+      fread(&frank, sizeof(int32_t), 1, ckpt->fp) != 1 ||
+      fread(fshard, sizeof(int32_t), 2, ckpt->fp) != 2 ||
+      fread(&fn, sizeof(uint64_t), 1, ckpt->fp) != 1 ||
+      fread(&fnrun, sizeof(uint64_t), 1, ckpt->fp) != 1 ||
+      fread(&subid, sizeof(uint8_t), 1, ckpt->fp) != 1) return false;
+  if (memcmp(magic, BRICKMASK_CKPT_MAGIC, CKPT_MAGIC_LEN) ||
+      fsize != size || frank != rank || fshard[0] != shard[0] ||
+      fshard[1] != shard[1] || fn != n || fnrun != nrun ||
+      (bool) subid != ckpt->subid) return false;
+  return true;
+}
+
+/******************************************************************************
+Function `ckpt_load`:
+  Load results of finished bricks from the checkpoint file, and truncate
+  incomplete records at the end of the file.
+Arguments:
+  * `ckpt`:     structure for the checkpoint;
+  * `data`:     structure for the data catalogue, sorted by bricks;
+  * `nrun`:     number of bricks for the data;
+  * `run`:      starting indices of data for each brick, and the total number;
+  * `done`:     indicate whether each brick is finished;
+  * `has_null`: indicate whether there are objects outside maskbit bricks;
+  * `dtype`:    the widest data type of maskbits that are loaded;
+  * `nload`:    number of bricks that are loaded.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int ckpt_load(CKPT *ckpt, DATA *data, const size_t nrun,
+    const size_t *run, bool *done, bool *has_null, int *dtype,
+    size_t *nload) {
+  long pos = ftell(ckpt->fp);
+  for (;;) {
+    uint64_t imin, num, hash;
+    int32_t bdtype, null;
+    if (fread(&imin, sizeof(uint64_t), 1, ckpt->fp) != 1 ||
+        fread(&num, sizeof(uint64_t), 1, ckpt->fp) != 1 ||
+        fread(&hash, sizeof(uint64_t), 1, ckpt->fp) != 1 ||
+        fread(&bdtype, sizeof(int32_t), 1, ckpt->fp) != 1 ||
+        fread(&null, sizeof(int32_t), 1, ckpt->fp) != 1) break;
+
+    /* Find the brick with binary search. */
+    size_t l = 0;
+    size_t u = nrun;
+    while (l < u) {
+      size_t m = l + (u - l) / 2;
+      if (run[m] < imin) l = m + 1;
+      else u = m;
+    }
+    if (l >= nrun || run[l] != imin || run[l + 1] - run[l] != num ||
+        ckpt_hash(data, run[l], run[l + 1]) != hash) {
+      P_WRN("inconsistent record in the checkpoint file: `%s'\n"
+          "results after this record are discarded\n", ckpt->fname);
+      break;
+    }
+
+    if (fread(data->mask + imin, sizeof(uint64_t), num, ckpt->fp) != num ||
+        (ckpt->subid && fread(data->subid + imin, sizeof(unsigned char), num,
+        ckpt->fp) != num)) break;
+
+    if (!done[l]) {
+      done[l] = true;
+      *nload += 1;
+    }
+    if (null) *has_null = true;
+    if (*dtype < bdtype) *dtype = bdtype;
+    pos = ftell(ckpt->fp);
+  }
+
+  /* Remove incomplete or inconsistent records. */
+  if (fflush(ckpt->fp) || ftruncate(fileno(ckpt->fp), pos) ||
+      fseek(ckpt->fp, pos, SEEK_SET)) {
+    P_ERR("failed to truncate the checkpoint file: `%s'\n", ckpt->fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+
+/*============================================================================*\
+                         Interfaces for checkpoints
+\*============================================================================*/
+
+/******************************************************************************
+Function `ckpt_init`:
+  Open the checkpoint file of the current task, and load results of bricks
+  that are finished by a previous run if applicable.
+Arguments:
+  * `dir`:      directory for checkpoint files;
+  * `ishard`:   index of the shard;
+  * `nshard`:   number of shards, 0 for no sharding;
+  * `resume`:   indicate whether to load existing results;
+  * `data`:     structure for the data catalogue, sorted by bricks;
+  * `nrun`:     number of bricks for the data;
+  * `run`:      starting indices of data for each brick, and the total number;
+  * `done`:     indicate whether each brick is finished;
+  * `has_null`: indicate whether there are objects outside maskbit bricks;
+  * `dtype`:    the widest data type of maskbits that are loaded;
+  * `nload`:    number of bricks that are loaded.
+Return:
+  Address of the structure for the checkpoint on success; NULL on error.
+******************************************************************************/
+CKPT *ckpt_init(const char *dir, const int ishard, const int nshard,
+    const bool resume, DATA *data, const size_t nrun, const size_t *run,
+    bool *done, bool *has_null, int *dtype, size_t *nload) {
+  if (!dir || !data || !run || !done) {
+    P_ERR("the checkpoint is not initialised\n");
+    return NULL;
+  }
+  *nload = 0;
+
+  CKPT *ckpt = malloc(sizeof(CKPT));
+  if (!ckpt) {
+    P_ERR("failed to allocate memory for the checkpoint\n");
+    return NULL;
+  }
+  ckpt->fp = NULL;
+  ckpt->subid = data->subid ? true : false;
+  ckpt->last = time(NULL);
+
+  int size, rank;
+  const int32_t shard[2] = {nshard, ishard};
+  if (!(ckpt->fname = ckpt_fname(dir, ishard, nshard, &size, &rank))) {
+    free(ckpt);
+    return NULL;
+  }
+
+  /* Load results from the existing checkpoint file. */
+  if (resume && !access(ckpt->fname, F_OK)) {
+    if (!(ckpt->fp = fopen(ckpt->fname, "r+b"))) {
+      P_ERR("cannot open the checkpoint file: `%s'\n", ckpt->fname);
+      ckpt_close(ckpt);
+      return NULL;
+    }
+    if (ckpt_check_head(ckpt, size, rank, shard, data->n, nrun)) {
+      if (ckpt_load(ckpt, data, nrun, run, done, has_null, dtype, nload)) {
+        ckpt_close(ckpt);
+        return NULL;
+      }
+      return ckpt;
+    }
+    P_WRN("the checkpoint file does not match the current run: `%s'\n"
+        "all bricks are to be processed\n", ckpt->fname);
+    fclose(ckpt->fp);
+    ckpt->fp = NULL;
+  }
+  else if (resume) {
+    P_WRN("cannot access the checkpoint file: `%s'\n"
+        "all bricks are to be processed\n", ckpt->fname);
+  }
+
+  /* Start a new checkpoint file. */
+  if (!(ckpt->fp = fopen(ckpt->fname, "wb"))) {
+    P_ERR("cannot write to the checkpoint file: `%s'\n", ckpt->fname);
+    ckpt_close(ckpt);
+    return NULL;
+  }
+  if (ckpt_write_head(ckpt, size, rank, shard, data->n, nrun)) {
+    ckpt_close(ckpt);
+    return NULL;
+  }
+  return ckpt;
+}
+
+/******************************************************************************
+Function `ckpt_save`:
+  Append results of a finished brick to the checkpoint file.
+Arguments:
+  * `ckpt`:     structure for the checkpoint;
+  * `data`:     structure for the data catalogue;
+  * `imin`:     starting index of data in the brick;
+  * `imax`:     ending index of data in the brick;
+  * `dtype`:    the widest data type of maskbits read for the brick;
+  * `null`:     indicate whether the brick has no maskbit file.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ckpt_save(CKPT *ckpt, const DATA *data, const size_t imin,
+    const size_t imax, const int dtype, const bool null) {
+  const uint64_t head[3] = {imin, imax - imin, ckpt_hash(data, imin, imax)};
+  const int32_t flag[2] = {dtype, null};
+  const size_t num = imax - imin;
+  if (fwrite(head, sizeof(uint64_t), 3, ckpt->fp) != 3 ||
+      fwrite(flag, sizeof(int32_t), 2, ckpt->fp) != 2 ||
+      fwrite(data->mask + imin, sizeof(uint64_t), num, ckpt->fp) != num ||
+      (ckpt->subid && fwrite(data->subid + imin, sizeof(unsigned char), num,
+      ckpt->fp) != num)) {
+    P_ERR("failed to write to the checkpoint file: `%s'\n", ckpt->fname);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* Flush results periodically, to limit the cost of file operations. */
+  time_t now = time(NULL);
+  if (difftime(now, ckpt->last) >= BRICKMASK_CKPT_INTERVAL) {
+    if (fflush(ckpt->fp) || fsync(fileno(ckpt->fp))) {
+      P_ERR("failed to flush the checkpoint file: `%s'\n", ckpt->fname);
+      return BRICKMASK_ERR_FILE;
+    }
+    ckpt->last = now;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `ckpt_close`:
+  Flush and close the checkpoint file.
+Arguments:
+  * `ckpt`:     structure for the checkpoint.
+******************************************************************************/
+void ckpt_close(CKPT *ckpt) {
+  if (!ckpt) return;
+  if (ckpt->fp && fclose(ckpt->fp))
+    P_WRN("failed to close the checkpoint file: `%s'\n", ckpt->fname);
+  if (ckpt->fname) free(ckpt->fname);
+  free(ckpt);
+}
+
+/******************************************************************************
+Function `ckpt_remove`:
+  Remove the checkpoint file of the current task, if it exists.
+Arguments:
+  * `dir`:      directory for checkpoint files;
+  * `ishard`:   index of the shard;
+  * `nshard`:   number of shards, 0 for no sharding.
+******************************************************************************/
+void ckpt_remove(const char *dir, const int ishard, const int nshard) {
+  if (!dir) return;
+  int size, rank;
+  char *fname = ckpt_fname(dir, ishard, nshard, &size, &rank);
+  if (!fname) return;
+  if (remove(fname) && errno != ENOENT)
+    P_WRN("failed to remove the checkpoint file: `%s'\n", fname);
+  free(fname);
+}
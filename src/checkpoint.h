@@ -0,0 +1,115 @@
+/*******************************************************************************
+* checkpoint.h: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+*******************************************************************************/
+
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include "data_io.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*============================================================================*\
+                        Data structure for checkpoints
+\*============================================================================*/
+
+/* Data structure for the checkpoint file of a task. */
+typedef struct {
+  char *fname;          /* name of the checkpoint file                  */
+  FILE *fp;             /* pointer to the opened checkpoint file        */
+  bool subid;           /* indicate whether subsample IDs are saved     */
+  time_t last;          /* time of the last flush                       */
+} CKPT;
+
+
+/*============================================================================*\
+                         Interfaces for checkpoints
+\*============================================================================*/
+
+/******************************************************************************
+Function `ckpt_init`:
+  Open the checkpoint file of the current task, and load results of bricks
+  that are finished by a previous run if applicable.
+Arguments:
+  * `dir`:      directory for checkpoint files;
+  * `ishard`:   index of the shard;
+  * `nshard`:   number of shards, 0 for no sharding;
+  * `resume`:   indicate whether to load existing results;
+  * `data`:     structure for the data catalogue, sorted by bricks;
+  * `nrun`:     number of bricks for the data;
+  * `run`:      starting indices of data for each brick, and the total number;
+  * `done`:     indicate whether each brick is finished;
+  * `has_null`: indicate whether there are objects outside maskbit bricks;
+  * `dtype`:    the widest data type of maskbits that are loaded;
+  * `nload`:    number of bricks that are loaded.
+Return:
+  Address of the structure for the checkpoint on success; NULL on error.
+******************************************************************************/
+CKPT *ckpt_init(const char *dir, const int ishard, const int nshard,
+    const bool resume, DATA *data, const size_t nrun, const size_t *run,
+    bool *done, bool *has_null, int *dtype, size_t *nload);
+
+/******************************************************************************
+Function `ckpt_save`:
+  Append results of a finished brick to the checkpoint file.
+Arguments:
+  * `ckpt`:     structure for the checkpoint;
+  * `data`:     structure for the data catalogue;
+  * `imin`:     starting index of data in the brick;
+  * `imax`:     ending index of data in the brick;
+  * `dtype`:    the widest data type of maskbits read for the brick;
+  * `null`:     indicate whether the brick has no maskbit file.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int ckpt_save(CKPT *ckpt, const DATA *data, const size_t imin,
+    const size_t imax, const int dtype, const bool null);
+
+/******************************************************************************
+Function `ckpt_close`:
+  Flush and close the checkpoint file.
+Arguments:
+  * `ckpt`:     structure for the checkpoint.
+******************************************************************************/
+void ckpt_close(CKPT *ckpt);
+
+/******************************************************************************
+Function `ckpt_remove`:
+  Remove the checkpoint file of the current task, if it exists.
+Arguments:
+  * `dir`:      directory for checkpoint files;
+  * `ishard`:   index of the shard;
+  * `nshard`:   number of shards, 0 for no sharding.
+******************************************************************************/
+void ckpt_remove(const char *dir, const int ishard, const int nshard);
+
+#endif
@@ -11,6 +11,7 @@
 
 *******************************************************************************/
 
+#define _POSIX_C_SOURCE 200809L
 #include "define.h"
 #include "data_io.h"
 #include "read_file.h"
@@ -18,6 +19,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <fitsio.h>
 
 /*============================================================================*\
@@ -32,7 +36,7 @@ Arguments:
 Return:
   Address of the structure for the input catalogue on success; NULL on error.
 ******************************************************************************/
-static DATA *data_init(const CONF *conf) {
+DATA *data_init(const CONF *conf) {
   DATA *data = calloc(1, sizeof(DATA));
   if (!data) {
     P_ERR("failed to allocate memory for the input data catalog\n");
@@ -46,6 +50,13 @@ static DATA *data_init(const CONF *conf) {
   data->mask = NULL;
   data->subid = NULL;
   data->content = NULL;
+  data->fmap = NULL;
+  data->fsize = NULL;
+  data->sel = NULL;
+  data->rows = NULL;
+  data->rmem = NULL;
+  data->nspan = 0;
+  data->ncat = conf->ncat;
 
   if (!(data->iidx = calloc(conf->ncat + 1, sizeof(size_t)))) {
     P_ERR("failed to allocate memory for the input data catalog\n");
@@ -54,36 +65,359 @@ static DATA *data_init(const CONF *conf) {
   }
   if (data->fmt == BRICKMASK_FFMT_ASCII) {
     data->nmax = BRICKMASK_DATA_INIT_NUM;
-    data->cmax = BRICKMASK_CONTENT_INIT_SIZE;
+    /* Mapped files are referred to by spans of the output columns. */
+    if (conf->amap) {
+      data->nspan = (conf->ncol) ? conf->ncol : 1;
+      if (!(data->fmap = calloc(conf->ncat, sizeof(char *))) ||
+          !(data->fsize = calloc(conf->ncat, sizeof(size_t)))) {
+        P_ERR("failed to allocate memory for the input data catalog\n");
+        data_destroy(data);
+        return NULL;
+      }
+    }
+    /* Columns are not kept if only maskbits are saved. */
+    else if (!conf->monly) {
+      data->cmax = BRICKMASK_CONTENT_INIT_SIZE;
+      if (!(data->content = malloc(data->cmax))) {
+        P_ERR("failed to allocate memory for the input data catalog\n");
+        data_destroy(data);
+        return NULL;
+      }
+    }
     if (!(data->ra = malloc(data->nmax * sizeof(double))) ||
         !(data->dec = malloc(data->nmax * sizeof(double))) ||
-        !(data->cidx = malloc(data->nmax * sizeof(size_t))) ||
-        !(data->content = malloc(data->cmax))) {
+        !(data->cidx = malloc(data->nmax * CIDX_PER_OBJECT(data) *
+        sizeof(size_t)))) {
+      P_ERR("failed to allocate memory for the input data catalog\n");
+      data_destroy(data);
+      return NULL;
+    }
+  }
+  else if (conf->sel) {
+    /* Row flags are needed for writing only the selected rows. */
+    if (!(data->sel = calloc(conf->ncat, sizeof(char *)))) {
       P_ERR("failed to allocate memory for the input data catalog\n");
       data_destroy(data);
       return NULL;
     }
   }
 
+  /* Rows of FITS tables are cached only if they are saved afterwards. */
+  if (data->fmt == BRICKMASK_FFMT_FITS && conf->rcache > 0 && !conf->nshard &&
+      !conf->monly) {
+    if (!(data->rows = calloc(conf->ncat, sizeof(unsigned char *))) ||
+        !(data->rmem = malloc(sizeof(size_t)))) {
+      P_ERR("failed to allocate memory for the input data catalog\n");
+      data_destroy(data);
+      return NULL;
+    }
+    *data->rmem = ((size_t) conf->rcache > SIZE_MAX / BRICKMASK_FITS_CACHE_UNIT)
+        ? SIZE_MAX : (size_t) conf->rcache * BRICKMASK_FITS_CACHE_UNIT;
+  }
+
   /* Check the data type of masks required by `MASKBIT_NULL`. */
-  uint64_t mnull = conf->mnull;
-  if (mnull < UINT8_MAX) data->mtype = TBYTE;
-  else if (mnull < UINT16_MAX) data->mtype = TSHORT;
-  else if (mnull < UINT32_MAX) data->mtype = TINT;
-  else data->mtype = TLONG;
+  data->mtype = mask_type(conf->mnull);
+  data->hook = NULL;
+  data->harg = NULL;
 
   return data;
 }
 
+/******************************************************************************
+Function `mask_type`:
+  Get the minimum data type of maskbits that holds a given bit code.
+Arguments:
+  * `mnull`:    the bit code for objects outside bricks.
+Return:
+  The CFITSIO data type of maskbits.
+******************************************************************************/
+int mask_type(const uint64_t mnull) {
+  if (mnull < UINT8_MAX) return TBYTE;
+  if (mnull < UINT16_MAX) return TSHORT;
+  if (mnull < UINT32_MAX) return TINT;
+  return TLONG;
+}
+
+/******************************************************************************
+Function `mask_size`:
+  Get the number of bytes of a maskbit value.
+Arguments:
+  * `mtype`:    CFITSIO data type of maskbits.
+Return:
+  Number of bytes; 0 for unknown data types.
+******************************************************************************/
+size_t mask_size(const int mtype) {
+  switch (mtype) {
+    case TBYTE:  return sizeof(uint8_t);
+    case TSHORT: return sizeof(uint16_t);
+    case TINT:   return sizeof(uint32_t);
+    case TLONG:  return sizeof(uint64_t);
+    default:     return 0;
+  }
+}
+
+/******************************************************************************
+Function `get_mask`:
+  Get a maskbit value from an array packed to a given data type.
+Arguments:
+  * `mask`:     the packed maskbit array;
+  * `mtype`:    CFITSIO data type of maskbits;
+  * `i`:        index of the value.
+Return:
+  The maskbit value.
+******************************************************************************/
+uint64_t get_mask(const void *mask, const int mtype, const size_t i) {
+  switch (mtype) {
+    case TBYTE:  return ((const uint8_t *) mask)[i];
+    case TSHORT: return ((const uint16_t *) mask)[i];
+    case TINT:   return ((const uint32_t *) mask)[i];
+    default:     return ((const uint64_t *) mask)[i];
+  }
+}
+
+/******************************************************************************
+Function `set_mask`:
+  Set a maskbit value of an array packed to a given data type.
+Arguments:
+  * `mask`:     the packed maskbit array;
+  * `mtype`:    CFITSIO data type of maskbits;
+  * `i`:        index of the value;
+  * `v`:        the maskbit value.
+******************************************************************************/
+void set_mask(void *mask, const int mtype, const size_t i, const uint64_t v) {
+  switch (mtype) {
+    case TBYTE:  ((uint8_t *) mask)[i] = v;  break;
+    case TSHORT: ((uint16_t *) mask)[i] = v; break;
+    case TINT:   ((uint32_t *) mask)[i] = v; break;
+    default:     ((uint64_t *) mask)[i] = v; break;
+  }
+}
+
+/******************************************************************************
+Function `same_file`:
+  Check whether two paths refer to the same file.
+Arguments:
+  * `fname1`:   name of the first file;
+  * `fname2`:   name of the second file.
+Return:
+  True if both files exist and are identical; false otherwise.
+******************************************************************************/
+bool same_file(const char *fname1, const char *fname2) {
+  struct stat st1, st2;
+  if (stat(fname1, &st1) || stat(fname2, &st2)) return false;
+  return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+/* Function for reading an input catalogue of a given format. */
+typedef int (*BRICKMASK_read_t) (const char *, const int, const CONF *,
+    DATA *);
+
+/* Function for saving an output catalogue of a given format. */
+typedef int (*BRICKMASK_save_t) (const CONF *, const DATA *, const int);
+
+#ifdef OMP
+/******************************************************************************
+Function `segment_init`:
+  Initialise a private segment of the input data, for reading one input
+  catalogue concurrently with others. Arrays indexed by catalogues are
+  shared with the full data, as each segment writes only its own entry.
+  So is the memory budget of the FITS row cache.
+Arguments:
+  * `data`:     structure for the input data catalogue.
+Return:
+  Address of the segment on success; NULL on error.
+******************************************************************************/
+static DATA *segment_init(const DATA *data) {
+  DATA *seg = calloc(1, sizeof(DATA));
+  if (!seg) return NULL;
+  seg->fmt = data->fmt;
+  seg->mtype = data->mtype;
+  seg->nspan = data->nspan;
+  seg->ncat = data->ncat;
+  seg->fmap = data->fmap;
+  seg->fsize = data->fsize;
+  seg->sel = data->sel;
+  seg->rows = data->rows;
+  seg->rmem = data->rmem;
+
+  if (seg->fmt == BRICKMASK_FFMT_ASCII) {
+    seg->nmax = BRICKMASK_DATA_INIT_NUM;
+    if (!seg->nspan && data->content) {
+      seg->cmax = BRICKMASK_CONTENT_INIT_SIZE;
+      if (!(seg->content = malloc(seg->cmax))) {
+        free(seg);
+        return NULL;
+      }
+    }
+    if (!(seg->ra = malloc(seg->nmax * sizeof(double))) ||
+        !(seg->dec = malloc(seg->nmax * sizeof(double))) ||
+        !(seg->cidx = malloc(seg->nmax * CIDX_PER_OBJECT(seg) *
+        sizeof(size_t)))) {
+      seg->fmap = NULL;
+      seg->fsize = NULL;
+      seg->sel = NULL;
+      seg->rows = NULL;
+      seg->rmem = NULL;
+      data_destroy(seg);
+      return NULL;
+    }
+  }
+  return seg;
+}
+
+/******************************************************************************
+Function `segment_destroy`:
+  Deconstruct a segment of the input data, without the shared arrays.
+Arguments:
+  * `seg`:      segment of the input data catalogue.
+******************************************************************************/
+static void segment_destroy(DATA *seg) {
+  if (!seg) return;
+  seg->fmap = NULL;
+  seg->fsize = NULL;
+  seg->sel = NULL;
+  seg->rows = NULL;
+  seg->rmem = NULL;
+  data_destroy(seg);
+}
+
+/******************************************************************************
+Function `segment_merge`:
+  Concatenate segments of all input catalogues in the file order, and
+  release the segments.
+Arguments:
+  * `seg`:      segments of the input catalogues;
+  * `data`:     structure for the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int segment_merge(DATA **seg, DATA *data) {
+  size_t n = 0;
+  size_t csize = 0;
+  for (int i = 0; i < data->ncat; i++) {
+    n += seg[i]->n;
+    csize += seg[i]->csize;
+    data->iidx[i + 1] = n;
+  }
+  if (!n) return 0;
+
+  /* Allocate memory for all the objects. */
+  const size_t nidx = (data->cidx) ? CIDX_PER_OBJECT(data) : 0;
+  double *dtmp = realloc(data->ra, n * sizeof(double));
+  if (!dtmp) {
+    P_ERR("failed to allocate memory for the input data catalog\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  data->ra = dtmp;
+  if (!(dtmp = realloc(data->dec, n * sizeof(double)))) {
+    P_ERR("failed to allocate memory for the input data catalog\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  data->dec = dtmp;
+  if (nidx) {
+    size_t *stmp = realloc(data->cidx, n * nidx * sizeof(size_t));
+    if (!stmp) {
+      P_ERR("failed to allocate memory for the input data catalog\n");
+      return BRICKMASK_ERR_MEMORY;
+    }
+    data->cidx = stmp;
+    data->nmax = n;
+  }
+  if (data->content && csize) {
+    char *ctmp = realloc(data->content, csize);
+    if (!ctmp) {
+      P_ERR("failed to allocate memory for the input data catalog\n");
+      return BRICKMASK_ERR_MEMORY;
+    }
+    data->content = ctmp;
+    data->cmax = csize;
+  }
+
+  /* Copy the segments, with offsets of the copied columns updated. */
+  for (int i = 0; i < data->ncat; i++) {
+    DATA *s = seg[i];
+    memcpy(data->ra + data->n, s->ra, s->n * sizeof(double));
+    memcpy(data->dec + data->n, s->dec, s->n * sizeof(double));
+    if (nidx) {
+      size_t *cidx = data->cidx + data->n * nidx;
+      memcpy(cidx, s->cidx, s->n * nidx * sizeof(size_t));
+      if (!data->nspan && data->content) {
+        for (size_t j = 0; j < s->n; j++) cidx[j] += data->csize;
+        memcpy((char *) data->content + data->csize, s->content, s->csize);
+        data->csize += s->csize;
+      }
+    }
+    /* FITS: the output columns are taken from the first non-empty file. */
+    else if (!data->content && s->content) {
+      data->content = s->content;
+      s->content = NULL;
+    }
+    data->n += s->n;
+    segment_destroy(s);
+    seg[i] = NULL;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `read_concurrent`:
+  Read input catalogues concurrently, each to a private segment of the
+  data, and concatenate the segments in the file order.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `func`:     function for reading a catalogue;
+  * `data`:     structure for the input data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int read_concurrent(const CONF *conf, BRICKMASK_read_t func,
+    DATA *data) {
+  DATA **seg = calloc(conf->ncat, sizeof(DATA *));
+  if (!seg) {
+    P_ERR("failed to allocate memory for reading files with threads\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  const int nthread = (conf->nread < conf->ncat) ? conf->nread : conf->ncat;
+  int err = 0;
+
+#pragma omp parallel for schedule(dynamic) num_threads(nthread) \
+  reduction(|:err)
+  for (int i = 0; i < conf->ncat; i++) {
+    if (err) continue;
+    if (!(seg[i] = segment_init(data))) {
+      P_ERR("failed to allocate memory for the input data catalog\n");
+      err = BRICKMASK_ERR_MEMORY;
+      continue;
+    }
+    err = func(conf->input[i], i, conf, seg[i]);
+  }
+
+  if (!err) err = segment_merge(seg, data);
+  for (int i = 0; i < conf->ncat; i++) segment_destroy(seg[i]);
+  free(seg);
+  if (err) return err;
+
+  if (conf->verbose) {
+    for (int i = 0; i < conf->ncat; i++) {
+      printf("  %zu objects read from `%s'\n",
+          data->iidx[i + 1] - data->iidx[i], conf->input[i]);
+    }
+  }
+  return 0;
+}
+#endif
+
 /******************************************************************************
 Function `read_data`:
   Read data from the input catalogue.
 Arguments:
-  * `conf`:     structure for storing configurations.
+  * `conf`:     structure for storing configurations;
+  * `hook`:     function to be called while reading, or NULL;
+  * `harg`:     arguments to be passed to `hook`.
 Return:
   Address of the structure for the input catalogue on success; NULL on error.
 ******************************************************************************/
-DATA *read_data(const CONF *conf) {
+DATA *read_data(const CONF *conf, BRICKMASK_hook_t hook, void *harg) {
   printf("Reading objects from the input catalogs ...");
   if (!conf) {
     P_ERR("configuration parameters are not loaded\n");
@@ -96,39 +430,60 @@ DATA *read_data(const CONF *conf) {
   /* Initialise the structure for the input catalogue. */
   DATA *data = data_init(conf);
   if (!data) return NULL;
-  size_t ndata = 0;
+  data->hook = hook;
+  data->harg = harg;
 
-  /* Read the input catalogue. */
+  /* Choose the reading function given the format. */
+  BRICKMASK_read_t func = NULL;
   switch (data->fmt) {
-    case BRICKMASK_FFMT_ASCII:
-      for (int i = 0; i < conf->ncat; i++) {
-        if (read_ascii(conf->input[i], conf, data)) {
-          data_destroy(data);
-          return NULL;
-        }
-        data->iidx[i + 1] = data->n;
-        if (conf->verbose) {
-          printf("  %zu objects read from `%s'\n", data->n - ndata,
-              conf->input[i]);
-          ndata = data->n;
-        }
+    case BRICKMASK_FFMT_ASCII: func = read_ascii; break;
+    case BRICKMASK_FFMT_FITS:  func = read_fits;  break;
+    case BRICKMASK_FFMT_NPY:   func = read_npy;   break;
+#ifdef HDF5
+    case BRICKMASK_FFMT_HDF5:  func = read_hdf5;  break;
+#endif
+    default:
+      P_ERR("unsupported format of the input catalogs: %d\n", data->fmt);
+      data_destroy(data);
+      return NULL;
+  }
+
+#ifdef OMP
+  /* Catalogues are read concurrently, unless they are reported while being
+     read, or the library is not thread-safe. HDF5 calls are serialised by
+     the library anyway. */
+  bool concurrent = (conf->nread > 1 && conf->ncat > 1 && !hook &&
+      data->fmt != BRICKMASK_FFMT_HDF5);
+  if (concurrent && data->fmt == BRICKMASK_FFMT_FITS &&
+      !fits_is_reentrant()) {
+    P_WRN("CFITSIO is not reentrant, input catalogs are read one by one\n");
+    concurrent = false;
+  }
+  if (concurrent) {
+    if (read_concurrent(conf, func, data)) {
+      data_destroy(data);
+      return NULL;
+    }
+  }
+  else {
+#endif
+    /* Read the input catalogues one by one. */
+    size_t ndata = 0;
+    for (int i = 0; i < conf->ncat; i++) {
+      if (func(conf->input[i], i, conf, data)) {
+        data_destroy(data);
+        return NULL;
       }
-      break;
-    case BRICKMASK_FFMT_FITS:
-      for (int i = 0; i < conf->ncat; i++) {
-        if (read_fits(conf->input[i], conf, data)) {
-          data_destroy(data);
-          return NULL;
-        }
-        data->iidx[i + 1] = data->n;
-        if (conf->verbose) {
-          printf("  %zu objects read from `%s'\n", data->n - ndata,
-              conf->input[i]);
-          ndata = data->n;
-        }
+      data->iidx[i + 1] = data->n;
+      if (conf->verbose) {
+        printf("  %zu objects read from `%s'\n", data->n - ndata,
+            conf->input[i]);
+        ndata = data->n;
       }
-      break;
+    }
+#ifdef OMP
   }
+#endif
 
   if (!data->n) {
     P_ERR("no valid object read from the input catalogs\n");
@@ -142,19 +497,14 @@ DATA *read_data(const CONF *conf) {
     if (dtmp) data->ra = dtmp;
     dtmp = realloc(data->dec, data->n * sizeof(double));
     if (dtmp) data->dec = dtmp;
-    size_t *stmp = realloc(data->cidx, data->n * sizeof(size_t));
+    size_t *stmp = realloc(data->cidx, data->n * CIDX_PER_OBJECT(data) *
+        sizeof(size_t));
     if (stmp) data->cidx = stmp;
-    char *ctmp = realloc(data->content, data->csize);
-    if (ctmp) data->content = ctmp;
-  }
-
-#ifdef MPI
-  if (data->n > BRICKMASK_MAX_DATA) {
-    P_ERR("too many objects in the catalogs: %zu\n", data->n);
-    data_destroy(data);
-    return NULL;
+    if (data->content) {
+      char *ctmp = realloc(data->content, data->csize);
+      if (ctmp) data->content = ctmp;
+    }
   }
-#endif
 
   /* Allocate memory for the rest of the properties. */
   if (!(data->idx = malloc(data->n * sizeof(size_t))) ||
@@ -179,6 +529,41 @@ DATA *read_data(const CONF *conf) {
                     Function for saving the output catalogue
 \*============================================================================*/
 
+#ifdef OMP
+/******************************************************************************
+Function `save_concurrent`:
+  Save output catalogues concurrently, each by one thread with its range of
+  objects in the shared data.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `func`:     function for saving a catalogue;
+  * `data`:     structure for the data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int save_concurrent(const CONF *conf, BRICKMASK_save_t func,
+    const DATA *data) {
+  const int nthread = (conf->nsave < conf->ncat) ? conf->nsave : conf->ncat;
+  int err = 0;
+
+#pragma omp parallel for schedule(dynamic) num_threads(nthread) \
+  reduction(|:err)
+  for (int i = 0; i < conf->ncat; i++) {
+    if (err) continue;
+    err = func(conf, data, i);
+  }
+  if (err) return err;
+
+  if (conf->verbose) {
+    for (int i = 0; i < conf->ncat; i++) {
+      printf("  %zu objects saved to `%s'\n",
+          data->iidx[i + 1] - data->iidx[i], conf->output[i]);
+    }
+  }
+  return 0;
+}
+#endif
+
 /******************************************************************************
 Function `save_data`:
   Save data to the output catalogue.
@@ -202,26 +587,50 @@ int save_data(const CONF *conf, DATA *data) {
     printf("\n  Output catalogs obtained from: `%s'\n", conf->olist);
   fflush(stdout);
 
-  switch (data->fmt) {
-    case BRICKMASK_FFMT_ASCII:
-      for (int i = 0; i < conf->ncat; i++) {
-        if (save_ascii(conf, data, i)) return BRICKMASK_ERR_SAVE;
-        if (conf->verbose) {
-          printf("  %zu objects saved to `%s'\n",
-              data->iidx[i + 1] - data->iidx[i], conf->output[i]);
-        }
-      }
-      break;
-    case BRICKMASK_FFMT_FITS:
-      for (int i = 0; i < conf->ncat; i++) {
-        if (save_fits(conf, data, i)) return BRICKMASK_ERR_SAVE;
-        if (conf->verbose) {
-          printf("  %zu objects saved to `%s'\n",
-              data->iidx[i + 1] - data->iidx[i], conf->output[i]);
-        }
+  /* Choose the saving function given the format. */
+  BRICKMASK_save_t func = NULL;
+  if (conf->monly) func = save_mask;    /* regardless of the input format */
+  else {
+    switch (data->fmt) {
+      case BRICKMASK_FFMT_ASCII: func = save_ascii; break;
+      case BRICKMASK_FFMT_FITS:  func = save_fits;  break;
+      case BRICKMASK_FFMT_NPY:   func = save_npy;   break;
+#ifdef HDF5
+      case BRICKMASK_FFMT_HDF5:  func = save_hdf5;  break;
+#endif
+      default:
+        P_ERR("unsupported format of the output catalogs: %d\n", data->fmt);
+        return BRICKMASK_ERR_SAVE;
+    }
+  }
+
+#ifdef OMP
+  /* Catalogues are saved concurrently, unless the library is not
+     thread-safe. HDF5 calls are serialised by the library anyway. */
+  const bool fits = (conf->monly) ? conf->monly == BRICKMASK_MONLY_FITS :
+      data->fmt == BRICKMASK_FFMT_FITS;
+  bool concurrent = (conf->nsave > 1 && conf->ncat > 1 &&
+      (conf->monly || data->fmt != BRICKMASK_FFMT_HDF5));
+  if (concurrent && fits && !fits_is_reentrant()) {
+    P_WRN("CFITSIO is not reentrant, output catalogs are saved one by one\n");
+    concurrent = false;
+  }
+  if (concurrent) {
+    if (save_concurrent(conf, func, data)) return BRICKMASK_ERR_SAVE;
+  }
+  else {
+#endif
+    /* Save the output catalogues one by one. */
+    for (int i = 0; i < conf->ncat; i++) {
+      if (func(conf, data, i)) return BRICKMASK_ERR_SAVE;
+      if (conf->verbose) {
+        printf("  %zu objects saved to `%s'\n",
+            data->iidx[i + 1] - data->iidx[i], conf->output[i]);
       }
-      break;
+    }
+#ifdef OMP
   }
+#endif
 
   data_destroy(data);
 
@@ -251,5 +660,25 @@ void data_destroy(DATA *data) {
   if (data->mask) free(data->mask);
   if (data->subid) free(data->subid);
   if (data->content) free(data->content);
+  if (data->fmap) {
+    for (int i = 0; i < data->ncat; i++) {
+      if (data->fmap[i]) munmap(data->fmap[i], data->fsize[i]);
+    }
+    free(data->fmap);
+  }
+  if (data->fsize) free(data->fsize);
+  if (data->sel) {
+    for (int i = 0; i < data->ncat; i++) {
+      if (data->sel[i]) free(data->sel[i]);
+    }
+    free(data->sel);
+  }
+  if (data->rows) {
+    for (int i = 0; i < data->ncat; i++) {
+      if (data->rows[i]) free(data->rows[i]);
+    }
+    free(data->rows);
+  }
+  if (data->rmem) free(data->rmem);
   free(data);
 }
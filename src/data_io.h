@@ -35,6 +35,7 @@
 #include "load_conf.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 /*============================================================================*\
                          Data structures for the inputs
@@ -43,9 +44,27 @@
 /* Type of the input catalogue. */
 typedef enum {
   BRICKMASK_FFMT_ASCII = 0,
-  BRICKMASK_FFMT_FITS = 1
+  BRICKMASK_FFMT_FITS = 1,
+  BRICKMASK_FFMT_NPY = 2,
+  BRICKMASK_FFMT_HDF5 = 3
 } BRICKMASK_ffmt_t;
 
+/* Format of the output files with only maskbits and subsample IDs. */
+typedef enum {
+  BRICKMASK_MONLY_NONE = 0,     /* full catalogues                      */
+  BRICKMASK_MONLY_FITS = 1,     /* FITS table                           */
+  BRICKMASK_MONLY_NPY = 2,      /* NumPy array                          */
+  BRICKMASK_MONLY_BIN = 3       /* raw binary rows                      */
+} BRICKMASK_monly_t;
+
+/* Function called whenever a block of objects is read, with the coordinates
+   and the total number of objects read so far. */
+typedef int (*BRICKMASK_hook_t) (const double *, const double *, const size_t,
+    void *);
+
+/* Number of elements of `cidx` per object. */
+#define CIDX_PER_OBJECT(d)      (((d)->nspan) ? 2 * (size_t) (d)->nspan : 1)
+
 /* Data structure for the input catalogue. */
 typedef struct {
   BRICKMASK_ffmt_t fmt; /* format of the input data catalogue           */
@@ -58,13 +77,26 @@ typedef struct {
   double *ra;           /* right ascension                              */
   double *dec;          /* declination                                  */
   size_t *idx;          /* index of the data before sorting             */
-  size_t *cidx;         /* ASCII: index for the rest of the columns     */
+  size_t *cidx;         /* ASCII: index for the rest of the columns, or
+                           (offset, length) spans in mapped files       */
   size_t *iidx;         /* index range for different input catalogues   */
+  int nspan;            /* ASCII: number of spans per object, 0 if the
+                           columns are copied to `content`              */
+  char **fmap;          /* ASCII: memory-mapped input catalogues        */
+  size_t *fsize;        /* ASCII: sizes of the mapped catalogues        */
+  int ncat;             /* number of input catalogues                   */
+  char **sel;           /* FITS: flags of selected rows of each input
+                           catalogue, NULL if all rows are selected     */
+  unsigned char **rows; /* FITS: output columns of selected rows of each
+                           input catalogue, NULL if not cached          */
+  size_t *rmem;         /* FITS: number of bytes left for caching rows  */
   long *id;             /* brick ID, signed type for sorting comparison */
-  uint64_t *mask;       /* maskbit value                                */
+  uint64_t *mask;       /* maskbit value, packed to `mtype`              */
   unsigned char *subid; /* ID of the subsample                          */
   void *content;        /* ASCII: address for the rest of the columns
                            FITS:  properties of output columns          */
+  BRICKMASK_hook_t hook;        /* function called while reading        */
+  void *harg;                   /* arguments for the reading hook       */
 } DATA;
 
 /* Data structure for information of FITS columns. */
@@ -78,15 +110,81 @@ typedef struct {
                Interfaces for reading and saving data catalogues
 \*============================================================================*/
 
+/******************************************************************************
+Function `data_init`:
+  Initialise the structure for the input data.
+Arguments:
+  * `conf`:     structure for storing configurations.
+Return:
+  Address of the structure for the input catalogue on success; NULL on error.
+******************************************************************************/
+DATA *data_init(const CONF *conf);
+
 /******************************************************************************
 Function `read_data`:
   Read data from the input catalogue.
 Arguments:
-  * `conf`:     structure for storing configurations.
+  * `conf`:     structure for storing configurations;
+  * `hook`:     function to be called while reading, or NULL;
+  * `harg`:     arguments to be passed to `hook`.
 Return:
   Address of the structure for the input catalogue on success; NULL on error.
 ******************************************************************************/
-DATA *read_data(const CONF *conf);
+DATA *read_data(const CONF *conf, BRICKMASK_hook_t hook, void *harg);
+
+/******************************************************************************
+Function `mask_type`:
+  Get the minimum data type of maskbits that holds a given bit code.
+Arguments:
+  * `mnull`:    the bit code for objects outside bricks.
+Return:
+  The CFITSIO data type of maskbits.
+******************************************************************************/
+int mask_type(const uint64_t mnull);
+
+/******************************************************************************
+Function `mask_size`:
+  Get the number of bytes of a maskbit value.
+Arguments:
+  * `mtype`:    CFITSIO data type of maskbits.
+Return:
+  Number of bytes; 0 for unknown data types.
+******************************************************************************/
+size_t mask_size(const int mtype);
+
+/******************************************************************************
+Function `get_mask`:
+  Get a maskbit value from an array packed to a given data type.
+Arguments:
+  * `mask`:     the packed maskbit array;
+  * `mtype`:    CFITSIO data type of maskbits;
+  * `i`:        index of the value.
+Return:
+  The maskbit value.
+******************************************************************************/
+uint64_t get_mask(const void *mask, const int mtype, const size_t i);
+
+/******************************************************************************
+Function `set_mask`:
+  Set a maskbit value of an array packed to a given data type.
+Arguments:
+  * `mask`:     the packed maskbit array;
+  * `mtype`:    CFITSIO data type of maskbits;
+  * `i`:        index of the value;
+  * `v`:        the maskbit value.
+******************************************************************************/
+void set_mask(void *mask, const int mtype, const size_t i, const uint64_t v);
+
+/******************************************************************************
+Function `same_file`:
+  Check whether two paths refer to the same file.
+Arguments:
+  * `fname1`:   name of the first file;
+  * `fname2`:   name of the second file.
+Return:
+  True if both files exist and are identical; false otherwise.
+******************************************************************************/
+bool same_file(const char *fname1, const char *fname2);
 
 /******************************************************************************
 Function `save_data`:
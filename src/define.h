@@ -45,7 +45,17 @@
 #define DEFAULT_CONF_FILE               "brickmask.conf"
 #define DEFAULT_FILE_TYPE               BRICKMASK_FFMT_ASCII
 #define DEFAULT_ASCII_COMMENT           '\0'
+#define DEFAULT_ASCII_MMAP              false
+#define DEFAULT_INPUT_THREADS           1
+#define DEFAULT_FITS_ROW_CACHE          0
+#define DEFAULT_MASK_ONLY               BRICKMASK_MONLY_NONE
+#define DEFAULT_OUTPUT_THREADS          1
 #define DEFAULT_OVERWRITE               0
+#define DEFAULT_STREAM_CHUNK            0
+#define DEFAULT_RESUME                  false
+#define DEFAULT_MERGE_SHARD             false
+#define DEFAULT_STDIO                   false
+#define DEFAULT_STDIO_WINDOW            1048576
 #define DEFAULT_VERBOSE                 true
 
 #ifdef EBOSS
@@ -77,6 +87,37 @@
 #define BRICKMASK_CONTENT_MAX_DOUBLE_SIZE       INT_MAX
 /* Maximum content size                                                   */
 #define BRICKMASK_CONTENT_MAX_SIZE              SIZE_MAX
+/* Basename and identifier of checkpoint files                            */
+#define BRICKMASK_CKPT_FNAME    "BRICKMASK_ckpt"
+#define BRICKMASK_CKPT_MAGIC    "BMCKPT02"
+/* Minimum number of seconds between flushes of checkpoint files          */
+#define BRICKMASK_CKPT_INTERVAL 60
+/* Basename and identifier of files for results of shards                 */
+#define BRICKMASK_SHARD_FNAME   "BRICKMASK_shard"
+#define BRICKMASK_SHARD_MAGIC   "BMSHRD01"
+/* Maximum length of coordinates parsed from memory-mapped ASCII files    */
+#define BRICKMASK_MAX_NUM_LEN   128
+/* Suffix of temporary files for overwriting memory-mapped inputs         */
+#define BRICKMASK_TMP_SUFFIX    ".tmp"
+/* Suffixes of compressed output ASCII files                              */
+#define BRICKMASK_GZIP_SUFFIX   ".gz"
+#define BRICKMASK_ZSTD_SUFFIX   ".zst"
+/* Window bits of zlib for writing gzip (instead of zlib) wrappers        */
+#define BRICKMASK_GZIP_WBITS    (15 + 16)
+/* Suffix of output FITS files with tile-compressed tables                */
+#define BRICKMASK_FZ_SUFFIX     ".fz"
+/* Name of the memory file for tables before tile compression             */
+#define BRICKMASK_FITS_MEMFILE  "mem://"
+/* Suffix of NumPy array files, and alignment of the array headers        */
+#define BRICKMASK_NPY_SUFFIX    ".npy"
+#define BRICKMASK_NPY_ALIGN     64
+/* Number of bytes of NumPy arrays converted at once for coordinates      */
+#define BRICKMASK_NPY_BLOCK     16777216
+/* Number of objects read at once from HDF5 datasets, rounded to chunks   */
+#define BRICKMASK_HDF5_BLOCK    2097152
+/* Names of the standard streams for the STDIO mode                       */
+#define BRICKMASK_STDIN_NAME    "/dev/stdin"
+#define BRICKMASK_STDOUT_NAME   "<stdout>"
 
 /*============================================================================*\
                             Other runtime constants
@@ -95,6 +136,10 @@
 #define BRICKMASK_FITS_MAX_COLNAME      32
 /* Case sensitivity of FITS columns. */
 #define BRICKMASK_FITS_CASESEN          CASEINSEN
+/* Number of bytes of table rows read at once for coordinates. */
+#define BRICKMASK_FITS_RAW_BLOCK        16777216
+/* Number of bytes per unit of `FITS_ROW_CACHE`. */
+#define BRICKMASK_FITS_CACHE_UNIT       1048576
 /* Number of revisions for showing progress. */
 #define BRICKMASK_PROGRESS_NUM          20
 
@@ -104,9 +149,19 @@
 #define EBOSS_XYBUG_VALID(bit)          ((bit) & (EBOSS_XYBUG_BIT))
 #endif
 
+#ifdef OMP
+/* Number of bins of brick IDs for sorting the data with threads. */
+#define BRICKMASK_OMP_SORT_NBIN         16384
+/* Number of bytes of ASCII files to be parsed by each thread at once. */
+#define BRICKMASK_OMP_PARSE_SIZE        16777216
+/* Number of objects formatted by each thread at once for ASCII outputs. */
+#define BRICKMASK_OMP_WRITE_NUM         65536
+#endif
+
 #ifdef MPI
 #define BRICKMASK_MPI_ROOT              0       /* root rank of MPI */
-#define BRICKMASK_MAX_DATA              INT_MAX /* maximum number of data */
+/* Number of elements per block for large-count messages. */
+#define BRICKMASK_MPI_BLOCK             1048576
 #endif
 
 /*============================================================================*\
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <math.h>
+#include <string.h>
 
 /*============================================================================*\
                         Functions for setting up bricks
@@ -42,18 +43,13 @@ static BRICK *brick_init(const CONF *conf) {
   brick->name = NULL;
   brick->nmask = NULL;
   brick->fmask = NULL;
-#ifdef MPI
-  brick->mlen = NULL;
-#endif
+  brick->fidx = NULL;
   brick->subid = NULL;
   brick->mnull = conf->mnull;
 
   brick->nsp = conf->nsub;
   if (!(brick->subid = malloc(brick->nsp * sizeof(int))) ||
       !(brick->nmask = malloc(brick->nsp * sizeof(size_t))) ||
-#ifdef MPI
-      !(brick->mlen = malloc(brick->nsp * sizeof(size_t))) ||
-#endif
       !(brick->fmask = malloc(brick->nsp * sizeof(char **)))) {
     P_ERR("failed to allocate memory for maskbit information\n");
     brick_destroy(brick);
@@ -105,6 +101,149 @@ static inline int check_brick(BRICK *brick) {
   return 0;
 }
 
+/******************************************************************************
+Function `hash_name`:
+  Compute the FNV-1a hash value of a string with a given length.
+Arguments:
+  * `str`:      the string;
+  * `len`:      length of the string.
+Return:
+  The hash value.
+******************************************************************************/
+static inline uint64_t hash_name(const char *str, const size_t len) {
+  uint64_t h = UINT64_C(14695981039346656037);
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char) str[i];
+    h *= UINT64_C(1099511628211);
+  }
+  return h;
+}
+
+/******************************************************************************
+Function `match_fmask`:
+  Find the maskbit file of each brick for all subsamples, by looking up
+  substrings of the filenames in a hash table of brick names.  Each file is
+  used at most once: bricks take in turn, following the order of the brick
+  list, the first unused file containing their names.  Brick names are
+  released afterwards.
+Arguments:
+  * `brick`:    structure for bricks.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int match_fmask(BRICK *brick) {
+  /* Get the maximum length of brick names, and the number of files. */
+  size_t lmax = 0;
+  for (size_t i = 0; i < brick->n; i++) {
+    size_t len = strlen(brick->name[i]);
+    if (len > lmax) lmax = len;
+  }
+  size_t fmax = 0;
+  for (int k = 0; k < brick->nsp; k++)
+    if (brick->nmask[k] > fmax) fmax = brick->nmask[k];
+
+  /* Construct the hash table, with indices of bricks starting from 1. */
+  size_t hsize = 2;
+  while (hsize < brick->n * 2) hsize <<= 1;
+  const size_t hmask = hsize - 1;
+  size_t *htab = calloc(hsize, sizeof(size_t));
+  bool *hlen = calloc(lmax + 1, sizeof(bool));
+  /* Matched pairs of bricks and files, and the files sorted by bricks. */
+  size_t *cnt = calloc(brick->n + 1, sizeof(size_t));
+  bool *used = malloc((fmax ? fmax : 1) * sizeof(bool));
+  size_t npair, pmax;
+  npair = 0;
+  pmax = (fmax ? fmax : 1);
+  size_t *pb = malloc(pmax * sizeof(size_t));
+  size_t *pf = malloc(pmax * sizeof(size_t));
+  size_t *sf = malloc(pmax * sizeof(size_t));
+  if (!htab || !hlen || !cnt || !used || !pb || !pf || !sf ||
+      !(brick->fidx = malloc(brick->n * brick->nsp * sizeof(long)))) {
+    P_ERR("failed to allocate memory for the hash table of bricks\n");
+    free(htab); free(hlen); free(cnt); free(used);
+    free(pb); free(pf); free(sf);
+    return BRICKMASK_ERR_MEMORY;
+  }
+  for (size_t i = 0; i < brick->n; i++) {
+    size_t len = strlen(brick->name[i]);
+    if (!len) continue;
+    hlen[len] = true;
+    size_t h = hash_name(brick->name[i], len) & hmask;
+    while (htab[h]) h = (h + 1) & hmask;
+    htab[h] = i + 1;
+  }
+
+  /* Initialise the indices of maskbit files. */
+  for (size_t i = 0; i < brick->n * brick->nsp; i++) brick->fidx[i] = -1;
+
+  for (int k = 0; k < brick->nsp; k++) {
+    /* Find bricks with names being substrings of each file, by checking all
+       substrings with lengths of brick names. */
+    npair = 0;
+    for (size_t j = 0; j < brick->nmask[k]; j++) {
+      const char *fname = brick->fmask[k][j];
+      size_t flen = strlen(fname);
+      for (size_t len = 1; len <= lmax && len <= flen; len++) {
+        if (!hlen[len]) continue;
+        for (size_t p = 0; p + len <= flen; p++) {
+          size_t h = hash_name(fname + p, len) & hmask;
+          while (htab[h]) {
+            const char *name = brick->name[htab[h] - 1];
+            if (name[len] == '\0' && !strncmp(name, fname + p, len)) {
+              if (npair == pmax) {
+                pmax <<= 1;
+                size_t *tb = realloc(pb, pmax * sizeof(size_t));
+                if (tb) pb = tb;
+                size_t *tf = realloc(pf, pmax * sizeof(size_t));
+                if (tf) pf = tf;
+                size_t *ts = realloc(sf, pmax * sizeof(size_t));
+                if (ts) sf = ts;
+                if (!tb || !tf || !ts) {
+                  P_ERR("failed to allocate memory for matching maskbit "
+                      "files\n");
+                  free(htab); free(hlen); free(cnt); free(used);
+                  free(pb); free(pf); free(sf);
+                  return BRICKMASK_ERR_MEMORY;
+                }
+              }
+              pb[npair] = htab[h] - 1;
+              pf[npair++] = j;
+              break;
+            }
+            h = (h + 1) & hmask;
+          }
+        }
+      }
+    }
+
+    /* Sort files by bricks, with the order of files kept. */
+    memset(cnt, 0, (brick->n + 1) * sizeof(size_t));
+    for (size_t i = 0; i < npair; i++) cnt[pb[i] + 1]++;
+    for (size_t i = 0; i < brick->n; i++) cnt[i + 1] += cnt[i];
+    for (size_t i = 0; i < npair; i++) sf[cnt[pb[i]]++] = pf[i];
+    for (size_t i = brick->n; i > 0; i--) cnt[i] = cnt[i - 1];
+    cnt[0] = 0;
+
+    /* Assign the first unused file to each brick. */
+    memset(used, 0, brick->nmask[k] * sizeof(bool));
+    for (size_t i = 0; i < brick->n; i++) {
+      for (size_t t = cnt[i]; t < cnt[i + 1]; t++) {
+        if (used[sf[t]]) continue;
+        used[sf[t]] = true;
+        brick->fidx[i * brick->nsp + k] = sf[t];
+        break;
+      }
+    }
+  }
+
+  free(htab); free(hlen); free(cnt); free(used);
+  free(pb); free(pf); free(sf);
+  free(brick->name[0]);
+  free(brick->name);
+  brick->name = NULL;
+  return 0;
+}
+
 /******************************************************************************
 Function `get_brick`:
   Get brick information from files.
@@ -137,13 +276,7 @@ BRICK *get_brick(const CONF *conf) {
   /* Read names of maskbit files. */
   size_t cnt = 0;
   for (int i = 0; i < conf->nsub; i++) {
-#ifdef MPI
-    if (!(brick->mlen[i] = read_fname(conf->fmask[i], brick->fmask + i,
-        brick->nmask + i)))
-#else
-    if (!read_fname(conf->fmask[i], brick->fmask + i, brick->nmask + i))
-#endif
-    {
+    if (!read_fname(conf->fmask[i], brick->fmask + i, brick->nmask + i)) {
       brick_destroy(brick);
       return NULL;
     }
@@ -159,6 +292,12 @@ BRICK *get_brick(const CONF *conf) {
   }
 #endif
 
+  /* Find the maskbit file for each brick. */
+  if (match_fmask(brick)) {
+    brick_destroy(brick);
+    return NULL;
+  }
+
   printf(FMT_DONE);
   return brick;
 }
@@ -190,8 +329,6 @@ void brick_destroy(BRICK *brick) {
     }
     free(brick->fmask);
   }
-#ifdef MPI
-  if (brick->mlen) free(brick->mlen);
-#endif
+  if (brick->fidx) free(brick->fidx);
   free(brick);
 }
@@ -52,11 +52,9 @@ typedef struct {
   int *subid;           /* IDs of subsamples                            */
   size_t *nmask;        /* number of maskbit files for each subsample   */
   char ***fmask;        /* names of maskbit files                       */
+  long *fidx;           /* index of the maskbit file for each brick and
+                           subsample, negative if there is no file      */
   uint64_t mnull;       /* bit code for objects outside maskbit bricks  */
-#ifdef MPI
-  int nlen;             /* length of the brick names                    */
-  size_t *mlen;         /* total length of filenames for each subsample */
-#endif
 } BRICK;
 
 /*============================================================================*\
@@ -17,10 +17,13 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "define.h"
 #include "load_conf.h"
 #include "data_io.h"
 #include "read_file.h"
+#include "stream_io.h"
+#include "npy_io.h"
 #include "libcfg.h"
 
 /*============================================================================*\
@@ -107,16 +110,44 @@ Assign maskbit codes to a catalog with sky coordinates.\n\
         Specify the file type of the input catalog\n\
       --comment         " FMT_KEY(ASCII_COMMENT) "   Character\n\
         Specify the comment symbol for ASCII-format input catalog\n\
+      --mmap            " FMT_KEY(ASCII_MMAP) "      Boolean\n\
+        Indicate whether to map ASCII-format input catalogs into memory\n\
   -C, --coord-col       " FMT_KEY(COORD_COLUMN) "    String array\n\
         Specify columns for RA and Dec in the input catalog\n\
+      --select          " FMT_KEY(INPUT_SELECTION) " String\n\
+        Set the criteria for selecting objects from the input catalog\n\
+      --read-threads    " FMT_KEY(INPUT_THREADS) "   Integer\n\
+        Set the number of input catalogs read at the same time\n\
+      --row-cache       " FMT_KEY(FITS_ROW_CACHE) "  Long integer\n\
+        Set the memory (in MB) for keeping FITS rows from reading to saving\n\
   -o, --output          " FMT_KEY(OUTPUT_FILES) "    String\n\
         Specify the text file with paths of all output catalogs\n\
   -e, --output-col      " FMT_KEY(OUTPUT_COLUMN) "   String array\n\
         Set columns to be written to the output catalog\n\
   -M, --mask-col        " FMT_KEY(MASKBIT_COLUMN) "  String\n\
         Set the name of the maskbit column for FITS-format output\n\
+      --mask-only       " FMT_KEY(MASK_ONLY) "       Integer\n\
+        Set the format for saving only maskbits, instead of catalogs\n\
+      --save-threads    " FMT_KEY(OUTPUT_THREADS) "  Integer\n\
+        Set the number of output catalogs saved at the same time\n\
   -O, --overwrite       " FMT_KEY(OVERWRITE) "       Integer\n\
         Indicate whether to overwrite existing output files\n\
+  -S, --stream-chunk    " FMT_KEY(STREAM_CHUNK) "    Long integer\n\
+        Set the number of objects per chunk for streaming to MPI workers\n\
+  -k, --checkpoint      " FMT_KEY(CHECKPOINT_DIR) "  String\n\
+        Specify the directory for saving results of finished bricks\n\
+  -r, --resume          " FMT_KEY(RESUME) "          Boolean\n\
+        Indicate whether to skip bricks finished by a previous run\n\
+  -p, --shard           " FMT_KEY(SHARD) "           String\n\
+        Process only bricks of shard K out of N, given as \"K/N\"\n\
+  -d, --shard-dir       " FMT_KEY(SHARD_DIR) "       String\n\
+        Specify the directory for results of shards\n\
+  -g, --merge           " FMT_KEY(MERGE_SHARD) "     Boolean\n\
+        Indicate whether to merge results of shards into output catalogs\n\
+      --stdio           " FMT_KEY(STDIO) "           Boolean\n\
+        Indicate whether to filter ASCII objects from stdin to stdout\n\
+      --stdio-window    " FMT_KEY(STDIO_WINDOW) "    Long integer\n\
+        Set the number of objects processed at once in the STDIO mode\n\
   -v, --verbose         " FMT_KEY(VERBOSE) "         Boolean\n\
         Indicate whether to display detailed standard outputs\n\
 Consult the -t option for more information on the parameters\n\
@@ -167,13 +198,36 @@ FILE_TYPE       = \n\
     # Integer, format of the input and output catalogs (default: %d).\n\
     # The allowed values are:\n\
     # * %d: ASCII text file;\n\
-    # * %d: FITS table.\n\
+    # * %d: FITS table;\n\
+    # * %d: NumPy structured array, or directory of arrays for columns;\n\
+    # * %d: HDF5 file, with 1-D datasets for columns.\n\
 ASCII_COMMENT   = \n\
     # Character indicating comment lines for ASCII-format catalog (unset: '%c%s.\n\
+ASCII_MMAP      = \n\
+    # Boolean option, indicate whether to map ASCII-format input catalogs into\n\
+    # memory, instead of copying columns to be saved (unset: %c).\n\
+    # The input files must not be modified by other programs while running.\n\
 COORD_COLUMN    = \n\
     # 2-element integer or string array, columns of (RA,Dec) for `INPUT`.\n\
     # They must be integers indicating the column numbers (starting from 1) for\n\
-    # an ASCII file, or strings indicating the column names for a FITS table.\n\
+    # an ASCII file, or strings indicating the column names for a FITS table\n\
+    # or NumPy arrays, or the dataset paths for an HDF5 file.\n\
+INPUT_SELECTION = \n\
+    # String, criteria for selecting objects from `INPUT` (unset: none).\n\
+    # Objects that do not pass the selection are discarded, and not saved to\n\
+    # `OUTPUT`.  For FITS tables, it is a CFITSIO row filter expression, e.g.\n\
+    #   \"(Z > 0.4) && (FLAG == 0)\"\n\
+    # For ASCII files, it is a list of comparisons between columns and\n\
+    # numbers, combined by '&&', with columns given by '$' + number, e.g.\n\
+    #   \"$3 > 0.4 && $5 == 0\"\n\
+    # The allowed operators are '<', '<=', '>', '>=', '==', and '!='.\n\
+INPUT_THREADS   = \n\
+    # Integer, number of input catalogs read at the same time (unset: %d).\n\
+    # It requires OpenMP, and is ignored if `STREAM_CHUNK` > 0.\n\
+FITS_ROW_CACHE  = \n\
+    # Long integer, memory in megabytes for keeping the output columns of\n\
+    # FITS tables in memory between reading and saving (unset: %d).\n\
+    # Tables that do not fit in are read again for saving.\n\
 OUTPUT_FILES    = \n\
     # Filename of an ASCII file storing paths of output catalogs.\n\
     # Each row of the ASCII file specifies the path of an output catalog that\n\
@@ -186,20 +240,69 @@ OUTPUT_COLUMN   = \n\
     # Note that maskbits (and optionally subsample IDs) are always saved\n\
     # as the last column (or last two columns).\n\
 MASKBIT_COLUMN  = \n\
-    # String, name of the maskbit column in the FITS-format `OUTPUT`.\n\
+    # String, name of the maskbit column in the FITS, NumPy, or HDF5 `OUTPUT`.\n\
+MASK_ONLY       = \n\
+    # Integer, format of `OUTPUT` with only maskbits (and subsample IDs) of\n\
+    # the objects, in the order of `INPUT` (unset: %d).  Other columns of\n\
+    # `INPUT` are then not loaded, and `INPUT_SELECTION` must be unset.\n\
+    # The allowed values are:\n\
+    # * %d: full catalogs in the format of `INPUT`;\n\
+    # * %d: FITS table;\n\
+    # * %d: NumPy array, or structured array with subsample IDs;\n\
+    # * %d: raw binary rows with the native byte order.\n\
+OUTPUT_THREADS  = \n\
+    # Integer, number of output catalogs saved at the same time (unset: %d).\n\
+    # It requires OpenMP.\n\
 OVERWRITE       = \n\
     # Flag indicating whether to overwrite existing files, integer (unset: %d).\n\
     # Allowed values are:\n\
     # * 0: quit the program when an output file exist;\n\
     # * positive: force overwriting output files whenever possible;\n\
     # * negative: notify at most this number of times for existing files.\n\
+STREAM_CHUNK    = \n\
+    # Long integer, number of objects sent to MPI workers at one time while\n\
+    # the input catalogs are still being read (unset: %d).\n\
+    # It is efficient only if the inputs are grouped by bricks.\n\
+    # If it is 0, the inputs are distributed after all of them are read.\n\
+CHECKPOINT_DIR  = \n\
+    # String, directory for saving results of finished bricks periodically.\n\
+    # If unset, no checkpoint is saved.  It is ignored if `STREAM_CHUNK` > 0.\n\
+RESUME          = \n\
+    # Boolean option, indicate whether to load results from `CHECKPOINT_DIR`\n\
+    # and skip bricks finished by a previous run with the same inputs and\n\
+    # number of MPI tasks (unset: %c).\n\
+SHARD           = \n\
+    # String \"K/N\", process only bricks of shard K (0 <= K < N) out of N\n\
+    # independent runs, and save the results to `SHARD_DIR`.\n\
+    # All shards must have the same settings except for K.\n\
+SHARD_DIR       = \n\
+    # String, directory for results of shards.\n\
+MERGE_SHARD     = \n\
+    # Boolean option, indicate whether to merge results of all shards in\n\
+    # `SHARD_DIR` and save the output catalogs (unset: %c).\n\
+STDIO           = \n\
+    # Boolean option, indicate whether to read ASCII-format objects from the\n\
+    # standard input, and write them with maskbits to the standard output, in\n\
+    # the original order (unset: %c).  `INPUT_FILES` and `OUTPUT_FILES` are\n\
+    # omitted, and messages are printed to the standard error.\n\
+STDIO_WINDOW    = \n\
+    # Long integer, number of objects processed at once in the STDIO mode\n\
+    # (unset: %d).  It bounds the memory cost.  Each maskbit file is read\n\
+    # only once if the inputs are grouped by bricks.\n\
 VERBOSE         = \n\
     # Boolean option, indicate whether to show detailed outputs (unset: %c).\n",
       BRICKMASK_READ_COMMENT, DEFAULT_MASK_NULL, BRICKMASK_READ_COMMENT,
       DEFAULT_FILE_TYPE, BRICKMASK_FFMT_ASCII, BRICKMASK_FFMT_FITS,
+      BRICKMASK_FFMT_NPY, BRICKMASK_FFMT_HDF5,
       DEFAULT_ASCII_COMMENT ? DEFAULT_ASCII_COMMENT : '\'',
-      DEFAULT_ASCII_COMMENT ? "')" : ")", BRICKMASK_READ_COMMENT,
-      DEFAULT_OVERWRITE, DEFAULT_VERBOSE ? 'T' : 'F');
+      DEFAULT_ASCII_COMMENT ? "')" : ")", DEFAULT_ASCII_MMAP ? 'T' : 'F',
+      DEFAULT_INPUT_THREADS, DEFAULT_FITS_ROW_CACHE, BRICKMASK_READ_COMMENT,
+      DEFAULT_MASK_ONLY, BRICKMASK_MONLY_NONE, BRICKMASK_MONLY_FITS,
+      BRICKMASK_MONLY_NPY, BRICKMASK_MONLY_BIN, DEFAULT_OUTPUT_THREADS,
+      DEFAULT_OVERWRITE,
+      DEFAULT_STREAM_CHUNK, DEFAULT_RESUME ? 'T' : 'F',
+      DEFAULT_MERGE_SHARD ? 'T' : 'F', DEFAULT_STDIO ? 'T' : 'F',
+      DEFAULT_STDIO_WINDOW, DEFAULT_VERBOSE ? 'T' : 'F');
   exit(0);
 }
 
@@ -218,8 +321,10 @@ static CONF *conf_init(void) {
   CONF *conf = calloc(1, sizeof *conf);
   if (!conf) return NULL;
   conf->fconf = conf->flist = conf->ilist = conf->olist = conf->mcol = NULL;
+  conf->sel = conf->ckdir = conf->shard = conf->shdir = NULL;
   conf->fmask = conf->input = conf->cname = conf->output = conf->ocol = NULL;
   conf->subid = conf->onum = NULL;
+  conf->ofd = -1;
   return conf;
 }
 
@@ -257,11 +362,25 @@ static cfg_t *conf_read(CONF *conf, const int argc, char *const *argv) {
     {'i', "input"       , "INPUT_FILES"    , CFG_DTYPE_STR , &conf->ilist   },
     {'f', "file-type"   , "FILE_TYPE"      , CFG_DTYPE_INT , &conf->ftype   },
     { 0 , "comment"     , "ASCII_COMMENT"  , CFG_DTYPE_CHAR, &conf->comment },
+    { 0 , "mmap"        , "ASCII_MMAP"     , CFG_DTYPE_BOOL, &conf->amap    },
     {'C', "coord-col"   , "COORD_COLUMN"   , CFG_ARRAY_STR , &conf->cname   },
+    { 0 , "select"      , "INPUT_SELECTION", CFG_DTYPE_STR , &conf->sel     },
+    { 0 , "read-threads", "INPUT_THREADS"  , CFG_DTYPE_INT , &conf->nread   },
+    { 0 , "row-cache"   , "FITS_ROW_CACHE" , CFG_DTYPE_LONG, &conf->rcache  },
     {'o', "output"      , "OUTPUT_FILES"   , CFG_DTYPE_STR , &conf->olist   },
     {'e', "output-col"  , "OUTPUT_COLUMN"  , CFG_ARRAY_STR , &conf->ocol    },
     {'M', "mask-col"    , "MASKBIT_COLUMN" , CFG_DTYPE_STR , &conf->mcol    },
+    { 0 , "mask-only"   , "MASK_ONLY"      , CFG_DTYPE_INT , &conf->monly   },
+    { 0 , "save-threads", "OUTPUT_THREADS" , CFG_DTYPE_INT , &conf->nsave   },
     {'O', "overwrite"   , "OVERWRITE"      , CFG_DTYPE_INT , &conf->ovwrite },
+    {'S', "stream-chunk", "STREAM_CHUNK"   , CFG_DTYPE_LONG, &conf->nchunk  },
+    {'k', "checkpoint"  , "CHECKPOINT_DIR" , CFG_DTYPE_STR , &conf->ckdir   },
+    {'r', "resume"      , "RESUME"         , CFG_DTYPE_BOOL, &conf->resume  },
+    {'p', "shard"       , "SHARD"          , CFG_DTYPE_STR , &conf->shard   },
+    {'d', "shard-dir"   , "SHARD_DIR"      , CFG_DTYPE_STR , &conf->shdir   },
+    {'g', "merge"       , "MERGE_SHARD"    , CFG_DTYPE_BOOL, &conf->merge   },
+    { 0 , "stdio"       , "STDIO"          , CFG_DTYPE_BOOL, &conf->stdio   },
+    { 0 , "stdio-window", "STDIO_WINDOW"   , CFG_DTYPE_LONG, &conf->nwin    },
     {'v', "verbose"     , "VERBOSE"        , CFG_DTYPE_BOOL, &conf->verbose }
   };
 
@@ -316,6 +435,19 @@ static inline int check_input(const char *fname, const char *key) {
   return 0;
 }
 
+/******************************************************************************
+Function `is_dir`:
+  Check whether a path refers to a directory.
+Arguments:
+  * `path`:     the path to be checked.
+Return:
+  True if the path is a directory; false otherwise.
+******************************************************************************/
+static inline bool is_dir(const char *path) {
+  struct stat st;
+  return !stat(path, &st) && S_ISDIR(st.st_mode);
+}
+
 /******************************************************************************
 Function `check_output`:
   Check whether an output file can be written.
@@ -424,26 +556,47 @@ static int conf_verify(const cfg_t *cfg, CONF *conf) {
     }
   }
 
-  /* INPUT_FILES */
-  CHECK_EXIST_PARAM(INPUT_FILES, cfg, &conf->ilist);
-  if ((e = check_input(conf->ilist, "INPUT_FILES"))) return e;
+  /* STDIO */
+  if (!cfg_is_set(cfg, &conf->stdio)) conf->stdio = DEFAULT_STDIO;
 
-  /* Read filenames of input catalogues. */
+  /* INPUT_FILES */
   size_t ncat;
-  if (read_fname(conf->ilist, &conf->input, &ncat) == 0)
-    return BRICKMASK_ERR_FILE;
-  if (ncat > BRICKMASK_MAX_NUM_CAT) {
-    P_ERR("number of files in " FMT_KEY(INPUT_FILES) " cannot exceed %d\n",
-        BRICKMASK_MAX_NUM_CAT);
-    return BRICKMASK_ERR_FILE;
+  if (conf->stdio) {
+    /* The standard input is the only input catalog. */
+    if (cfg_is_set(cfg, &conf->ilist))
+      P_WRN(FMT_KEY(INPUT_FILES) " is omitted in the STDIO mode\n");
+    if (!(conf->input = calloc(1, sizeof(char *))) ||
+        !(conf->input[0] = malloc(sizeof(BRICKMASK_STDIN_NAME)))) {
+      P_ERR("failed to allocate memory for the name of the standard input\n");
+      return BRICKMASK_ERR_MEMORY;
+    }
+    memcpy(conf->input[0], BRICKMASK_STDIN_NAME, sizeof(BRICKMASK_STDIN_NAME));
+    conf->ncat = 1;
+  }
+  else {
+    CHECK_EXIST_PARAM(INPUT_FILES, cfg, &conf->ilist);
+    if ((e = check_input(conf->ilist, "INPUT_FILES"))) return e;
+
+    /* Read filenames of input catalogues. */
+    if (read_fname(conf->ilist, &conf->input, &ncat) == 0)
+      return BRICKMASK_ERR_FILE;
+    if (ncat > BRICKMASK_MAX_NUM_CAT) {
+      P_ERR("number of files in " FMT_KEY(INPUT_FILES) " cannot exceed %d\n",
+          BRICKMASK_MAX_NUM_CAT);
+      return BRICKMASK_ERR_FILE;
+    }
+    conf->ncat = ncat;
   }
-  conf->ncat = ncat;
   for (int i = 0; i < conf->ncat; i++) {
     if ((e = check_input(conf->input[i], "INPUT_FILES"))) return e;
   }
 
   /* FILE_TYPE */
   if (!cfg_is_set(cfg, &conf->ftype)) conf->ftype = DEFAULT_FILE_TYPE;
+  if (conf->stdio && conf->ftype != BRICKMASK_FFMT_ASCII) {
+    P_ERR(FMT_KEY(STDIO) " requires ASCII-format catalogs\n");
+    return BRICKMASK_ERR_CFG;
+  }
   switch (conf->ftype) {
     case BRICKMASK_FFMT_ASCII:
       /* ASCII_COMMENT */
@@ -454,9 +607,44 @@ static int conf_verify(const cfg_t *cfg, CONF *conf) {
             conf->comment, conf->comment);
         return BRICKMASK_ERR_CFG;
       }
+      /* ASCII_MMAP */
+      if (!cfg_is_set(cfg, &conf->amap)) conf->amap = DEFAULT_ASCII_MMAP;
+      else if (conf->stdio && conf->amap)
+        P_WRN(FMT_KEY(ASCII_MMAP) " is disabled in the STDIO mode\n");
+      if (conf->stdio) conf->amap = false;
+      /* Compressed catalogues are decompressed as streams. */
+      for (int i = 0; i < conf->ncat; i++) {
+        BRICKMASK_comp_t comp = input_compression(conf->input[i]);
+        if (!compression_supported(comp)) {
+          P_ERR("compressed " FMT_KEY(INPUT_FILES) " is not supported by "
+              "this build: `%s'\n", conf->input[i]);
+          return BRICKMASK_ERR_CFG;
+        }
+        if (comp != BRICKMASK_COMP_NONE && conf->amap) {
+          P_WRN(FMT_KEY(ASCII_MMAP) " is disabled for compressed inputs\n");
+          conf->amap = false;
+        }
+      }
       break;
     case BRICKMASK_FFMT_FITS:
       break;
+    case BRICKMASK_FFMT_NPY:
+      /* Inputs are either all structured arrays or all directories. */
+      for (int i = 1; i < conf->ncat; i++) {
+        if (is_dir(conf->input[i]) != is_dir(conf->input[0])) {
+          P_ERR("NumPy-format " FMT_KEY(INPUT_FILES) " must be either all "
+              "files or all directories\n");
+          return BRICKMASK_ERR_CFG;
+        }
+      }
+      break;
+    case BRICKMASK_FFMT_HDF5:
+#ifndef HDF5
+      P_ERR("HDF5-format " FMT_KEY(INPUT_FILES) " are not supported by this "
+          "build\n");
+      return BRICKMASK_ERR_CFG;
+#endif
+      break;
     default:
       P_ERR("invalid " FMT_KEY(FILE_TYPE) ": %d\n", conf->ftype);
       return BRICKMASK_ERR_CFG;
@@ -489,28 +677,160 @@ static int conf_verify(const cfg_t *cfg, CONF *conf) {
     return BRICKMASK_ERR_CFG;
   }
 
+  /* INPUT_SELECTION */
+  if (cfg_is_set(cfg, &conf->sel)) {
+    const char *c = conf->sel;
+    while (isspace((unsigned char) *c)) c++;
+    if (*c == '\0') {          /* treat empty selection as no selection */
+      free(conf->sel);
+      conf->sel = NULL;
+    }
+    else if (conf->ftype == BRICKMASK_FFMT_NPY ||
+        conf->ftype == BRICKMASK_FFMT_HDF5) {
+      P_ERR(FMT_KEY(INPUT_SELECTION) " is not supported for NumPy- or "
+          "HDF5-format inputs\n");
+      return BRICKMASK_ERR_CFG;
+    }
+  }
+
+  /* INPUT_THREADS */
+  if (!cfg_is_set(cfg, &conf->nread)) conf->nread = DEFAULT_INPUT_THREADS;
+  if (conf->nread <= 0) {
+    P_ERR(FMT_KEY(INPUT_THREADS) " must be positive\n");
+    return BRICKMASK_ERR_CFG;
+  }
+#ifndef OMP
+  if (conf->nread > 1) {
+    P_WRN(FMT_KEY(INPUT_THREADS) " is omitted without OpenMP\n");
+    conf->nread = 1;
+  }
+#endif
+
+  /* FITS_ROW_CACHE */
+  if (!cfg_is_set(cfg, &conf->rcache)) conf->rcache = DEFAULT_FITS_ROW_CACHE;
+  if (conf->rcache < 0) {
+    P_ERR(FMT_KEY(FITS_ROW_CACHE) " must be non-negative\n");
+    return BRICKMASK_ERR_CFG;
+  }
+
+  /* SHARD */
+  conf->ishard = conf->nshard = 0;
+  if (cfg_is_set(cfg, &conf->shard)) {
+    char c;
+    if (sscanf(conf->shard, "%d / %d %c", &conf->ishard, &conf->nshard, &c)
+        != 2 || conf->nshard <= 0 || conf->ishard < 0 ||
+        conf->ishard >= conf->nshard) {
+      P_ERR("invalid " FMT_KEY(SHARD) ": `%s'\n"
+          "it must be \"K/N\", with 0 <= K < N\n", conf->shard);
+      return BRICKMASK_ERR_CFG;
+    }
+  }
+
+  /* MERGE_SHARD */
+  if (!cfg_is_set(cfg, &conf->merge)) conf->merge = DEFAULT_MERGE_SHARD;
+  if (conf->merge && conf->nshard) {
+    P_ERR(FMT_KEY(SHARD) " and " FMT_KEY(MERGE_SHARD) " cannot be set at "
+        "the same time\n");
+    return BRICKMASK_ERR_CFG;
+  }
+
+  /* SHARD_DIR */
+  if (conf->nshard || conf->merge) {
+    CHECK_EXIST_PARAM(SHARD_DIR, cfg, &conf->shdir);
+    if (conf->shdir[0] == '\0') {
+      P_ERR(FMT_KEY(SHARD_DIR) " is empty\n");
+      return BRICKMASK_ERR_CFG;
+    }
+    if (access(conf->shdir, (conf->merge) ? R_OK | X_OK : W_OK | X_OK)) {
+      P_ERR("cannot access " FMT_KEY(SHARD_DIR) ": `%s'\n", conf->shdir);
+      return BRICKMASK_ERR_FILE;
+    }
+  }
+
   /* OVERWRITE */
   if (!cfg_is_set(cfg, &conf->ovwrite)) conf->ovwrite = DEFAULT_OVERWRITE;
 
+  /* MASK_ONLY */
+  if (!cfg_is_set(cfg, &conf->monly)) conf->monly = DEFAULT_MASK_ONLY;
+  if (conf->monly < BRICKMASK_MONLY_NONE || conf->monly > BRICKMASK_MONLY_BIN) {
+    P_ERR("invalid " FMT_KEY(MASK_ONLY) ": %d\n", conf->monly);
+    return BRICKMASK_ERR_CFG;
+  }
+  if (conf->monly && conf->stdio) {
+    P_WRN(FMT_KEY(MASK_ONLY) " is omitted in the STDIO mode\n");
+    conf->monly = BRICKMASK_MONLY_NONE;
+  }
+  /* Rows of the outputs have to be aligned with the inputs. */
+  if (conf->monly && conf->sel) {
+    P_ERR(FMT_KEY(MASK_ONLY) " cannot be set with " FMT_KEY(INPUT_SELECTION)
+        "\n");
+    return BRICKMASK_ERR_CFG;
+  }
+  /* Columns of the input catalogs are not kept. */
+  if (conf->monly) conf->amap = false;
+
+  /* OUTPUT_THREADS */
+  if (!cfg_is_set(cfg, &conf->nsave)) conf->nsave = DEFAULT_OUTPUT_THREADS;
+  if (conf->nsave <= 0) {
+    P_ERR(FMT_KEY(OUTPUT_THREADS) " must be positive\n");
+    return BRICKMASK_ERR_CFG;
+  }
+#ifndef OMP
+  if (conf->nsave > 1) {
+    P_WRN(FMT_KEY(OUTPUT_THREADS) " is omitted without OpenMP\n");
+    conf->nsave = 1;
+  }
+#endif
+
   /* OUTPUT_FILES */
-  CHECK_EXIST_PARAM(OUTPUT_FILES, cfg, &conf->olist);
-  if  ((e = check_input(conf->olist, "OUTPUT_FILES"))) return e;
+  const bool npy_dir = (conf->ftype == BRICKMASK_FFMT_NPY && !conf->monly &&
+      is_dir(conf->input[0]));
+  if (conf->stdio) {
+    /* Objects are written to the standard output. */
+    if (cfg_is_set(cfg, &conf->olist))
+      P_WRN(FMT_KEY(OUTPUT_FILES) " is omitted in the STDIO mode\n");
+  }
+  else {
+    CHECK_EXIST_PARAM(OUTPUT_FILES, cfg, &conf->olist);
+    if  ((e = check_input(conf->olist, "OUTPUT_FILES"))) return e;
 
-  /* Read filenames of output catalogs. */
-  if (read_fname(conf->olist, &conf->output, &ncat) == 0)
-    return BRICKMASK_ERR_FILE;
-  if ((size_t) conf->ncat != ncat) {
-    P_ERR("different numbers of files in " FMT_KEY(INPUT_FILES) " and "
-        FMT_KEY(OUTPUT_FILES) "\n");
-    return BRICKMASK_ERR_FILE;
+    /* Read filenames of output catalogs. */
+    if (read_fname(conf->olist, &conf->output, &ncat) == 0)
+      return BRICKMASK_ERR_FILE;
+    if ((size_t) conf->ncat != ncat) {
+      P_ERR("different numbers of files in " FMT_KEY(INPUT_FILES) " and "
+          FMT_KEY(OUTPUT_FILES) "\n");
+      return BRICKMASK_ERR_FILE;
+    }
   }
-  for (int i = 0; i < conf->ncat; i++) {
+  /* Output catalogs are not written by shards. */
+  for (int i = 0; conf->output && !conf->nshard && i < conf->ncat; i++) {
+    /* Arrays in output directories are checked with `MASKBIT_COLUMN`. */
+    if (npy_dir) {
+      if (!access(conf->output[i], F_OK) && !is_dir(conf->output[i])) {
+        P_ERR(FMT_KEY(OUTPUT_FILES) " must be directories for directories of "
+            "NumPy arrays: `%s'\n", conf->output[i]);
+        return BRICKMASK_ERR_CFG;
+      }
+      continue;
+    }
     if ((e = check_output(conf->output[i], "OUTPUT_FILES", conf->ovwrite)))
       return e;
+    if (conf->ftype == BRICKMASK_FFMT_ASCII && !conf->monly &&
+        !compression_supported(output_compression(conf->output[i]))) {
+      P_ERR("compressed " FMT_KEY(OUTPUT_FILES) " is not supported by "
+          "this build: `%s'\n", conf->output[i]);
+      return BRICKMASK_ERR_CFG;
+    }
   }
 
   /* OUTPUT_COLUMN */
-  if ((conf->ncol = cfg_get_size(cfg, &conf->ocol))) {
+  if (conf->monly) {
+    if (cfg_get_size(cfg, &conf->ocol))
+      P_WRN(FMT_KEY(OUTPUT_COLUMN) " is omitted with " FMT_KEY(MASK_ONLY) "\n");
+    conf->ncol = 0;
+  }
+  else if ((conf->ncol = cfg_get_size(cfg, &conf->ocol))) {
     if (conf->ftype == BRICKMASK_FFMT_ASCII) {
       if (!(conf->onum = calloc(conf->ncol, sizeof(int)))) {
         P_ERR("failed to allocate memory for " FMT_KEY(OUTPUT_COLUMN) "\n");
@@ -571,7 +891,9 @@ static int conf_verify(const cfg_t *cfg, CONF *conf) {
   }
 
   /* MASKBIT_COLUMN */
-  if (conf->ftype == BRICKMASK_FFMT_FITS) {
+  if ((conf->ftype != BRICKMASK_FFMT_ASCII && !conf->monly) ||
+      conf->monly == BRICKMASK_MONLY_FITS ||
+      conf->monly == BRICKMASK_MONLY_NPY) {
     if (!cfg_is_set(cfg, &conf->mcol)) {
       P_ERR(FMT_KEY(MASKBIT_COLUMN) " is not set\n");
       return BRICKMASK_ERR_CFG;
@@ -611,6 +933,79 @@ static int conf_verify(const cfg_t *cfg, CONF *conf) {
     }
   }
 
+  /* Arrays to be written to the output directories. */
+  if (npy_dir) {
+    if (conf->ncol) {
+      P_WRN(FMT_KEY(OUTPUT_COLUMN) " is omitted for directories of NumPy "
+          "arrays\n");
+    }
+    for (int i = 0; !conf->nshard && i < conf->ncat; i++) {
+      const char *name[2] = {conf->mcol, BRICKMASK_FITS_SUBID};
+      for (int j = 0; j < ((conf->subid) ? 2 : 1); j++) {
+        char *fname = npy_path(conf->output[i], name[j]);
+        if (!fname) return BRICKMASK_ERR_MEMORY;
+        e = check_output(fname, "OUTPUT_FILES", conf->ovwrite);
+        free(fname);
+        if (e) return e;
+      }
+    }
+  }
+
+  /* STREAM_CHUNK */
+  if (!cfg_is_set(cfg, &conf->nchunk)) conf->nchunk = DEFAULT_STREAM_CHUNK;
+  if (conf->nchunk < 0) {
+    P_ERR(FMT_KEY(STREAM_CHUNK) " must be non-negative\n");
+    return BRICKMASK_ERR_CFG;
+  }
+  if (conf->nchunk && (conf->nshard || conf->merge)) {
+    P_WRN(FMT_KEY(STREAM_CHUNK) " is omitted for shards\n");
+    conf->nchunk = 0;
+  }
+
+  /* CHECKPOINT_DIR */
+  if (cfg_is_set(cfg, &conf->ckdir)) {
+    if (conf->ckdir[0] == '\0') {
+      P_ERR(FMT_KEY(CHECKPOINT_DIR) " is empty\n");
+      return BRICKMASK_ERR_CFG;
+    }
+    if (access(conf->ckdir, W_OK | X_OK)) {
+      P_ERR("cannot write to " FMT_KEY(CHECKPOINT_DIR) ": `%s'\n",
+          conf->ckdir);
+      return BRICKMASK_ERR_FILE;
+    }
+  }
+
+  /* RESUME */
+  if (!cfg_is_set(cfg, &conf->resume)) conf->resume = DEFAULT_RESUME;
+  if (conf->resume && !conf->ckdir) {
+    P_ERR(FMT_KEY(RESUME) " requires " FMT_KEY(CHECKPOINT_DIR) "\n");
+    return BRICKMASK_ERR_CFG;
+  }
+
+  /* STDIO_WINDOW */
+  if (conf->stdio) {
+    if (conf->nshard || conf->merge) {
+      P_ERR(FMT_KEY(STDIO) " cannot be used with " FMT_KEY(SHARD) " or "
+          FMT_KEY(MERGE_SHARD) "\n");
+      return BRICKMASK_ERR_CFG;
+    }
+    if (conf->nchunk) {
+      P_WRN(FMT_KEY(STREAM_CHUNK) " is omitted in the STDIO mode\n");
+      conf->nchunk = 0;
+    }
+    if (conf->ckdir) {
+      P_WRN(FMT_KEY(CHECKPOINT_DIR) " is omitted in the STDIO mode\n");
+      free(conf->ckdir);
+      conf->ckdir = NULL;
+      conf->resume = false;
+    }
+    if (!cfg_is_set(cfg, &conf->nwin)) conf->nwin = DEFAULT_STDIO_WINDOW;
+    if (conf->nwin <= 0) {
+      P_ERR(FMT_KEY(STDIO_WINDOW) " must be positive\n");
+      return BRICKMASK_ERR_CFG;
+    }
+  }
+
   /* VERBOSE */
   if (!cfg_is_set(cfg, &conf->verbose)) conf->verbose = DEFAULT_VERBOSE;
 
@@ -641,18 +1036,23 @@ static void conf_print(const CONF *conf) {
     printf("\n  SUBSAMPLE_ID    = %d", conf->subid[0]);
     for (int i = 1; i < conf->nsub; i++) printf(" , %d", conf->subid[i]);
   }
-  printf("\n  INPUT_FILES     = %s", conf->ilist);
+  if (!conf->stdio) printf("\n  INPUT_FILES     = %s", conf->ilist);
 
-  const char *ftype[2] = {"ASCII", "FITS"};
+  const char *ftype[4] = {"ASCII", "FITS", "NumPy", "HDF5"};
   printf("\n  FILE_TYPE       = %d (%s)", conf->ftype, ftype[conf->ftype]);
   if (conf->ftype == BRICKMASK_FFMT_ASCII) {
     if (conf->comment == 0) printf("\n  ASCII_COMMENT   = ''");
     else printf("\n  ASCII_COMMENT   = '%c'", conf->comment);
+    printf("\n  ASCII_MMAP      = %c", conf->amap ? 'T' : 'F');
     printf("\n  COORD_COLUMN    = %d , %d", conf->cnum[0], conf->cnum[1]);
   }
   else printf("\n  COORD_COLUMN    = %s , %s", conf->cname[0], conf->cname[1]);
+  if (conf->sel) printf("\n  INPUT_SELECTION = %s", conf->sel);
+  if (conf->nread > 1) printf("\n  INPUT_THREADS   = %d", conf->nread);
+  if (conf->ftype == BRICKMASK_FFMT_FITS)
+    printf("\n  FITS_ROW_CACHE  = %ld", conf->rcache);
 
-  printf("\n  OUTPUT_FILES    = %s", conf->olist);
+  if (!conf->stdio) printf("\n  OUTPUT_FILES    = %s", conf->olist);
   if (conf->ncol) {
     if (conf->ftype == BRICKMASK_FFMT_ASCII) {
       printf("\n  OUTPUT_COLUMN   = %d", conf->onum[0]);
@@ -663,10 +1063,34 @@ static void conf_print(const CONF *conf) {
       for (int i = 1; i < conf->ncol; i++) printf(" , %s", conf->ocol[i]);
     }
   }
-  if (conf->ftype == BRICKMASK_FFMT_FITS)
+  if (conf->mcol && (conf->ftype != BRICKMASK_FFMT_ASCII || conf->monly))
     printf("\n  MASKBIT_COLUMN  = %s", conf->mcol);
+  if (conf->monly) {
+    const char *monly[3] = {"FITS", "NumPy", "binary"};
+    printf("\n  MASK_ONLY       = %d (%s)", conf->monly,
+        monly[conf->monly - 1]);
+  }
+  if (conf->nsave > 1) printf("\n  OUTPUT_THREADS  = %d", conf->nsave);
 
-  printf("\n  OVERWRITE       = %d\n", conf->ovwrite);
+  printf("\n  OVERWRITE       = %d", conf->ovwrite);
+  printf("\n  STREAM_CHUNK    = %ld", conf->nchunk);
+  if (conf->nshard) {
+    printf("\n  SHARD           = %d / %d", conf->ishard, conf->nshard);
+    printf("\n  SHARD_DIR       = %s", conf->shdir);
+  }
+  else if (conf->merge) {
+    printf("\n  SHARD_DIR       = %s", conf->shdir);
+    printf("\n  MERGE_SHARD     = T");
+  }
+  if (conf->ckdir) {
+    printf("\n  CHECKPOINT_DIR  = %s", conf->ckdir);
+    printf("\n  RESUME          = %c", conf->resume ? 'T' : 'F');
+  }
+  if (conf->stdio) {
+    printf("\n  STDIO           = T");
+    printf("\n  STDIO_WINDOW    = %ld", conf->nwin);
+  }
+  printf("\n");
 }
 
 
@@ -693,6 +1117,15 @@ CONF *load_conf(const int argc, char *const *argv) {
     return NULL;
   }
 
+  /* The standard output is reserved for objects in the STDIO mode. */
+  if (cfg_is_set(cfg, &conf->stdio) && conf->stdio &&
+      (conf->ofd = stdout_detach()) < 0) {
+    if (cfg_is_set(cfg, &conf->fconf)) free(conf->fconf);
+    conf_destroy(conf);
+    cfg_destroy(cfg);
+    return NULL;
+  }
+
   printf("Loading configurations ...");
   fflush(stdout);
 
@@ -726,10 +1159,14 @@ void conf_destroy(CONF *conf) {
   FREE_ARRAY(conf->ilist);
   FREE_STR_ARRAY(conf->input);
   FREE_STR_ARRAY(conf->cname);
+  FREE_ARRAY(conf->sel);
   FREE_ARRAY(conf->olist);
   FREE_STR_ARRAY(conf->output);
   FREE_STR_ARRAY(conf->ocol);
   FREE_ARRAY(conf->onum);
   FREE_ARRAY(conf->mcol);
+  FREE_ARRAY(conf->ckdir);
+  FREE_ARRAY(conf->shard);
+  FREE_ARRAY(conf->shdir);
   free(conf);
 }
@@ -50,15 +50,32 @@ typedef struct {
   int ncat;             /* Number of input/output catalogues. */
   int ftype;            /* FILE_TYPE            */
   char comment;         /* ASCII_COMMENT        */
+  bool amap;            /* ASCII_MMAP           */
   char **cname;         /* COORD_COLUMN         */
   int cnum[2];          /* Column number of (RA,Dec) for ASCII input. */
+  char *sel;            /* INPUT_SELECTION      */
+  int nread;            /* INPUT_THREADS        */
+  long rcache;          /* FITS_ROW_CACHE       */
   char *olist;          /* OUTPUT_FILES         */
   char **output;        /* Output catalogs.     */
   char **ocol;          /* OUTPUT_COLUMN        */
   int ncol;             /* Number of output columns. */
   int *onum;            /* Column numbers to be saved to the output. */
   char *mcol;           /* MASKBIT_COLUMN       */
+  int monly;            /* MASK_ONLY            */
+  int nsave;            /* OUTPUT_THREADS       */
   int ovwrite;          /* OVERWRITE            */
+  long nchunk;          /* STREAM_CHUNK         */
+  char *ckdir;          /* CHECKPOINT_DIR       */
+  bool resume;          /* RESUME               */
+  char *shard;          /* SHARD                */
+  int ishard;           /* Index of the shard.  */
+  int nshard;           /* Number of shards, 0 for no sharding. */
+  char *shdir;          /* SHARD_DIR            */
+  bool merge;           /* MERGE_SHARD          */
+  bool stdio;           /* STDIO                */
+  long nwin;            /* STDIO_WINDOW         */
+  int ofd;              /* Descriptor of the standard output for data. */
   bool verbose;         /* VERBOSE              */
 } CONF;
 
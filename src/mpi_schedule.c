@@ -14,11 +14,14 @@
 #ifdef MPI
 #include "define.h"
 #include "mpi_schedule.h"
+#include "sort_data.h"
+#include "assign_mask.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
+#include <fitsio.h>
 #include <mpi.h>
 
 /* Define the MPI data type for size_t */
@@ -36,147 +39,454 @@
   #error "MPI root rank must be 0"
 #endif
 
+/* Maximum number of messages for transferring an array with a single task. */
+#if MPI_VERSION >= 4
+  #define BRICKMASK_MPI_NMSG    1
+#else
+  #define BRICKMASK_MPI_NMSG    2
+#endif
+
+/* Tags of messages for transferring data arrays. */
+typedef enum {
+  BRICKMASK_MPI_TAG_RA = 1,
+  BRICKMASK_MPI_TAG_DEC = 2,
+  BRICKMASK_MPI_TAG_ID = 3,
+  BRICKMASK_MPI_TAG_MASK = 4,
+  BRICKMASK_MPI_TAG_SUBID = 5,
+  BRICKMASK_MPI_TAG_CHUNK = 6,          /* header of a data chunk       */
+  BRICKMASK_MPI_TAG_CDATA = 7,          /* contents of a data chunk     */
+  BRICKMASK_MPI_TAG_RESULT = 8,         /* header of results of a chunk */
+  BRICKMASK_MPI_TAG_RDATA = 9           /* results of a chunk           */
+} BRICKMASK_mpi_tag_t;
+
+/* Index of a chunk indicating that the worker is ready for a new chunk. */
+#define BRICKMASK_MPI_READY     SIZE_MAX
+
+/* Record of a data chunk processed by a worker. */
+typedef struct {
+  size_t n;             /* number of objects in the chunk               */
+  size_t *idx;          /* indices of the objects in the full catalogue */
+  int mtype;            /* data type of maskbits of the chunk           */
+  void *res;            /* packed maskbits, followed by subsample IDs   */
+} STREAM_CHUNK;
+
+/* Scheduler of data chunks on the root task. */
+typedef struct {
+  const BRICK *brick;   /* structure for bricks                         */
+  bool subid;           /* indicate whether subsample IDs are required  */
+  int nhead;            /* number of elements in a chunk header         */
+  size_t csize;         /* number of objects per chunk                  */
+  size_t nsent;         /* number of objects sent to workers            */
+  size_t nchunk;        /* number of chunks sent to workers             */
+  size_t nmax;          /* number of chunk records allocated            */
+  STREAM_CHUNK *chunk;  /* records of chunks                            */
+  int nidle;            /* number of idle workers                       */
+  int *idle;            /* ranks of idle workers                        */
+  size_t *head;         /* chunk headers for each worker                */
+  char **buf;           /* chunk contents for each worker               */
+  int *nreq;            /* number of pending messages for each worker   */
+  MPI_Request *req;     /* requests of messages for each worker         */
+} STREAM;
+
+/* Maximum number of pending messages for sending a chunk to a worker. */
+#define BRICKMASK_MPI_CHUNK_NREQ        (1 + BRICKMASK_MPI_NMSG)
+
 /*============================================================================*\
-                 Functions for sharing information with workers
+                   Functions for large-count communications
 \*============================================================================*/
 
 /******************************************************************************
-Function `mpi_bcast_brick`:
-  Broadcast information of bricks.
+Function `mpi_ipost_large`:
+  Post non-blocking messages for sending or receiving an array with arbitrary
+  length. The array is split into blocks of `BRICKMASK_MPI_BLOCK` elements and
+  the rest, unless large-count functions of MPI-4 are available.
 Arguments:
-  * `brick`:    structure for storing information of bricks.
+  * `buf`:      address of the array;
+  * `n`:        number of elements;
+  * `dtype`:    MPI data type of the elements;
+  * `peer`:     rank of the destination or source task;
+  * `tag`:      tag of the messages;
+  * `send`:     true for sending the array, and false for receiving it;
+  * `req`:      requests for the messages.
+Return:
+  Number of requests posted, at most `BRICKMASK_MPI_NMSG`.
 ******************************************************************************/
-static void mpi_bcast_brick(BRICK **brick) {
-  int rank;
-  if (MPI_Comm_rank(MPI_COMM_WORLD, &rank))
+static int mpi_ipost_large(void *buf, const size_t n, MPI_Datatype dtype,
+    const int peer, const int tag, const bool send, MPI_Request *req) {
+  if (!n) return 0;
+  const char *act = (send) ? "send data to" : "receive data from";
+#if MPI_VERSION >= 4
+  if ((send) ?
+      MPI_Isend_c(buf, (MPI_Count) n, dtype, peer, tag, MPI_COMM_WORLD, req) :
+      MPI_Irecv_c(buf, (MPI_Count) n, dtype, peer, tag, MPI_COMM_WORLD, req)) {
+    P_ERR("failed to %s task %d\n", act, peer);
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+  return 1;
+#else
+  const size_t nblk = n / BRICKMASK_MPI_BLOCK;
+  const size_t nrest = n - nblk * BRICKMASK_MPI_BLOCK;
+  if (nblk > INT_MAX) {
+    P_ERR("too many elements for messages with task %d: %zu\n", peer, n);
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
 
-  if (rank != BRICKMASK_MPI_ROOT && !(*brick = calloc(1, sizeof(BRICK)))) {
-    P_ERR("failed to allocate memory for task-private brick information\n");
-    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  int nreq = 0;
+  if (nblk) {
+    MPI_Datatype btype;
+    if (MPI_Type_contiguous(BRICKMASK_MPI_BLOCK, dtype, &btype) ||
+        MPI_Type_commit(&btype) || ((send) ?
+        MPI_Isend(buf, nblk, btype, peer, tag, MPI_COMM_WORLD, req + nreq) :
+        MPI_Irecv(buf, nblk, btype, peer, tag, MPI_COMM_WORLD, req + nreq)) ||
+        MPI_Type_free(&btype)) {
+      P_ERR("failed to %s task %d\n", act, peer);
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+    nreq++;
   }
-  BRICK *b = *brick;
-  if (rank != BRICKMASK_MPI_ROOT) {
-    b->ra1 = b->ra2 = b->dec1 = b->dec2 = NULL;
-    b->name = NULL;
-    b->subid = NULL;
-    b->nmask = NULL;
-    b->fmask = NULL;
-    b->mlen = NULL;
+  if (nrest) {
+    MPI_Aint lb, extent;
+    if (MPI_Type_get_extent(dtype, &lb, &extent)) {
+      P_ERR("failed to %s task %d\n", act, peer);
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+    char *rest = (char *) buf + nblk * BRICKMASK_MPI_BLOCK * extent;
+    if ((send) ?
+        MPI_Isend(rest, nrest, dtype, peer, tag, MPI_COMM_WORLD, req + nreq) :
+        MPI_Irecv(rest, nrest, dtype, peer, tag, MPI_COMM_WORLD, req + nreq)) {
+      P_ERR("failed to %s task %d\n", act, peer);
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+    nreq++;
   }
+  return nreq;
+#endif
+}
 
-  /* Broadcast number of bricks and length of brick names. */
-  MPI_Request req[3];
-  if (MPI_Ibcast(&b->n, 1, MY_MPI_SIZE_T, BRICKMASK_MPI_ROOT,
-      MPI_COMM_WORLD, req) || MPI_Ibcast(&b->nlen, 1, MPI_INT,
-      BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 1) ||
-      MPI_Waitall(2, req, MPI_STATUSES_IGNORE)) {
-    P_ERR("failed to broadcast brick information\n");
-    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+/******************************************************************************
+Function `mpi_isend_large`:
+  Send an array with arbitrary length to a task, with non-blocking messages.
+Arguments:
+  * `buf`:      address of the array to be sent;
+  * `n`:        number of elements to be sent;
+  * `dtype`:    MPI data type of the elements;
+  * `dest`:     rank of the destination task;
+  * `tag`:      tag of the messages;
+  * `req`:      requests for the messages.
+Return:
+  Number of requests posted, at most `BRICKMASK_MPI_NMSG`.
+******************************************************************************/
+static inline int mpi_isend_large(const void *buf, const size_t n,
+    MPI_Datatype dtype, const int dest, const int tag, MPI_Request *req) {
+  /* The array is not modified, as it is only sent. */
+  return mpi_ipost_large((void *) buf, n, dtype, dest, tag, true, req);
+}
+
+/******************************************************************************
+Function `mpi_irecv_large`:
+  Receive an array with arbitrary length from a task, with non-blocking
+  messages, in the same way as `mpi_isend_large`.
+Arguments:
+  * `buf`:      address of the array for receiving data;
+  * `n`:        number of elements to be received;
+  * `dtype`:    MPI data type of the elements;
+  * `src`:      rank of the source task;
+  * `tag`:      tag of the messages;
+  * `req`:      requests for the messages.
+Return:
+  Number of requests posted, at most `BRICKMASK_MPI_NMSG`.
+******************************************************************************/
+static inline int mpi_irecv_large(void *buf, const size_t n,
+    MPI_Datatype dtype, const int src, const int tag, MPI_Request *req) {
+  return mpi_ipost_large(buf, n, dtype, src, tag, false, req);
+}
+
+/*============================================================================*\
+                 Functions for sharing information with workers
+\*============================================================================*/
+
+/******************************************************************************
+Function `mpi_split_data`:
+  Split the data into segments for different tasks, by brick IDs.
+Arguments:
+  * `data`:     structure for storing the input data;
+  * `size`:     number of MPI tasks;
+  * `nsend`:    number of objects for each task;
+  * `disp`:     starting index of the objects for each task.
+******************************************************************************/
+static void mpi_split_data(const DATA *data, const int size, size_t *nsend,
+    size_t *disp) {
+  long num = data->nbrick / size;       /* number of bricks per worker */
+  long num0 = data->nbrick - num * (size - 1);  /* number of bricks for root */
+
+  /* Count the number of data associated with each brick. */
+  long prev = -1;
+  long cnt = -1;
+  size_t i_prev = 0;
+  for (size_t i = 0; i < data->n; i++) {
+    if (data->id[i] != prev) {
+      prev = data->id[i];
+      if (++cnt == num0) {
+        i_prev = i;
+        break;
+      }
+    }
+  }
+  if (!i_prev) i_prev = data->n;
+  int wid = 0;
+  nsend[wid++] = i_prev;        /* number of data to be processed by root */
+  for (size_t i = i_prev; i < data->n; i++) {
+    if (data->id[i] != prev) {
+      prev = data->id[i];
+      if (++cnt == num0 + num * wid) {
+        /* Compute the length of data for this worker. */
+        nsend[wid] = i - i_prev;
+        disp[wid] = disp[wid - 1] + nsend[wid - 1];
+        if (wid++ == size) {
+          P_ERR("unexpected number of MPI tasks\n");
+          MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_UNKNOWN);
+        }
+        i_prev = i;
+      }
+    }
   }
+  if (wid != size) {
+    nsend[wid] = data->n - i_prev;
+    disp[wid] = disp[wid - 1] + nsend[wid - 1];
+  }
+}
 
-  /* Allocate memory for brick names. */
-  if (rank != BRICKMASK_MPI_ROOT) {
-    if (!(b->name = malloc(b->n * sizeof(char *)))) {
-      P_ERR("failed to allocate memory for task-private brick information\n");
+/******************************************************************************
+Function `mpi_pack_brick`:
+  Pack the maskbit files of bricks for each task, and replace brick IDs of
+  the data with dense indices of bricks for the corresponding task.
+Arguments:
+  * `brick`:    structure for storing information of bricks;
+  * `data`:     structure for storing the input data;
+  * `size`:     number of MPI tasks;
+  * `nsend`:    number of objects for each task;
+  * `disp`:     starting index of the objects for each task;
+  * `head`:     number of bricks, and number & length of maskbit files of
+                each subsample, for each task;
+  * `fidx`:     indices of maskbit files for bricks of all tasks;
+  * `fname`:    maskbit filenames for all tasks;
+  * `cnt`:      number of indices and characters for each task;
+  * `off`:      offsets of indices and characters for each task.
+******************************************************************************/
+static void mpi_pack_brick(const BRICK *brick, DATA *data, const int size,
+    const size_t *nsend, const size_t *disp, size_t *head, long **fidx,
+    char **fname, int *cnt, int *off) {
+  const int nsp = brick->nsp;
+  const int nhead = 1 + 2 * nsp;
+
+  /* Count bricks and maskbit files for each task. */
+  size_t nidx, nchar;
+  nidx = nchar = 0;
+  for (int r = 0; r < size; r++) {
+    size_t *h = head + r * nhead;
+    long prev = -1;
+    for (size_t i = disp[r]; i < disp[r] + nsend[r]; i++) {
+      if (data->id[i] == prev) continue;
+      prev = data->id[i];
+      h[0]++;
+      const long *idx = brick->fidx + prev * nsp;
+      for (int k = 0; k < nsp; k++) {
+        if (idx[k] < 0) continue;
+        h[1 + k]++;
+        h[1 + nsp + k] += strlen(brick->fmask[k][idx[k]]) + 1;
+      }
     }
-    for (size_t i = 0; i < b->n; i++) b->name[i] = NULL;
-    if (!(b->name[0] = malloc(b->n * (b->nlen + 1) * sizeof(char)))) {
-      P_ERR("failed to allocate memory for task-private brick information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+    size_t len = 0;
+    for (int k = 0; k < nsp; k++) len += h[1 + nsp + k];
+    if (h[0] * nsp > INT_MAX - nidx || len > INT_MAX - nchar) {
+      P_ERR("too many maskbit files to be sent to tasks\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
     }
+    cnt[r] = h[0] * nsp;
+    off[r] = nidx;
+    cnt[size + r] = len;
+    off[size + r] = nchar;
+    nidx += h[0] * nsp;
+    nchar += len;
   }
 
-  /* Broadcast brick names and number of subsamples. */
-  if (MPI_Ibcast(b->name[0], b->n * (b->nlen + 1), MPI_CHAR,
-      BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req) || MPI_Ibcast(&b->nsp, 1,
-      MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 1) ||
-      MPI_Waitall(2, req, MPI_STATUSES_IGNORE)) {
-    P_ERR("failed to broadcast brick information\n");
-    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  /* Allocate memory for the packages. */
+  char **pos = malloc(nsp * sizeof(char *));
+  size_t *num = malloc(nsp * sizeof(size_t));
+  if (!pos || !num || !(*fidx = malloc((nidx ? nidx : 1) * sizeof(long))) ||
+      !(*fname = malloc((nchar ? nchar : 1) * sizeof(char)))) {
+    P_ERR("failed to allocate memory for sharing brick information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
   }
 
-  /* Define brick names, and allocate memory for the workers. */
-  if (rank != BRICKMASK_MPI_ROOT) {
-    for (size_t i = 1; i < b->n; i++)
-      b->name[i] = b->name[0] + i * (b->nlen + 1);
+  /* Pack maskbit files and re-index bricks for each task. */
+  for (int r = 0; r < size; r++) {
+    const size_t *h = head + r * nhead;
+    long *pidx = *fidx + off[r];
+    pos[0] = *fname + off[size + r];
+    for (int k = 1; k < nsp; k++) pos[k] = pos[k - 1] + h[nsp + k];
+    for (int k = 0; k < nsp; k++) num[k] = 0;
 
-    if (!(b->subid = malloc(b->nsp * sizeof(int))) ||
-        !(b->nmask = malloc(b->nsp * sizeof(size_t))) ||
-        !(b->mlen = malloc(b->nsp * sizeof(size_t))) ||
-        !(b->fmask = malloc(b->nsp * sizeof(char **)))) {
-      P_ERR("failed to allocate memory for task-private brick information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+    long prev = -1;
+    long bid = -1;
+    for (size_t i = disp[r]; i < disp[r] + nsend[r]; i++) {
+      if (data->id[i] != prev) {
+        prev = data->id[i];
+        bid++;
+        const long *idx = brick->fidx + prev * nsp;
+        for (int k = 0; k < nsp; k++) {
+          if (idx[k] < 0) {
+            pidx[bid * nsp + k] = -1;
+            continue;
+          }
+          pidx[bid * nsp + k] = num[k]++;
+          const char *src = brick->fmask[k][idx[k]];
+          size_t len = strlen(src) + 1;
+          memcpy(pos[k], src, len);
+          pos[k] += len;
+        }
+      }
+      data->id[i] = bid;
     }
-    for (int i = 0; i < b->nsp; i++) b->fmask[i] = NULL;
   }
 
-  /* Broadcast subsample IDs, and number & length of maskbit files. */
-  if (MPI_Ibcast(b->subid, b->nsp, MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD,
-      req) || MPI_Ibcast(b->nmask, b->nsp, MY_MPI_SIZE_T, BRICKMASK_MPI_ROOT,
-      MPI_COMM_WORLD, req + 1) || MPI_Ibcast(b->mlen, b->nsp, MY_MPI_SIZE_T,
-      BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 2) ||
-      MPI_Waitall(3, req, MPI_STATUSES_IGNORE)) {
+  free(pos);
+  free(num);
+}
+
+/******************************************************************************
+Function `mpi_scatter_brick`:
+  Send each task only the maskbit files of bricks for its own data.
+Arguments:
+  * `brick`:    structure for storing information of bricks;
+  * `data`:     structure for storing the input data;
+  * `nsend`:    number of objects for each task;
+  * `disp`:     starting index of the objects for each task.
+******************************************************************************/
+static void mpi_scatter_brick(BRICK **brick, DATA *data, const size_t *nsend,
+    const size_t *disp) {
+  int size, rank;
+  size = rank = 0;
+  if (MPI_Comm_size(MPI_COMM_WORLD, &size) ||
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank))
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+
+  /* Broadcast the number of subsamples, and bit code for null objects. */
+  BRICK *b = *brick;
+  int nsp = 0;
+  uint64_t mnull = 0;
+  if (rank == BRICKMASK_MPI_ROOT) {
+    nsp = b->nsp;
+    mnull = b->mnull;
+  }
+  MPI_Request req[2];
+  if (MPI_Ibcast(&nsp, 1, MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req) ||
+      MPI_Ibcast(&mnull, 1, MPI_UINT64_T, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD,
+      req + 1) || MPI_Waitall(2, req, MPI_STATUSES_IGNORE)) {
     P_ERR("failed to broadcast brick information\n");
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
   }
 
-  /* Allocate memory for maskbit filenames. */
-  if (rank != BRICKMASK_MPI_ROOT) {
-    for (int i = 0; i < b->nsp; i++) {
-      if (b->nmask[i] &&
-          !(b->fmask[i] = malloc(b->nmask[i] * sizeof(char *)))) {
-        P_ERR("failed to allocate memory for task-private brick information\n");
-        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
-      }
-      for (size_t j = 0; j < b->nmask[i]; j++) b->fmask[i][j] = NULL;
-      if (b->nmask[i] &&
-          !(b->fmask[i][0] = malloc(b->mlen[i] * sizeof(char)))) {
-        P_ERR("failed to allocate memory for task-private brick information\n");
-        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
-      }
+  /* Pack information of bricks for each task. */
+  const int nhead = 1 + 2 * nsp;
+  size_t *head = NULL;
+  long *sidx = NULL;
+  char *sname = NULL;
+  int *cnt, *off;
+  cnt = off = NULL;
+  if (rank == BRICKMASK_MPI_ROOT) {
+    if (!(head = calloc((size_t) nhead * size, sizeof(size_t))) ||
+        !(cnt = malloc(2 * size * sizeof(int))) ||
+        !(off = malloc(2 * size * sizeof(int)))) {
+      P_ERR("failed to allocate memory for sharing brick information\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
     }
+    mpi_pack_brick(b, data, size, nsend, disp, head, &sidx, &sname, cnt, off);
   }
 
-  /* Broadcast maskfit filenames. */
-  MPI_Request *nreq = malloc(b->nsp * sizeof *nreq);
-  if (!nreq) {
-    P_ERR("failed to allocate memory for broadcasting brick information\n");
+  /* Initialise the task-private bricks. */
+  BRICK *nb = calloc(1, sizeof(BRICK));
+  size_t *h = malloc(nhead * sizeof(size_t));
+  if (!nb || !h) {
+    P_ERR("failed to allocate memory for task-private brick information\n");
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
   }
-  for (int i = 0; i < b->nsp; i++) {
-    if (MPI_Ibcast(b->fmask[i][0], b->mlen[i], MPI_CHAR, BRICKMASK_MPI_ROOT,
-        MPI_COMM_WORLD, nreq + i)) {
-      P_ERR("failed to broadcast brick information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
-    }
+  nb->ra1 = nb->ra2 = nb->dec1 = nb->dec2 = NULL;
+  nb->name = NULL;
+  nb->fidx = NULL;
+  nb->nsp = nsp;
+  nb->mnull = mnull;
+  if (!(nb->subid = malloc(nsp * sizeof(int))) ||
+      !(nb->nmask = malloc(nsp * sizeof(size_t))) ||
+      !(nb->fmask = malloc(nsp * sizeof(char **)))) {
+    P_ERR("failed to allocate memory for task-private brick information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
   }
+  for (int i = 0; i < nsp; i++) nb->fmask[i] = NULL;
+  if (rank == BRICKMASK_MPI_ROOT)
+    memcpy(nb->subid, b->subid, nsp * sizeof(int));
 
-  if (MPI_Waitall(b->nsp, nreq, MPI_STATUSES_IGNORE)) {
-    P_ERR("failed to broadcast brick information\n");
+  /* Scatter the numbers of bricks and maskbit files, and subsample IDs. */
+  if (MPI_Scatter(head, nhead, MY_MPI_SIZE_T, h, nhead, MY_MPI_SIZE_T,
+      BRICKMASK_MPI_ROOT, MPI_COMM_WORLD) || MPI_Bcast(nb->subid, nsp,
+      MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
+    P_ERR("failed to scatter brick information\n");
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
   }
-  free(nreq);
 
-  if (rank != BRICKMASK_MPI_ROOT) {
-    for (int i = 0; i < b->nsp; i++) {
-      /* Search for individual filenames. */
-      char *end = b->fmask[i][0] + b->mlen[i];
-      for (size_t j = 1; j < b->nmask[i]; j++) {
-        char *p = b->fmask[i][j - 1];
-        b->fmask[i][j] = memchr(p, '\0', end - p) + 1;
-      }
+  /* Scatter indices of maskbit files and the filenames. */
+  nb->n = h[0];
+  const size_t nidx = nb->n * nsp;
+  size_t nchar = 0;
+  for (int i = 0; i < nsp; i++) nchar += h[1 + nsp + i];
+  char *fname = malloc((nchar ? nchar : 1) * sizeof(char));
+  if (!fname || !(nb->fidx = malloc((nidx ? nidx : 1) * sizeof(long)))) {
+    P_ERR("failed to allocate memory for task-private brick information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+  if (MPI_Scatterv(sidx, cnt, off, MPI_LONG, nb->fidx, nidx, MPI_LONG,
+      BRICKMASK_MPI_ROOT, MPI_COMM_WORLD) || MPI_Scatterv(sname,
+      (cnt) ? cnt + size : NULL, (off) ? off + size : NULL, MPI_CHAR, fname,
+      nchar, MPI_CHAR, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
+    P_ERR("failed to scatter brick information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+
+  /* Set maskbit filenames for each subsample. */
+  const char *src = fname;
+  for (int i = 0; i < nsp; i++) {
+    nb->nmask[i] = h[1 + i];
+    if (!nb->nmask[i]) continue;
+    size_t len = h[1 + nsp + i];
+    if (!(nb->fmask[i] = malloc(nb->nmask[i] * sizeof(char *))) ||
+        !(nb->fmask[i][0] = malloc(len * sizeof(char)))) {
+      P_ERR("failed to allocate memory for task-private brick information\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
     }
+    memcpy(nb->fmask[i][0], src, len);
+    src += len;
+    for (size_t j = 1; j < nb->nmask[i]; j++)
+      nb->fmask[i][j] = nb->fmask[i][j - 1] + strlen(nb->fmask[i][j - 1]) + 1;
+  }
+
+  free(fname);
+  free(h);
+  if (rank == BRICKMASK_MPI_ROOT) {
+    free(head); free(sidx); free(sname); free(cnt); free(off);
+    brick_destroy(b);
   }
+  *brick = nb;
 }
 
 /******************************************************************************
 Function `mpi_scatter_data`:
   Scatter parts of the data to the workers.
 Arguments:
-  * `data`:     structure for storing the input data.
+  * `data`:     structure for storing the input data;
+  * `nsend`:    number of objects for each task;
+  * `disp`:     starting index of the objects for each task.
 ******************************************************************************/
-static void mpi_scatter_data(DATA **data) {
+static void mpi_scatter_data(DATA **data, size_t *nsend, size_t *disp) {
   int size, rank;
   size = rank = 0;
   if (MPI_Comm_size(MPI_COMM_WORLD, &size) ||
@@ -190,56 +500,8 @@ static void mpi_scatter_data(DATA **data) {
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
   }
 
-  int *nsend, *disp;
-  if (!(nsend = calloc(size, sizeof(int))) ||
-      !(disp = calloc(size, sizeof(int)))) {
-    P_ERR("failed to allocate memory for sharing data information\n");
-    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
-  }
-
   DATA *d;
-  /* Split the data by brick IDs. */
-  if (rank == BRICKMASK_MPI_ROOT) {
-    d = *data;
-    long num = d->nbrick / size;        /* number of bricks per worker */
-    long num0 = d->nbrick - num * (size - 1);   /* number of bricks for root */
-
-    /* Count the number of data associated with each brick. */
-    long prev = -1;
-    long cnt = -1;
-    size_t i_prev = 0;
-    for (size_t i = 0; i < d->n; i++) {
-      if (d->id[i] != prev) {
-        prev = d->id[i];
-        if (++cnt == num0) {
-          i_prev = i;
-          break;
-        }
-      }
-    }
-    if (!i_prev) i_prev = d->n;
-    int wid = 0;
-    nsend[wid++] = i_prev;      /* number of data to be processed by root */
-    for (size_t i = i_prev; i < d->n; i++) {
-      if (d->id[i] != prev) {
-        prev = d->id[i];
-        if (++cnt == num0 + num * wid) {
-          /* Compute the length of data for this worker. */
-          nsend[wid] = i - i_prev;
-          disp[wid] = disp[wid - 1] + nsend[wid - 1];
-          if (wid++ == size) {
-            P_ERR("unexpected number of MPI tasks\n");
-            MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_UNKNOWN);
-          }
-          i_prev = i;
-        }
-      }
-    }
-    if (wid != size) {
-      nsend[wid] = d->n - i_prev;
-      disp[wid] = disp[wid - 1] + nsend[wid - 1];
-    }
-  }
+  if (rank == BRICKMASK_MPI_ROOT) d = *data;
   /* Allocate memory for the task-private data. */
   else {
     if (!(*data = calloc(1, sizeof(DATA)))) {
@@ -255,22 +517,20 @@ static void mpi_scatter_data(DATA **data) {
     d->content = NULL;
   }
 
-  /* Broadcast the length of data and number of bricks for each task. */
+  /* Broadcast the length of data, and the initial data type of maskbits
+     (for objects outside bricks) for each task. */
   MPI_Request req[3];
-  if (MPI_Ibcast(nsend, size, MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD,
-      req) || MPI_Ibcast(disp, size, MPI_INT, BRICKMASK_MPI_ROOT,
-      MPI_COMM_WORLD, req + 1) || MPI_Ibcast(&d->nbrick, 1, MY_MPI_SIZE_T,
-      BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 2) ||
-      MPI_Waitall(3, req, MPI_STATUSES_IGNORE)) {
+  if (MPI_Ibcast(nsend, size, MY_MPI_SIZE_T, BRICKMASK_MPI_ROOT,
+      MPI_COMM_WORLD, req) || MPI_Ibcast(disp, size, MY_MPI_SIZE_T,
+      BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 1) ||
+      MPI_Ibcast(&d->mtype, 1, MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD,
+      req + 2) || MPI_Waitall(3, req, MPI_STATUSES_IGNORE)) {
     P_ERR("failed to share data information\n");
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
   }
 
-  /* Set length of data and number of bricks for each task. */
+  /* Set length of data for each task. */
   d->n = nsend[rank];
-  size_t nbrick = d->nbrick / size;
-  if (rank == BRICKMASK_MPI_ROOT) d->nbrick -= nbrick * (size - 1);
-  else d->nbrick = nbrick;
 
   /* Allocate memory for the data. */
   if (rank != BRICKMASK_MPI_ROOT && d->n) {
@@ -285,36 +545,486 @@ static void mpi_scatter_data(DATA **data) {
   }
 
   /* Scatter the data. */
-  if (rank == BRICKMASK_MPI_ROOT) {     /* in-place scatter from the root */
-    if (MPI_Iscatterv(d->ra, nsend, disp, MPI_DOUBLE, MPI_IN_PLACE, d->n,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req) ||
-        MPI_Iscatterv(d->dec, nsend, disp, MPI_DOUBLE, MPI_IN_PLACE, d->n,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 1) ||
-        MPI_Iscatterv(d->id, nsend, disp, MPI_LONG, MPI_IN_PLACE, d->n,
-        MPI_LONG, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 2)) {
-      P_ERR("failed to share data information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  MPI_Request *mreq = malloc(sizeof(MPI_Request) * 3 * BRICKMASK_MPI_NMSG *
+      ((rank == BRICKMASK_MPI_ROOT) ? size : 1));
+  if (!mreq) {
+    P_ERR("failed to allocate memory for sharing data information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+  int nreq = 0;
+  if (rank == BRICKMASK_MPI_ROOT) {     /* the root keeps its own segment */
+    for (int i = 1; i < size; i++) {
+      nreq += mpi_isend_large(d->ra + disp[i], nsend[i], MPI_DOUBLE, i,
+          BRICKMASK_MPI_TAG_RA, mreq + nreq);
+      nreq += mpi_isend_large(d->dec + disp[i], nsend[i], MPI_DOUBLE, i,
+          BRICKMASK_MPI_TAG_DEC, mreq + nreq);
+      nreq += mpi_isend_large(d->id + disp[i], nsend[i], MPI_LONG, i,
+          BRICKMASK_MPI_TAG_ID, mreq + nreq);
     }
   }
   else {        /* receive only for the workers */
-    if (MPI_Iscatterv(NULL, nsend, disp, MPI_DOUBLE, d->ra, d->n,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req) ||
-        MPI_Iscatterv(NULL, nsend, disp, MPI_DOUBLE, d->dec, d->n,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 1) ||
-        MPI_Iscatterv(NULL, nsend, disp, MPI_LONG, d->id, d->n,
-        MPI_LONG, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 2)) {
-      P_ERR("failed to share data information\n");
+    nreq += mpi_irecv_large(d->ra, d->n, MPI_DOUBLE, BRICKMASK_MPI_ROOT,
+        BRICKMASK_MPI_TAG_RA, mreq + nreq);
+    nreq += mpi_irecv_large(d->dec, d->n, MPI_DOUBLE, BRICKMASK_MPI_ROOT,
+        BRICKMASK_MPI_TAG_DEC, mreq + nreq);
+    nreq += mpi_irecv_large(d->id, d->n, MPI_LONG, BRICKMASK_MPI_ROOT,
+        BRICKMASK_MPI_TAG_ID, mreq + nreq);
+  }
+
+  if (MPI_Waitall(nreq, mreq, MPI_STATUSES_IGNORE)) {
+    P_ERR("failed to share data information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+
+  free(mreq);
+}
+
+
+/*============================================================================*\
+                    Functions for streaming data to workers
+\*============================================================================*/
+
+/******************************************************************************
+Function `mpi_stream_wait`:
+  Wait until the chunk sent to a worker is delivered, and release the
+  contents of the chunk.
+Arguments:
+  * `s`:        scheduler of data chunks;
+  * `dest`:     rank of the worker.
+******************************************************************************/
+static void mpi_stream_wait(STREAM *s, const int dest) {
+  if (!s->nreq[dest]) return;
+  if (MPI_Waitall(s->nreq[dest], s->req + dest * BRICKMASK_MPI_CHUNK_NREQ,
+      MPI_STATUSES_IGNORE)) {
+    P_ERR("failed to send data chunk to task %d\n", dest);
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+  s->nreq[dest] = 0;
+  free(s->buf[dest]);
+  s->buf[dest] = NULL;
+}
+
+/******************************************************************************
+Function `mpi_stream_poll`:
+  Receive results of chunks from workers, and mark the workers as idle.
+Arguments:
+  * `s`:        scheduler of data chunks;
+  * `block`:    indicate whether to wait for at least one worker.
+******************************************************************************/
+static void mpi_stream_poll(STREAM *s, bool block) {
+  for (;;) {
+    MPI_Status status;
+    int flag = 1;
+    if (block) {
+      if (MPI_Probe(MPI_ANY_SOURCE, BRICKMASK_MPI_TAG_RESULT, MPI_COMM_WORLD,
+          &status)) {
+        P_ERR("failed to receive results from workers\n");
+        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+      }
+      block = false;
+    }
+    else if (MPI_Iprobe(MPI_ANY_SOURCE, BRICKMASK_MPI_TAG_RESULT,
+        MPI_COMM_WORLD, &flag, &status)) {
+      P_ERR("failed to receive results from workers\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+    if (!flag) return;
+
+    /* Receive the index and data type of maskbits of the chunk. */
+    const int src = status.MPI_SOURCE;
+    size_t head[2];
+    if (MPI_Recv(head, 2, MY_MPI_SIZE_T, src, BRICKMASK_MPI_TAG_RESULT,
+        MPI_COMM_WORLD, MPI_STATUS_IGNORE)) {
+      P_ERR("failed to receive results from task %d\n", src);
       MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
     }
+
+    if (head[0] != BRICKMASK_MPI_READY) {
+      if (head[0] >= s->nchunk) {
+        P_ERR("unexpected chunk index from task %d: %zu\n", src, head[0]);
+        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_UNKNOWN);
+      }
+      STREAM_CHUNK *c = s->chunk + head[0];
+      c->mtype = head[1];
+      const size_t nmask = c->n * mask_size(c->mtype);
+      if (!(c->res = malloc(nmask + (s->subid ? c->n : 0)))) {
+        P_ERR("failed to allocate memory for results of chunks\n");
+        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+      }
+
+      MPI_Request req[2 * BRICKMASK_MPI_NMSG];
+      int nreq = mpi_irecv_large(c->res, nmask, MPI_BYTE, src,
+          BRICKMASK_MPI_TAG_RDATA, req);
+      if (s->subid) {
+        nreq += mpi_irecv_large((char *) c->res + nmask, c->n,
+            MPI_UNSIGNED_CHAR, src, BRICKMASK_MPI_TAG_RDATA, req + nreq);
+      }
+      if (MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE)) {
+        P_ERR("failed to receive results from task %d\n", src);
+        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+      }
+    }
+    s->idle[s->nidle++] = src;
   }
+}
 
-  if (MPI_Waitall(3, req, MPI_STATUSES_IGNORE)) {
-    P_ERR("failed to share data information\n");
+/******************************************************************************
+Function `mpi_stream_send`:
+  Sort a chunk of the data, and send it to an idle worker, with only the
+  maskbit files of bricks for this chunk.
+Arguments:
+  * `s`:        scheduler of data chunks;
+  * `ra`:       right ascension of all objects read so far;
+  * `dec`:      declination of all objects read so far;
+  * `n`:        number of objects in the chunk.
+******************************************************************************/
+static void mpi_stream_send(STREAM *s, const double *ra, const double *dec,
+    const size_t n) {
+  const int dest = s->idle[--s->nidle];
+  const int nsp = s->brick->nsp;
+  mpi_stream_wait(s, dest);
+
+  /* Enlarge the records of chunks if necessary. */
+  if (s->nchunk == s->nmax) {
+    s->nmax = s->nmax * 2 + 1;
+    STREAM_CHUNK *tmp = realloc(s->chunk, s->nmax * sizeof(STREAM_CHUNK));
+    if (!tmp) {
+      P_ERR("failed to allocate memory for records of chunks\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+    }
+    s->chunk = tmp;
+  }
+
+  /* Sort a copy of the chunk by bricks. */
+  DATA d;
+  memset(&d, 0, sizeof(DATA));
+  d.n = n;
+  if (!(d.ra = malloc(n * sizeof(double))) ||
+      !(d.dec = malloc(n * sizeof(double))) ||
+      !(d.idx = malloc(n * sizeof(size_t))) ||
+      !(d.id = malloc(n * sizeof(long)))) {
+    P_ERR("failed to allocate memory for the data chunk\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+  memcpy(d.ra, ra + s->nsent, n * sizeof(double));
+  memcpy(d.dec, dec + s->nsent, n * sizeof(double));
+  for (size_t i = 0; i < n; i++) d.idx[i] = s->nsent + i;
+  if (sort_chunk(s->brick, &d)) {
+    P_ERR("failed to sort the data chunk\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_BRICK);
+  }
+
+  /* Pack the bricks of the chunk. */
+  size_t *h = s->head + dest * s->nhead;
+  memset(h, 0, s->nhead * sizeof(size_t));
+  h[0] = s->nchunk;
+  h[1] = n;
+  const size_t disp = 0;
+  long *fidx = NULL;
+  char *fname = NULL;
+  int cnt[2], off[2];
+  mpi_pack_brick(s->brick, &d, 1, &n, &disp, h + 2, &fidx, &fname, cnt, off);
+
+  /* Coordinates, dense brick IDs, file indices, and filenames. */
+  const size_t nidx = h[2] * nsp;
+  const size_t size = n * (2 * sizeof(double) + sizeof(long)) +
+      nidx * sizeof(long) + cnt[1];
+  char *buf = malloc(size);
+  if (!buf) {
+    P_ERR("failed to allocate memory for the data chunk\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+  char *pos = buf;
+  memcpy(pos, d.ra, n * sizeof(double));
+  pos += n * sizeof(double);
+  memcpy(pos, d.dec, n * sizeof(double));
+  pos += n * sizeof(double);
+  memcpy(pos, d.id, n * sizeof(long));
+  pos += n * sizeof(long);
+  memcpy(pos, fidx, nidx * sizeof(long));
+  pos += nidx * sizeof(long);
+  memcpy(pos, fname, cnt[1]);
+  free(d.ra); free(d.dec); free(d.id); free(fidx); free(fname);
+
+  /* Record the chunk, and send it to the worker. */
+  STREAM_CHUNK *c = s->chunk + s->nchunk++;
+  c->n = n;
+  c->idx = d.idx;
+  c->mtype = 0;
+  c->res = NULL;
+  s->buf[dest] = buf;
+  s->nsent += n;
+
+  MPI_Request *req = s->req + dest * BRICKMASK_MPI_CHUNK_NREQ;
+  if (MPI_Isend(h, s->nhead, MY_MPI_SIZE_T, dest, BRICKMASK_MPI_TAG_CHUNK,
+      MPI_COMM_WORLD, req)) {
+    P_ERR("failed to send data chunk to task %d\n", dest);
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
   }
+  s->nreq[dest] = 1 + mpi_isend_large(buf, size, MPI_BYTE, dest,
+      BRICKMASK_MPI_TAG_CDATA, req + 1);
+}
 
-  free(nsend);
-  free(disp);
+/******************************************************************************
+Function `mpi_stream_hook`:
+  Send full chunks to idle workers while the input catalogues are read.
+Arguments:
+  * `ra`:       right ascension of all objects read so far;
+  * `dec`:      declination of all objects read so far;
+  * `n`:        number of objects read so far;
+  * `arg`:      scheduler of data chunks.
+Return:
+  Zero on success.
+******************************************************************************/
+static int mpi_stream_hook(const double *ra, const double *dec,
+    const size_t n, void *arg) {
+  STREAM *s = (STREAM *) arg;
+  mpi_stream_poll(s, false);
+  while (s->nidle && n - s->nsent >= s->csize)
+    mpi_stream_send(s, ra, dec, s->csize);
+  return 0;
+}
+
+/******************************************************************************
+Function `mpi_stream_merge`:
+  Save results of all chunks to the data catalogue in the original order,
+  with the widest data type of maskbits of the catalogue and all chunks.
+Arguments:
+  * `s`:        scheduler of data chunks;
+  * `data`:     structure for the data catalogue.
+******************************************************************************/
+static void mpi_stream_merge(STREAM *s, DATA *data) {
+  for (size_t i = 0; i < s->nchunk; i++)
+    if (data->mtype < s->chunk[i].mtype) data->mtype = s->chunk[i].mtype;
+
+  for (size_t i = 0; i < s->nchunk; i++) {
+    STREAM_CHUNK *c = s->chunk + i;
+    const void *mask = c->res;
+    for (size_t j = 0; j < c->n; j++)
+      set_mask(data->mask, data->mtype, c->idx[j],
+          get_mask(mask, c->mtype, j));
+    if (data->subid) {
+      const unsigned char *subid =
+          (const unsigned char *) mask + c->n * mask_size(c->mtype);
+      for (size_t j = 0; j < c->n; j++) data->subid[c->idx[j]] = subid[j];
+    }
+    free(c->idx);
+    free(c->res);
+  }
+}
+
+/******************************************************************************
+Function `mpi_stream_root`:
+  Read the input catalogues, and schedule chunks of the data for workers.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `brick`:    structure for bricks;
+  * `size`:     number of MPI tasks.
+Return:
+  Address of the data catalogue with maskbits in the original order.
+******************************************************************************/
+static DATA *mpi_stream_root(const CONF *conf, const BRICK *brick,
+    const int size) {
+  STREAM s;
+  memset(&s, 0, sizeof(STREAM));
+  s.brick = brick;
+  s.subid = (conf->subid) ? true : false;
+  s.nhead = 3 + 2 * brick->nsp;
+  s.csize = conf->nchunk;
+  if (!(s.idle = malloc(size * sizeof(int))) ||
+      !(s.head = malloc((size_t) s.nhead * size * sizeof(size_t))) ||
+      !(s.buf = calloc(size, sizeof(char *))) ||
+      !(s.nreq = calloc(size, sizeof(int))) ||
+      !(s.req = malloc(size * BRICKMASK_MPI_CHUNK_NREQ *
+      sizeof(MPI_Request)))) {
+    P_ERR("failed to allocate memory for scheduling data chunks\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+
+  /* Send full chunks to workers while reading. */
+  DATA *data = read_data(conf, mpi_stream_hook, &s);
+  if (!data) {
+    printf(FMT_FAIL);
+    P_EXT("failed to read the input data catalogs\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_FILE);
+  }
+  data->hook = NULL;
+  data->harg = NULL;
+
+  printf("Assigning maskbits to the data with MPI workers ...");
+  if (conf->verbose) printf("\n");
+  fflush(stdout);
+
+  /* Send the rest of the data, and wait for all workers. */
+  while (s.nsent < data->n) {
+    if (!s.nidle) mpi_stream_poll(&s, true);
+    size_t n = data->n - s.nsent;
+    mpi_stream_send(&s, data->ra, data->dec, (n < s.csize) ? n : s.csize);
+  }
+  while (s.nidle < size - 1) mpi_stream_poll(&s, true);
+
+  /* Stop the workers. */
+  for (int i = 1; i < size; i++) {
+    mpi_stream_wait(&s, i);
+    size_t *h = s.head + i * s.nhead;
+    memset(h, 0, s.nhead * sizeof(size_t));
+    if (MPI_Send(h, s.nhead, MY_MPI_SIZE_T, i, BRICKMASK_MPI_TAG_CHUNK,
+        MPI_COMM_WORLD)) {
+      P_ERR("failed to stop task %d\n", i);
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+  }
+
+  mpi_stream_merge(&s, data);
+  if (conf->verbose) {
+    printf("  %zu chunks processed by %d workers\n", s.nchunk, size - 1);
+  }
+
+  free(s.chunk); free(s.idle); free(s.head); free(s.buf); free(s.nreq);
+  free(s.req);
+  printf(FMT_DONE);
+  return data;
+}
+
+/******************************************************************************
+Function `mpi_stream_worker`:
+  Assign maskbits to data chunks received from the root task, until an
+  empty chunk is received.
+Arguments:
+  * `nsp`:      number of subsamples;
+  * `spid`:     IDs of subsamples;
+  * `mnull`:    bit code for objects outside bricks;
+  * `subid`:    indicate whether subsample IDs are required.
+******************************************************************************/
+static void mpi_stream_worker(const int nsp, int *spid, const uint64_t mnull,
+    const bool subid) {
+  const int nhead = 3 + 2 * nsp;
+  size_t *h = malloc(nhead * sizeof(size_t));
+  size_t *nmask = malloc(nsp * sizeof(size_t));
+  char ***fmask = malloc(nsp * sizeof(char **));
+  if (!h || !nmask || !fmask) {
+    P_ERR("failed to allocate memory for receiving data chunks\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+
+  /* Tell the root task that this worker is ready. */
+  size_t res[2] = {BRICKMASK_MPI_READY, 0};
+  if (MPI_Send(res, 2, MY_MPI_SIZE_T, BRICKMASK_MPI_ROOT,
+      BRICKMASK_MPI_TAG_RESULT, MPI_COMM_WORLD)) {
+    P_ERR("failed to communicate with the root task\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+
+  char *buf = NULL;
+  char **fptr = NULL;
+  size_t bmax, fmax;
+  bmax = fmax = 0;
+  for (;;) {
+    if (MPI_Recv(h, nhead, MY_MPI_SIZE_T, BRICKMASK_MPI_ROOT,
+        BRICKMASK_MPI_TAG_CHUNK, MPI_COMM_WORLD, MPI_STATUS_IGNORE)) {
+      P_ERR("failed to receive data chunk from the root task\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+    const size_t n = h[1];
+    if (!n) break;              /* no more chunk */
+
+    /* Receive the contents of the chunk. */
+    const size_t nidx = h[2] * nsp;
+    size_t nfile, nchar;
+    nfile = nchar = 0;
+    for (int k = 0; k < nsp; k++) {
+      nfile += h[3 + k];
+      nchar += h[3 + nsp + k];
+    }
+    const size_t size = n * (2 * sizeof(double) + sizeof(long)) +
+        nidx * sizeof(long) + nchar;
+    if (size > bmax) {
+      free(buf);
+      if (!(buf = malloc(size))) {
+        P_ERR("failed to allocate memory for receiving data chunks\n");
+        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+      }
+      bmax = size;
+    }
+    if (nfile > fmax) {
+      free(fptr);
+      if (!(fptr = malloc(nfile * sizeof(char *)))) {
+        P_ERR("failed to allocate memory for receiving data chunks\n");
+        MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+      }
+      fmax = nfile;
+    }
+    MPI_Request req[BRICKMASK_MPI_NMSG * 2];
+    int nreq = mpi_irecv_large(buf, size, MPI_BYTE, BRICKMASK_MPI_ROOT,
+        BRICKMASK_MPI_TAG_CDATA, req);
+    if (MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE)) {
+      P_ERR("failed to receive data chunk from the root task\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+
+    /* Set up the bricks and data of the chunk. */
+    BRICK b;
+    memset(&b, 0, sizeof(BRICK));
+    b.n = h[2];
+    b.nsp = nsp;
+    b.subid = spid;
+    b.nmask = nmask;
+    b.fmask = fmask;
+    b.mnull = mnull;
+
+    DATA d;
+    memset(&d, 0, sizeof(DATA));
+    d.n = n;
+    d.nbrick = b.n;
+    d.mtype = mask_type(mnull);
+    d.ra = (double *) buf;
+    d.dec = d.ra + n;
+    d.id = (long *) (d.dec + n);
+    b.fidx = d.id + n;
+    char *fname = (char *) (b.fidx + nidx);
+    char **ptr = fptr;
+    for (int k = 0; k < nsp; k++) {
+      nmask[k] = h[3 + k];
+      fmask[k] = ptr;
+      for (size_t j = 0; j < nmask[k]; j++) {
+        *ptr++ = fname;
+        fname += strlen(fname) + 1;
+      }
+    }
+    if (!(d.mask = calloc(n, sizeof(uint64_t))) ||
+        (subid && !(d.subid = calloc(n, sizeof(unsigned char))))) {
+      P_ERR("failed to allocate memory for the data chunk\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+    }
+
+    if (assign_mask_chunk(&b, &d)) {
+      P_ERR("failed to assign maskbits to the data chunk\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MASK);
+    }
+
+    /* Send the results back to the root task. */
+    res[0] = h[0];
+    res[1] = d.mtype;
+    if (MPI_Send(res, 2, MY_MPI_SIZE_T, BRICKMASK_MPI_ROOT,
+        BRICKMASK_MPI_TAG_RESULT, MPI_COMM_WORLD)) {
+      P_ERR("failed to send results to the root task\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+    nreq = mpi_isend_large(d.mask, n * mask_size(d.mtype), MPI_BYTE,
+        BRICKMASK_MPI_ROOT, BRICKMASK_MPI_TAG_RDATA, req);
+    if (subid) {
+      nreq += mpi_isend_large(d.subid, n, MPI_UNSIGNED_CHAR,
+          BRICKMASK_MPI_ROOT, BRICKMASK_MPI_TAG_RDATA, req + nreq);
+    }
+    if (MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE)) {
+      P_ERR("failed to send results to the root task\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    }
+    free(d.mask);
+    if (d.subid) free(d.subid);
+  }
+
+  free(h); free(nmask); free(fmask); free(buf); free(fptr);
 }
 
 
@@ -333,8 +1043,10 @@ Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
 void mpi_init_worker(BRICK **brick, DATA **data, const bool verbose) {
-  int rank;
-  if (MPI_Comm_rank(MPI_COMM_WORLD, &rank))
+  int size, rank;
+  size = rank = 0;
+  if (MPI_Comm_size(MPI_COMM_WORLD, &size) ||
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank))
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
 
   if (rank == BRICKMASK_MPI_ROOT) {
@@ -348,11 +1060,24 @@ void mpi_init_worker(BRICK **brick, DATA **data, const bool verbose) {
     MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_INIT);
   }
 
+  size_t *nsend, *disp;
+  if (!(nsend = calloc(size, sizeof(size_t))) ||
+      !(disp = calloc(size, sizeof(size_t)))) {
+    P_ERR("failed to allocate memory for sharing data information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+
+  /* Split the data by bricks. */
+  if (rank == BRICKMASK_MPI_ROOT) mpi_split_data(*data, size, nsend, disp);
+
   /* Send brick information to workers. */
-  mpi_bcast_brick(brick);
+  mpi_scatter_brick(brick, *data, nsend, disp);
 
   /* Send data information to workers. */
-  mpi_scatter_data(data);
+  mpi_scatter_data(data, nsend, disp);
+  (*data)->nbrick = (*brick)->n;
+  free(nsend);
+  free(disp);
 
   if (verbose) {
     printf("  Task %d: %zu objects in %zu bricks\n", rank,
@@ -396,28 +1121,27 @@ void mpi_gather_data(BRICK *brick, DATA *data) {
   }
 
   /* Gather the number of objects assigned to each task. */
-  MPI_Request req[4];
-  int n = data->n;
-  int *nrecv, *disp;
+  size_t n = data->n;
+  size_t *nrecv, *disp;
   nrecv = disp = NULL;
   if (rank == BRICKMASK_MPI_ROOT) {
-    if (!(nrecv = calloc(size, sizeof(int))) ||
-        !(disp = calloc(size, sizeof(int)))) {
+    if (!(nrecv = calloc(size, sizeof(size_t))) ||
+        !(disp = calloc(size, sizeof(size_t)))) {
       P_ERR("failed to allocate memory for gathering data from tasks\n");
       MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
     }
 
     /* Gather the length of data segments. */
-    if (MPI_Gather(&n, 1, MPI_INT, nrecv, 1, MPI_INT, BRICKMASK_MPI_ROOT,
-        MPI_COMM_WORLD)) {
+    if (MPI_Gather(&n, 1, MY_MPI_SIZE_T, nrecv, 1, MY_MPI_SIZE_T,
+        BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
       P_ERR("failed to gather data information\n");
       MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
     }
   }
   else {
     /* Send the length of data segments. */
-    if (MPI_Gather(&n, 1, MPI_INT, NULL, 1, MPI_INT, BRICKMASK_MPI_ROOT,
-        MPI_COMM_WORLD)) {
+    if (MPI_Gather(&n, 1, MY_MPI_SIZE_T, NULL, 1, MY_MPI_SIZE_T,
+        BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
       P_ERR("failed to gather data information\n");
       MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
     }
@@ -455,26 +1179,50 @@ void mpi_gather_data(BRICK *brick, DATA *data) {
     }
   }
 
+  /* Maskbits are already packed to the same data type on all tasks. */
+  MPI_Datatype mtype;
+  switch (data->mtype) {
+    case TBYTE:  mtype = MPI_UINT8_T;  break;
+    case TSHORT: mtype = MPI_UINT16_T; break;
+    case TINT:   mtype = MPI_UINT32_T; break;
+    case TLONG:  mtype = MPI_UINT64_T; break;
+    default:
+      P_ERR("unexpected data type for maskbits: %d\n", data->mtype);
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_UNKNOWN);
+      return;
+  }
+  int msize = 0;
+  if (MPI_Type_size(mtype, &msize)) {
+    P_ERR("failed to gather data information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+
+  /* Allocate memory for the requests of messages.  Only the results are
+     gathered, as the root keeps coordinates and indices of all objects. */
+  const int nmsg = (data->subid) ? 2 : 1;
+  MPI_Request *mreq = malloc(sizeof(MPI_Request) * nmsg * BRICKMASK_MPI_NMSG *
+      ((rank == BRICKMASK_MPI_ROOT) ? size : 1));
+  if (!mreq) {
+    P_ERR("failed to allocate memory for gathering data from tasks\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+  int nreq = 0;
+
   if (rank == BRICKMASK_MPI_ROOT) {
     /* Compute displacements. */
     for (int i = 1; i < size; i++) disp[i] = disp[i - 1] + nrecv[i - 1];
 
-    /* Gather data. */
-    if (MPI_Igatherv(MPI_IN_PLACE, n, MPI_DOUBLE, data->ra, nrecv, disp,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req) ||
-        MPI_Igatherv(MPI_IN_PLACE, n, MPI_DOUBLE, data->dec, nrecv, disp,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 1) ||
-        MPI_Igatherv(MPI_IN_PLACE, n, MPI_UINT64_T, data->mask, nrecv, disp,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 2) ||
-        (data->subid && MPI_Igatherv(MPI_IN_PLACE, n, MPI_UNSIGNED_CHAR,
-        data->subid, nrecv, disp, MPI_UNSIGNED_CHAR, BRICKMASK_MPI_ROOT,
-        MPI_COMM_WORLD, req + 3))) {
-      P_ERR("failed to gather data information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    /* Gather data, the segment of the root is already in place. */
+    for (int i = 1; i < size; i++) {
+      nreq += mpi_irecv_large((char *) data->mask + disp[i] * msize,
+          nrecv[i], mtype, i, BRICKMASK_MPI_TAG_MASK, mreq + nreq);
+      if (data->subid) {
+        nreq += mpi_irecv_large(data->subid + disp[i], nrecv[i],
+            MPI_UNSIGNED_CHAR, i, BRICKMASK_MPI_TAG_SUBID, mreq + nreq);
+      }
     }
 
-    int nreq = (data->subid) ? 4 : 3;
-    if (MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE)) {
+    if (MPI_Waitall(nreq, mreq, MPI_STATUSES_IGNORE)) {
       P_ERR("failed to gather data information\n");
       MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
     }
@@ -484,42 +1232,22 @@ void mpi_gather_data(BRICK *brick, DATA *data) {
     for (int i = 0; i < size; i++) data->n += nrecv[i];
     free(nrecv);
     free(disp);
-
-    /* Get the largest mask width. */
-    if (MPI_Reduce(MPI_IN_PLACE, &data->mtype, 1, MPI_INT, MPI_MAX,
-        BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
-      P_ERR("failed to gather data information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
-    }
   }
   else {
-    /* Gather data. */
-    if (MPI_Igatherv(data->ra, n, MPI_DOUBLE, NULL, NULL, NULL,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req) ||
-        MPI_Igatherv(data->dec, n, MPI_DOUBLE, NULL, NULL, NULL,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 1) ||
-        MPI_Igatherv(data->mask, n, MPI_UINT64_T, NULL, NULL, NULL,
-        MPI_DOUBLE, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req + 2) ||
-        (data->subid && MPI_Igatherv(data->subid, n, MPI_UNSIGNED_CHAR,
-        NULL, NULL, NULL, MPI_UNSIGNED_CHAR, BRICKMASK_MPI_ROOT,
-        MPI_COMM_WORLD, req + 3))) {
-      P_ERR("failed to gather data information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+    /* Send data to the root. */
+    nreq += mpi_isend_large(data->mask, n, mtype, BRICKMASK_MPI_ROOT,
+        BRICKMASK_MPI_TAG_MASK, mreq + nreq);
+    if (data->subid) {
+      nreq += mpi_isend_large(data->subid, n, MPI_UNSIGNED_CHAR,
+          BRICKMASK_MPI_ROOT, BRICKMASK_MPI_TAG_SUBID, mreq + nreq);
     }
 
-    int nreq = (data->subid) ? 4 : 3;
-    if (MPI_Waitall(nreq, req, MPI_STATUSES_IGNORE)) {
-      P_ERR("failed to gather data information\n");
-      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
-    }
-
-    /* Send the largest mask width. */
-    if (MPI_Reduce(&data->mtype, NULL, 1, MPI_INT, MPI_MAX, BRICKMASK_MPI_ROOT,
-        MPI_COMM_WORLD)) {
+    if (MPI_Waitall(nreq, mreq, MPI_STATUSES_IGNORE)) {
       P_ERR("failed to gather data information\n");
       MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
     }
   }
+  free(mreq);
 
   if (rank == BRICKMASK_MPI_ROOT) {
     printf(FMT_DONE);
@@ -536,4 +1264,100 @@ void mpi_gather_data(BRICK *brick, DATA *data) {
   }
 }
 
+
+/******************************************************************************
+Function `mpi_stream_data`:
+  Read the input data on the root task, and assign maskbits to chunks of the
+  data with workers as soon as the chunks are read.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `brick`:    structure for bricks.
+Return:
+  Address of the data catalogue with maskbits in the original order on the
+  root task; NULL on workers.
+******************************************************************************/
+DATA *mpi_stream_data(const CONF *conf, const BRICK *brick) {
+  int size, rank;
+  size = rank = 0;
+  if (MPI_Comm_size(MPI_COMM_WORLD, &size) ||
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank))
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  if (size < 2) {
+    P_ERR("no MPI worker is available for streaming data\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+
+  /* Broadcast information of subsamples, and bit code for null objects. */
+  int nsp = 0;
+  uint64_t mnull = 0;
+  bool subid = false;
+  if (rank == BRICKMASK_MPI_ROOT) {
+    if (!conf || !brick) {
+      P_ERR("the configurations or bricks are not initialised\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_INIT);
+    }
+    nsp = brick->nsp;
+    mnull = brick->mnull;
+    subid = (conf->subid) ? true : false;
+  }
+  MPI_Request req[3];
+  if (MPI_Ibcast(&nsp, 1, MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD, req) ||
+      MPI_Ibcast(&mnull, 1, MPI_UINT64_T, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD,
+      req + 1) || MPI_Ibcast(&subid, 1, MPI_C_BOOL, BRICKMASK_MPI_ROOT,
+      MPI_COMM_WORLD, req + 2) || MPI_Waitall(3, req, MPI_STATUSES_IGNORE)) {
+    P_ERR("failed to broadcast brick information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+  int *spid = malloc(nsp * sizeof(int));
+  if (!spid) {
+    P_ERR("failed to allocate memory for subsample IDs\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+  }
+  if (rank == BRICKMASK_MPI_ROOT) memcpy(spid, brick->subid, nsp * sizeof(int));
+  if (MPI_Bcast(spid, nsp, MPI_INT, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
+    P_ERR("failed to broadcast brick information\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+
+  DATA *data = NULL;
+  if (rank == BRICKMASK_MPI_ROOT) data = mpi_stream_root(conf, brick, size);
+  else mpi_stream_worker(nsp, spid, mnull, subid);
+  free(spid);
+  return data;
+}
+
+/******************************************************************************
+Function `mpi_bcast_str`:
+  Broadcast a string from the root task to the workers.
+Arguments:
+  * `str`:      address of the string, allocated on workers if not NULL.
+******************************************************************************/
+void mpi_bcast_str(char **str) {
+  int rank = 0;
+  if (MPI_Comm_rank(MPI_COMM_WORLD, &rank))
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+
+  /* The length includes the terminating null character, 0 for NULL. */
+  size_t len = 0;
+  if (rank == BRICKMASK_MPI_ROOT && *str) len = strlen(*str) + 1;
+  if (MPI_Bcast(&len, 1, MY_MPI_SIZE_T, BRICKMASK_MPI_ROOT, MPI_COMM_WORLD)) {
+    P_ERR("failed to broadcast the length of a string\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+  if (rank != BRICKMASK_MPI_ROOT) {
+    *str = NULL;
+    if (!len) return;
+    if (!(*str = malloc(len * sizeof(char)))) {
+      P_ERR("failed to allocate memory for a string\n");
+      MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MEMORY);
+    }
+  }
+  else if (!len) return;
+  if (len > INT_MAX || MPI_Bcast(*str, len, MPI_CHAR, BRICKMASK_MPI_ROOT,
+      MPI_COMM_WORLD)) {
+    P_ERR("failed to broadcast a string\n");
+    MPI_Abort(MPI_COMM_WORLD, BRICKMASK_ERR_MPI);
+  }
+}
+
 #endif
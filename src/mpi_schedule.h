@@ -37,7 +37,7 @@
 #include "data_io.h"
 
 /*============================================================================*\
-                 Function for assigning maskbits with MPI tasks
+                Functions for assigning maskbits with MPI tasks
 \*============================================================================*/
 
 /******************************************************************************
@@ -59,5 +59,26 @@ Arguments:
 ******************************************************************************/
 void mpi_gather_data(BRICK *brick, DATA *data);
 
+/******************************************************************************
+Function `mpi_stream_data`:
+  Read the input data on the root task, and assign maskbits to chunks of the
+  data with workers as soon as the chunks are read.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `brick`:    structure for bricks.
+Return:
+  Address of the data catalogue with maskbits in the original order on the
+  root task; NULL on workers.
+******************************************************************************/
+DATA *mpi_stream_data(const CONF *conf, const BRICK *brick);
+
+/******************************************************************************
+Function `mpi_bcast_str`:
+  Broadcast a string from the root task to the workers.
+Arguments:
+  * `str`:      address of the string, allocated on workers if not NULL.
+******************************************************************************/
+void mpi_bcast_str(char **str);
+
 #endif
 #endif
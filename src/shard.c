@@ -0,0 +1,317 @@
+/*******************************************************************************
+* shard.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#include "define.h"
+#include "shard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fitsio.h>
+
+/*============================================================================*\
+  Format of shard files (native byte order):
+  * header: BRICKMASK_SHARD_MAGIC, index of the shard (int32), number of
+            shards (int32), number of objects (uint64), data type of
+            maskbits (int32, 0 if there is no object), size of indices
+            (uint8), flag for subsample IDs (uint8);
+  * original indices of the objects (size_t), maskbits packed to the data
+    type, and optionally subsample IDs (uint8).
+\*============================================================================*/
+
+#define SHARD_MAGIC_LEN (sizeof(BRICKMASK_SHARD_MAGIC) - 1)
+
+/* Header of shard files. */
+typedef struct {
+  int32_t ishard;       /* index of the shard                           */
+  int32_t nshard;       /* total number of shards                       */
+  uint64_t n;           /* number of objects                            */
+  int32_t mtype;        /* data type of maskbits                        */
+  uint8_t isize;        /* size of indices                              */
+  uint8_t subid;        /* indicate whether subsample IDs are saved     */
+} SHARD_HEAD;
+
+/*============================================================================*\
+                      Functions for processing shard files
+\*============================================================================*/
+
+/******************************************************************************
+Function `shard_fname`:
+  Construct the name of the file for a shard.
+Arguments:
+  * `dir`:      directory for shard files;
+  * `ishard`:   index of the shard.
+Return:
+  The filename on success; NULL on error.
+******************************************************************************/
+static char *shard_fname(const char *dir, const int ishard) {
+  size_t len = strlen(dir) + strlen(BRICKMASK_SHARD_FNAME) + 16;
+  char *fname = malloc(len * sizeof(char));
+  if (!fname) {
+    P_ERR("failed to allocate memory for the shard filename\n");
+    return NULL;
+  }
+  snprintf(fname, len, "%s%c" BRICKMASK_SHARD_FNAME ".%d", dir,
+      BRICKMASK_PATH_SEP, ishard);
+  return fname;
+}
+
+/******************************************************************************
+Function `read_head`:
+  Read the header of a shard file.
+Arguments:
+  * `fp`:       pointer to the shard file;
+  * `fname`:    name of the shard file;
+  * `head`:     the header read from file.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int read_head(FILE *fp, const char *fname, SHARD_HEAD *head) {
+  char magic[SHARD_MAGIC_LEN];
+  if (fread(magic, SHARD_MAGIC_LEN, 1, fp) != 1 ||
+      fread(&head->ishard, sizeof(int32_t), 1, fp) != 1 ||
+      fread(&head->nshard, sizeof(int32_t), 1, fp) != 1 ||
+      fread(&head->n, sizeof(uint64_t), 1, fp) != 1 ||
+      fread(&head->mtype, sizeof(int32_t), 1, fp) != 1 ||
+      fread(&head->isize, sizeof(uint8_t), 1, fp) != 1 ||
+      fread(&head->subid, sizeof(uint8_t), 1, fp) != 1) {
+    P_ERR("failed to read the header of the shard file: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (memcmp(magic, BRICKMASK_SHARD_MAGIC, SHARD_MAGIC_LEN) ||
+      head->nshard <= 0 || head->ishard < 0 || head->ishard >= head->nshard ||
+      head->isize != sizeof(size_t) ||
+      (head->n && !mask_size(head->mtype))) {
+    P_ERR("invalid shard file: `%s'\n", fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  return 0;
+}
+
+/******************************************************************************
+Function `open_shard`:
+  Open a shard file and check its header.
+Arguments:
+  * `dir`:      directory for shard files;
+  * `ishard`:   index of the shard;
+  * `head`:     the header read from file.
+Return:
+  Pointer to the opened file on success; NULL on error.
+******************************************************************************/
+static FILE *open_shard(const char *dir, const int ishard, SHARD_HEAD *head) {
+  char *fname = shard_fname(dir, ishard);
+  if (!fname) return NULL;
+  FILE *fp = fopen(fname, "rb");
+  if (!fp) {
+    P_ERR("cannot open the shard file: `%s'\n", fname);
+    free(fname);
+    return NULL;
+  }
+  if (read_head(fp, fname, head)) {
+    fclose(fp);
+    free(fname);
+    return NULL;
+  }
+  if (head->ishard != ishard) {
+    P_ERR("unexpected shard index in `%s': %d\n", fname, (int) head->ishard);
+    fclose(fp);
+    free(fname);
+    return NULL;
+  }
+  free(fname);
+  return fp;
+}
+
+
+/*============================================================================*\
+                  Interfaces for results of independent shards
+\*============================================================================*/
+
+/******************************************************************************
+Function `save_shard`:
+  Save maskbits and subsample IDs of a shard, with the original indices of
+  the objects.
+Arguments:
+  * `dir`:      directory for shard files;
+  * `ishard`:   index of the shard;
+  * `nshard`:   total number of shards;
+  * `data`:     structure for the data catalogue of the shard.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int save_shard(const char *dir, const int ishard, const int nshard,
+    const DATA *data) {
+  printf("Saving maskbits of the shard ...");
+  if (!dir || !data) {
+    P_ERR("the shard directory or data catalogue is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  fflush(stdout);
+
+  char *fname = shard_fname(dir, ishard);
+  if (!fname) return BRICKMASK_ERR_MEMORY;
+  FILE *fp = fopen(fname, "wb");
+  if (!fp) {
+    P_ERR("cannot write to the shard file: `%s'\n", fname);
+    free(fname);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  /* The data type is not set by shards without data. */
+  const SHARD_HEAD head = {ishard, nshard, data->n,
+    data->n ? data->mtype : 0, sizeof(size_t), data->subid ? 1 : 0};
+  const size_t msize = mask_size(head.mtype);
+  if (data->n && !msize) {
+    P_ERR("unexpected data type for maskbits: %d\n", data->mtype);
+    fclose(fp);
+    free(fname);
+    return BRICKMASK_ERR_UNKNOWN;
+  }
+
+  if (fwrite(BRICKMASK_SHARD_MAGIC, SHARD_MAGIC_LEN, 1, fp) != 1 ||
+      fwrite(&head.ishard, sizeof(int32_t), 1, fp) != 1 ||
+      fwrite(&head.nshard, sizeof(int32_t), 1, fp) != 1 ||
+      fwrite(&head.n, sizeof(uint64_t), 1, fp) != 1 ||
+      fwrite(&head.mtype, sizeof(int32_t), 1, fp) != 1 ||
+      fwrite(&head.isize, sizeof(uint8_t), 1, fp) != 1 ||
+      fwrite(&head.subid, sizeof(uint8_t), 1, fp) != 1 ||
+      fwrite(data->idx, sizeof(size_t), data->n, fp) != data->n ||
+      fwrite(data->mask, msize, data->n, fp) != data->n ||
+      (head.subid && fwrite(data->subid, sizeof(unsigned char), data->n, fp)
+      != data->n)) {
+    P_ERR("failed to write to the shard file: `%s'\n", fname);
+    fclose(fp);
+    free(fname);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (fclose(fp)) {
+    P_ERR("failed to close the shard file: `%s'\n", fname);
+    free(fname);
+    return BRICKMASK_ERR_FILE;
+  }
+
+  free(fname);
+  printf(FMT_DONE);
+  return 0;
+}
+
+/******************************************************************************
+Function `merge_shard`:
+  Load results of all shards into the full data catalogue, in the original
+  order, with maskbits packed to the widest data type of all shards.
+Arguments:
+  * `dir`:      directory for shard files;
+  * `data`:     structure for the full data catalogue;
+  * `verbose`:  indicate whether to show detailed outputs.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int merge_shard(const char *dir, DATA *data, const bool verbose) {
+  printf("Merging maskbits of shards ...");
+  if (!dir || !data) {
+    P_ERR("the shard directory or data catalogue is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (verbose) printf("\n");
+  fflush(stdout);
+
+  /* Check headers of all shards, and get the widest data type. */
+  SHARD_HEAD head;
+  FILE *fp = open_shard(dir, 0, &head);
+  if (!fp) return BRICKMASK_ERR_FILE;
+  fclose(fp);
+  const int nshard = head.nshard;
+  const bool subid = head.subid;
+  if (subid != (data->subid != NULL)) {
+    P_ERR("subsample IDs of shards are inconsistent with "
+        FMT_KEY(SUBSAMPLE_ID) "\n");
+    return BRICKMASK_ERR_FILE;
+  }
+  int mtype = 0;
+  size_t ntot = 0;
+  for (int i = 0; i < nshard; i++) {
+    if (!(fp = open_shard(dir, i, &head))) return BRICKMASK_ERR_FILE;
+    fclose(fp);
+    if (head.nshard != nshard || (bool) head.subid != subid) {
+      P_ERR("shard %d does not belong to the same run as shard 0\n", i);
+      return BRICKMASK_ERR_FILE;
+    }
+    if (mtype < head.mtype) mtype = head.mtype;
+    ntot += head.n;
+  }
+  if (ntot != data->n) {
+    P_ERR("number of objects in shards (%zu) differs from that of the "
+        "input catalogs (%zu)\n", ntot, data->n);
+    return BRICKMASK_ERR_FILE;
+  }
+  if (mtype) data->mtype = mtype;
+
+  /* Objects that are already loaded. */
+  unsigned char *seen = calloc(data->n, sizeof(unsigned char));
+  if (!seen) {
+    P_ERR("failed to allocate memory for merging shards\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+
+  /* Place results of each shard at the original indices of the objects. */
+  for (int i = 0; i < nshard; i++) {
+    if (!(fp = open_shard(dir, i, &head))) {
+      free(seen);
+      return BRICKMASK_ERR_FILE;
+    }
+    const size_t n = head.n;
+    const size_t msize = mask_size(head.mtype);
+    size_t *idx = NULL;
+    void *mask = NULL;
+    unsigned char *sid = NULL;
+    int err = 0;
+    if (n && (!(idx = malloc(n * sizeof(size_t))) ||
+        !(mask = malloc(n * msize)) ||
+        (subid && !(sid = malloc(n * sizeof(unsigned char)))))) {
+      P_ERR("failed to allocate memory for merging shards\n");
+      err = BRICKMASK_ERR_MEMORY;
+    }
+    else if (fread(idx, sizeof(size_t), n, fp) != n ||
+        fread(mask, msize, n, fp) != n ||
+        (subid && fread(sid, sizeof(unsigned char), n, fp) != n)) {
+      P_ERR("failed to read results of shard %d\n", i);
+      err = BRICKMASK_ERR_FILE;
+    }
+    fclose(fp);
+
+    for (size_t j = 0; !err && j < n; j++) {
+      if (idx[j] >= data->n || seen[idx[j]]) {
+        P_ERR("invalid or duplicate object index in shard %d: %zu\n",
+            i, idx[j]);
+        err = BRICKMASK_ERR_FILE;
+        break;
+      }
+      seen[idx[j]] = 1;
+      set_mask(data->mask, data->mtype, idx[j], get_mask(mask, head.mtype, j));
+      if (subid) data->subid[idx[j]] = sid[j];
+    }
+
+    if (idx) free(idx);
+    if (mask) free(mask);
+    if (sid) free(sid);
+    if (err) {
+      free(seen);
+      return err;
+    }
+    if (verbose) printf("  %zu objects loaded from shard %d\n", n, i);
+  }
+
+  free(seen);
+  if (verbose) printf("  %d shards merged\n", nshard);
+  printf(FMT_DONE);
+  return 0;
+}
@@ -17,6 +17,9 @@
 #include "define.h"
 #include "get_brick.h"
 #include "data_io.h"
+#ifdef OMP
+#include <omp.h>
+#endif
 
 /*============================================================================*\
                     Functions for finding bricks of the data
@@ -72,25 +75,44 @@ static long find_brick(const BRICK *brick, const double ra,
 }
 
 /******************************************************************************
-Function `get_brick_id`:
-  Get brick IDs for the input data sample.
+Function `find_brick_id`:
+  Find brick IDs for the input data sample.
 Arguments:
   * `brick`:    structure for bricks;
   * `data`:     structure for the data catalogue.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-static inline int get_brick_id(BRICK *brick, DATA *data) {
+static int find_brick_id(const BRICK *brick, DATA *data) {
+  int err = 0;
+#ifdef OMP
+#pragma omp parallel for reduction(|:err)
+#endif
   for (size_t i = 0; i < data->n; i++) {
     if (data->ra[i] == 360) data->ra[i] -= BRICKMASK_TOL;
     if (data->dec[i] == 90) data->dec[i] -= BRICKMASK_TOL;
     data->id[i] = find_brick(brick, data->ra[i], data->dec[i]);
     if (data->id[i] < 0) {
-      P_ERR("cannot find the brick for coordinate (%g, %g)\n",
+      /* Report only the first failure of each thread. */
+      if (!err) P_ERR("cannot find the brick for coordinate (%g, %g)\n",
           data->ra[i], data->dec[i]);
-      return BRICKMASK_ERR_BRICK;
+      err = 1;
     }
   }
+  return (err) ? BRICKMASK_ERR_BRICK : 0;
+}
+
+/******************************************************************************
+Function `get_brick_id`:
+  Get brick IDs for the input data sample, and release the brick ranges.
+Arguments:
+  * `brick`:    structure for bricks;
+  * `data`:     structure for the data catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static inline int get_brick_id(BRICK *brick, DATA *data) {
+  if (find_brick_id(brick, data)) return BRICKMASK_ERR_BRICK;
   free(brick->ra1);
   free(brick->ra2);
   free(brick->dec1);
@@ -99,6 +121,77 @@ static inline int get_brick_id(BRICK *brick, DATA *data) {
   return 0;
 }
 
+/******************************************************************************
+Function `count_brick`:
+  Count the total number of bricks for the sorted data.
+Arguments:
+  * `data`:     structure for the data catalogue.
+******************************************************************************/
+static inline void count_brick(DATA *data) {
+  long prev = -1;
+  data->nbrick = 0;
+  for (size_t i = 0; i < data->n; i++) {
+    if (data->id[i] != prev) {
+      data->nbrick++;
+      prev = data->id[i];
+    }
+  }
+}
+
+/******************************************************************************
+Function `select_shard`:
+  Keep only objects in bricks of a given shard.  Bricks containing data are
+  split into `nshard` contiguous ranges of brick IDs, with (almost) the same
+  number of bricks in each range.
+Arguments:
+  * `nbrick`:   total number of bricks;
+  * `data`:     structure for the data catalogue;
+  * `ishard`:   index of the shard;
+  * `nshard`:   total number of shards.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int select_shard(const size_t nbrick, DATA *data, const int ishard,
+    const int nshard) {
+  /* Mark bricks that contain data. */
+  unsigned char *used = calloc(nbrick, sizeof(unsigned char));
+  if (!used) {
+    P_ERR("failed to allocate memory for selecting bricks\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+  for (size_t i = 0; i < data->n; i++) used[data->id[i]] = 1;
+  size_t nused = 0;
+  for (size_t i = 0; i < nbrick; i++) nused += used[i];
+
+  /* Find the range of brick IDs for this shard. */
+  const size_t rmin = nused * ishard / nshard;
+  const size_t rmax = nused * (ishard + 1) / nshard;
+  long idmin, idmax;
+  idmin = idmax = nbrick;
+  for (size_t i = 0, r = 0; i < nbrick; i++) {
+    if (!used[i]) continue;
+    if (r == rmin) idmin = i;
+    if (r == rmax) {
+      idmax = i;
+      break;
+    }
+    r++;
+  }
+  free(used);
+
+  /* Remove objects of the other shards, without changing the order. */
+  size_t n = 0;
+  for (size_t i = 0; i < data->n; i++) {
+    if (data->id[i] < idmin || data->id[i] >= idmax) continue;
+    data->ra[n] = data->ra[i];
+    data->dec[n] = data->dec[i];
+    data->idx[n] = data->idx[i];
+    data->id[n++] = data->id[i];
+  }
+  data->n = n;
+  return 0;
+}
+
 /*============================================================================*\
                   Definitions for sorting the data by brick ID
 \*============================================================================*/
@@ -149,20 +242,135 @@ typedef struct {
 
 #include "timsort.c"
 
+#ifdef OMP
+/******************************************************************************
+Function `omp_sort`:
+  Sort the data by brick IDs with threads.  Objects are distributed stably
+  into bins of consecutive brick IDs first, and then the bins are sorted
+  independently, so the result is identical to that of a single `tim_sort`.
+Arguments:
+  * `data`:     structure for the data catalogue;
+  * `nbrick`:   total number of bricks.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int omp_sort(DATA *data, const size_t nbrick) {
+  const size_t n = data->n;
+  const size_t nbin = (nbrick < BRICKMASK_OMP_SORT_NBIN) ?
+      nbrick : BRICKMASK_OMP_SORT_NBIN;
+  const int nthread = omp_get_max_threads();
+  size_t esize = sizeof(double);
+  if (esize < sizeof(size_t)) esize = sizeof(size_t);
+  if (esize < sizeof(long)) esize = sizeof(long);
+
+  /* Counters of bins for each thread, and offsets of bins. */
+  size_t *cnt = calloc((nthread + 1) * nbin + 1, sizeof(size_t));
+  size_t *pos = malloc(n * sizeof(size_t));
+  void *tmp = malloc(n * esize);
+  if (!cnt || !pos || !tmp) {
+    P_ERR("failed to allocate memory for sorting the data\n");
+    if (cnt) free(cnt);
+    if (pos) free(pos);
+    if (tmp) free(tmp);
+    return BRICKMASK_ERR_MEMORY;
+  }
+  size_t *off = cnt + nthread * nbin;
+
+#pragma omp parallel num_threads(nthread)
+  {
+    size_t *c = cnt + omp_get_thread_num() * nbin;
+
+    /* Count objects in each bin, identical schedules keep the order. */
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) c[data->id[i] * nbin / nbrick]++;
+
+#pragma omp single
+    {
+      const int nt = omp_get_num_threads();
+      size_t sum = 0;
+      for (size_t b = 0; b < nbin; b++) {
+        off[b] = sum;
+        for (int t = 0; t < nt; t++) {
+          size_t num = cnt[t * nbin + b];
+          cnt[t * nbin + b] = sum;
+          sum += num;
+        }
+      }
+      off[nbin] = sum;
+    }
+
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) pos[i] = c[data->id[i] * nbin / nbrick]++;
+
+    /* Move the objects to their bins. */
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) ((double *) tmp)[pos[i]] = data->ra[i];
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) data->ra[i] = ((double *) tmp)[i];
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) ((double *) tmp)[pos[i]] = data->dec[i];
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) data->dec[i] = ((double *) tmp)[i];
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) ((size_t *) tmp)[pos[i]] = data->idx[i];
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) data->idx[i] = ((size_t *) tmp)[i];
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) ((long *) tmp)[pos[i]] = data->id[i];
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < n; i++) data->id[i] = ((long *) tmp)[i];
+
+    /* Sort each bin. */
+#pragma omp for schedule(dynamic)
+    for (size_t b = 0; b < nbin; b++) {
+      DATA bin;
+      bin.ra = data->ra + off[b];
+      bin.dec = data->dec + off[b];
+      bin.idx = data->idx + off[b];
+      tim_sort(data->id + off[b], &bin, off[b + 1] - off[b]);
+    }
+  }
+
+  free(cnt);
+  free(pos);
+  free(tmp);
+  return 0;
+}
+#endif
+
+/******************************************************************************
+Function `sort_id`:
+  Sort the data by brick IDs.
+Arguments:
+  * `data`:     structure for the data catalogue;
+  * `nbrick`:   total number of bricks.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static inline int sort_id(DATA *data, const size_t nbrick) {
+#ifdef OMP
+  if (omp_get_max_threads() > 1) return omp_sort(data, nbrick);
+#else
+  (void) nbrick;
+#endif
+  tim_sort(data->id, data, data->n);
+  return 0;
+}
+
 
 /*============================================================================*\
                  Functions for restoring the order of the data
 \*============================================================================*/
 
 /******************************************************************************
-Function `reorder_mask_reduce`:
-  Reorder maskbits, and reduce the length of the data type if applicable.
+Function `reorder_mask`:
+  Restore the original order of maskbits, which are packed to `mtype`.
 Arguments:
   * `data`:     structure for the the data catalogue.
 Return:
   Zero on success; non-zero on error.
 ******************************************************************************/
-static inline int reorder_mask_reduce(DATA *data) {
+static inline int reorder_mask(DATA *data) {
   void *mask;
   switch (data->mtype) {
     case TBYTE:
@@ -171,7 +379,8 @@ static inline int reorder_mask_reduce(DATA *data) {
         return BRICKMASK_ERR_MEMORY;
       }
       for (size_t i = 0; i < data->n; i++)
-        ((unsigned char *) mask)[data->idx[i]] = data->mask[i];
+        ((unsigned char *) mask)[data->idx[i]] =
+            ((unsigned char *) data->mask)[i];
       break;
     case TSHORT:
       if (!(mask = malloc(data->n * sizeof(uint16_t)))) {
@@ -179,7 +388,7 @@ static inline int reorder_mask_reduce(DATA *data) {
         return BRICKMASK_ERR_MEMORY;
       }
       for (size_t i = 0; i < data->n; i++)
-        ((uint16_t *) mask)[data->idx[i]] = data->mask[i];
+        ((uint16_t *) mask)[data->idx[i]] = ((uint16_t *) data->mask)[i];
       break;
     case TINT:
       if (!(mask = malloc(data->n * sizeof(uint32_t)))) {
@@ -187,7 +396,7 @@ static inline int reorder_mask_reduce(DATA *data) {
         return BRICKMASK_ERR_MEMORY;
       }
       for (size_t i = 0; i < data->n; i++)
-        ((uint32_t *) mask)[data->idx[i]] = data->mask[i];
+        ((uint32_t *) mask)[data->idx[i]] = ((uint32_t *) data->mask)[i];
       break;
     case TLONG:
       if (!(mask = malloc(data->n * sizeof(uint64_t)))) {
@@ -207,27 +416,6 @@ static inline int reorder_mask_reduce(DATA *data) {
   return 0;
 }
 
-/******************************************************************************
-Function `reorder_mask`:
-  Restore the original maskbits before data sorting.
-Arguments:
-  * `data`:     structure for the the data catalogue.
-Return:
-  Zero on success; non-zero on error.
-******************************************************************************/
-static inline int reorder_mask(DATA *data) {
-  uint64_t *mask = malloc(data->n * sizeof(uint64_t));
-  if (!mask) {
-    P_ERR("failed to allocate memory for saving maskbits\n");
-    return BRICKMASK_ERR_MEMORY;
-  }
-
-  for (size_t i = 0; i < data->n; i++) mask[data->idx[i]] = data->mask[i];
-  free(data->mask);
-  data->mask = mask;
-  return 0;
-}
-
 /******************************************************************************
 Function `reorder_subid`:
   Restore the original subsample ID before data sorting.
@@ -252,7 +440,7 @@ static inline int reorder_subid(DATA *data) {
 
 
 /*============================================================================*\
-                         Interface for sorting the data
+                         Interfaces for sorting the data
 \*============================================================================*/
 
 /******************************************************************************
@@ -275,23 +463,79 @@ int sort_data(BRICK *brick, DATA *data, const bool verbose) {
   fflush(stdout);
 
   /* Get brick ID and sort the data. */
+  const size_t nbrick = brick->n;
   if (get_brick_id(brick, data)) return BRICKMASK_ERR_BRICK;
-  tim_sort(data->id, data, data->n);
+  if (sort_id(data, nbrick)) return BRICKMASK_ERR_MEMORY;
+  count_brick(data);
+  if (verbose) printf("  %zu bricks contain data points\n", data->nbrick);
 
-  /* Count the total number of bricks for the data. */
-  long prev = -1;
-  for (size_t i = 0; i < data->n; i++) {
-    if (data->id[i] != prev) {
-      data->nbrick++;
-      prev = data->id[i];
-    }
+  printf(FMT_DONE);
+  return 0;
+}
+
+/******************************************************************************
+Function `sort_shard`:
+  Keep only objects of a given shard, and sort them based on the brick IDs.
+Arguments:
+  * `brick`:    structure for bricks;
+  * `data`:     structure for the data catalogue;
+  * `ishard`:   index of the shard;
+  * `nshard`:   total number of shards;
+  * `verbose`:  indicate whether to show detailed outputs.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int sort_shard(BRICK *brick, DATA *data, const int ishard, const int nshard,
+    const bool verbose) {
+  printf("Sorting objects of shard %d / %d based on brick IDs ...",
+      ishard, nshard);
+  if (!brick || !data) {
+    P_ERR("the bricks or input data is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (ishard < 0 || ishard >= nshard) {
+    P_ERR("invalid shard: %d / %d\n", ishard, nshard);
+    return BRICKMASK_ERR_INIT;
+  }
+  if (verbose) printf("\n");
+  fflush(stdout);
+
+  const size_t nbrick = brick->n;
+  if (get_brick_id(brick, data)) return BRICKMASK_ERR_BRICK;
+  if (select_shard(nbrick, data, ishard, nshard)) return BRICKMASK_ERR_MEMORY;
+  if (sort_id(data, nbrick)) return BRICKMASK_ERR_MEMORY;
+  count_brick(data);
+  if (verbose) {
+    printf("  %zu objects in %zu bricks are selected\n",
+        data->n, data->nbrick);
   }
-  if (verbose) printf("  %zu bricks contain data points\n", data->nbrick);
 
   printf(FMT_DONE);
   return 0;
 }
 
+/******************************************************************************
+Function `sort_chunk`:
+  Sort a chunk of the input data based on the brick IDs, and keep the brick
+  ranges for subsequent chunks.
+Arguments:
+  * `brick`:    structure for bricks;
+  * `data`:     structure for the data chunk, with `idx` being the indices
+                of objects in the full catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int sort_chunk(const BRICK *brick, DATA *data) {
+  if (!brick || !data) {
+    P_ERR("the bricks or input data is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (find_brick_id(brick, data)) return BRICKMASK_ERR_BRICK;
+  if (sort_id(data, brick->n)) return BRICKMASK_ERR_MEMORY;
+  count_brick(data);
+  return 0;
+}
+
 /******************************************************************************
 Function `reorder_data`:
   Restore the original order of the input data sample.
@@ -308,17 +552,28 @@ int reorder_data(DATA *data) {
   }
   fflush(stdout);
 
-  switch (data->fmt) {
-    case BRICKMASK_FFMT_ASCII:
-      if (reorder_mask(data)) return BRICKMASK_ERR_MEMORY;
-      break;
-    case BRICKMASK_FFMT_FITS:
-      if (reorder_mask_reduce(data)) return BRICKMASK_ERR_MEMORY;
-      break;
-  }
-
+  if (reorder_mask(data)) return BRICKMASK_ERR_MEMORY;
   if (reorder_subid(data)) return BRICKMASK_ERR_MEMORY;
 
   printf(FMT_DONE);
   return 0;
 }
+
+/******************************************************************************
+Function `reorder_chunk`:
+  Restore the original order of maskbits and subsample IDs of a data chunk,
+  without printing messages.
+Arguments:
+  * `data`:     structure for the data chunk, with `idx` being the indices
+                of objects in the chunk.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int reorder_chunk(DATA *data) {
+  if (!data) {
+    P_ERR("the data chunk is not initialised\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (reorder_mask(data) || reorder_subid(data)) return BRICKMASK_ERR_MEMORY;
+  return 0;
+}
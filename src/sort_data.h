@@ -51,6 +51,34 @@ Return:
 ******************************************************************************/
 int sort_data(BRICK *brick, DATA *data, const bool verbose);
 
+/******************************************************************************
+Function `sort_shard`:
+  Keep only objects of a given shard, and sort them based on the brick IDs.
+Arguments:
+  * `brick`:    structure for bricks;
+  * `data`:     structure for the data catalogue;
+  * `ishard`:   index of the shard;
+  * `nshard`:   total number of shards;
+  * `verbose`:  indicate whether to show detailed outputs.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int sort_shard(BRICK *brick, DATA *data, const int ishard, const int nshard,
+    const bool verbose);
+
+/******************************************************************************
+Function `sort_chunk`:
+  Sort a chunk of the input data based on the brick IDs, and keep the brick
+  ranges for subsequent chunks.
+Arguments:
+  * `brick`:    structure for bricks;
+  * `data`:     structure for the data chunk, with `idx` being the indices
+                of objects in the full catalogue.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int sort_chunk(const BRICK *brick, DATA *data);
+
 /******************************************************************************
 Function `reorder_data`:
   Restore the original order of the input data sample.
@@ -61,4 +89,16 @@ Return:
 ******************************************************************************/
 int reorder_data(DATA *data);
 
+/******************************************************************************
+Function `reorder_chunk`:
+  Restore the original order of maskbits and subsample IDs of a data chunk,
+  without printing messages.
+Arguments:
+  * `data`:     structure for the data chunk, with `idx` being the indices
+                of objects in the chunk.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int reorder_chunk(DATA *data);
+
 #endif
@@ -0,0 +1,236 @@
+/*******************************************************************************
+* stdio_stream.c: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>  [MIT license]
+
+*******************************************************************************/
+
+#include "define.h"
+#include "stdio_stream.h"
+#include "data_io.h"
+#include "read_file.h"
+#include "save_file.h"
+#include "sort_data.h"
+#include "assign_mask.h"
+#include "stream_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Data structure for filtering objects from the standard input. */
+typedef struct {
+  const BRICK *brick;   /* structure for bricks                         */
+  DATA *data;           /* objects of the current window                */
+  OSTREAM *fp;          /* stream of the standard output                */
+  size_t nwin;          /* number of objects processed at once          */
+  bool subid;           /* indicate whether to save subsample IDs       */
+  size_t ntot;          /* number of objects written so far             */
+  size_t nproc;         /* number of windows processed so far           */
+} STDIO_STREAM;
+
+/*============================================================================*\
+                   Functions for processing windows of objects
+\*============================================================================*/
+
+/******************************************************************************
+Function `window_init`:
+  Allocate memory for brick IDs, maskbits, and subsample IDs of a window.
+Arguments:
+  * `s`:        structure for filtering objects.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int window_init(STDIO_STREAM *s) {
+  DATA *d = s->data;
+  const size_t n = d->n;
+  size_t *itmp = realloc(d->idx, n * sizeof(size_t));
+  if (itmp) d->idx = itmp;
+  long *ltmp = (itmp) ? realloc(d->id, n * sizeof(long)) : NULL;
+  if (ltmp) d->id = ltmp;
+  if (d->mask) free(d->mask);
+  if (d->subid) free(d->subid);
+  d->mask = NULL;
+  d->subid = NULL;
+  if (!itmp || !ltmp || !(d->mask = calloc(n, sizeof(uint64_t))) ||
+      (s->subid && !(d->subid = calloc(n, sizeof(uint8_t))))) {
+    P_ERR("failed to allocate memory for the window of objects\n");
+    return BRICKMASK_ERR_MEMORY;
+  }
+
+  for (size_t i = 0; i < n; i++) d->idx[i] = i;
+  d->mtype = mask_type(s->brick->mnull);
+  return 0;
+}
+
+/******************************************************************************
+Function `window_tail`:
+  Find the trailing objects of a sorted window that are in the same brick
+  as the last object read, and remove them from the sorted arrays.
+Arguments:
+  * `d`:        structure for the sorted window;
+  * `ra`:       array for right ascensions of the removed objects;
+  * `dec`:      array for declinations of the removed objects.
+Return:
+  Number of the removed objects, which are at the end of the window in the
+  original order.
+******************************************************************************/
+static size_t window_tail(DATA *d, double **ra, double **dec) {
+  const size_t n = d->n;
+  *ra = *dec = NULL;
+
+  /* The last object read closes the run of its brick, as sorting is stable. */
+  size_t k = 0;
+  while (d->idx[k] != n - 1) k++;
+  size_t m = 1;
+  while (m <= k && d->id[k - m] == d->id[k] && d->idx[k - m] == n - 1 - m)
+    m++;
+  if (m == n) return 0;         /* the window contains a single brick */
+
+  if (!(*ra = malloc(m * sizeof(double))) ||
+      !(*dec = malloc(m * sizeof(double)))) {
+    if (*ra) free(*ra);
+    *ra = NULL;
+    return 0;                   /* process the full window instead */
+  }
+  const size_t first = k + 1 - m;
+  memcpy(*ra, d->ra + first, m * sizeof(double));
+  memcpy(*dec, d->dec + first, m * sizeof(double));
+
+  const size_t nrest = n - k - 1;
+  memmove(d->ra + first, d->ra + k + 1, nrest * sizeof(double));
+  memmove(d->dec + first, d->dec + k + 1, nrest * sizeof(double));
+  memmove(d->idx + first, d->idx + k + 1, nrest * sizeof(size_t));
+  memmove(d->id + first, d->id + k + 1, nrest * sizeof(long));
+  d->n = n - m;
+  return m;
+}
+
+/******************************************************************************
+Function `window_flush`:
+  Assign maskbits to objects of the current window, and write them to the
+  standard output.  Unless it is the last window, objects of the last brick
+  read are kept for the next window, so that maskbit files of inputs grouped
+  by bricks are read only once.
+Arguments:
+  * `s`:        structure for filtering objects;
+  * `last`:     indicate whether no more object is to be read.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int window_flush(STDIO_STREAM *s, const bool last) {
+  DATA *d = s->data;
+  const size_t n = d->n;
+  if (!n) return 0;
+
+  int err;
+  if ((err = window_init(s))) return err;
+  if ((err = sort_chunk(s->brick, d))) return err;
+
+  double *ra, *dec;
+  const size_t m = (last) ? 0 : window_tail(d, &ra, &dec);
+
+  if ((err = assign_mask_chunk(s->brick, d)) || (err = reorder_chunk(d)) ||
+      (err = save_ascii_stream(s->fp, d, d->n))) {
+    if (m) {
+      free(ra);
+      free(dec);
+    }
+    return err;
+  }
+  s->ntot += d->n;
+  s->nproc++;
+
+  /* Move the kept objects to the beginning of the window. */
+  if (m) {
+    const size_t c0 = d->cidx[n - m];
+    memmove(d->content, d->content + c0, d->csize - c0);
+    d->csize -= c0;
+    for (size_t i = 0; i < m; i++) d->cidx[i] = d->cidx[n - m + i] - c0;
+    memcpy(d->ra, ra, m * sizeof(double));
+    memcpy(d->dec, dec, m * sizeof(double));
+    free(ra);
+    free(dec);
+  }
+  else d->csize = 0;
+  d->n = m;
+  return 0;
+}
+
+/******************************************************************************
+Function `stdio_hook`:
+  Process a window whenever enough objects are read.
+Arguments:
+  * `ra`:       right ascension of objects read so far;
+  * `dec`:      declination of objects read so far;
+  * `n`:        number of objects read so far;
+  * `arg`:      structure for filtering objects.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+static int stdio_hook(const double *ra, const double *dec, const size_t n,
+    void *arg) {
+  (void) ra;
+  (void) dec;
+  STDIO_STREAM *s = (STDIO_STREAM *) arg;
+  if (n < s->nwin) return 0;
+  return window_flush(s, false);
+}
+
+
+/*============================================================================*\
+            Interface for filtering objects from the standard input
+\*============================================================================*/
+
+/******************************************************************************
+Function `stdio_stream`:
+  Read ASCII-format objects from the standard input by windows, and write
+  them with maskbits to the standard output, in the original order.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `brick`:    structure for bricks.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int stdio_stream(const CONF *conf, const BRICK *brick) {
+  printf("Filtering objects from the standard input ...");
+  if (!conf || !brick) {
+    P_ERR("configuration parameters or bricks are not loaded\n");
+    return BRICKMASK_ERR_INIT;
+  }
+  if (conf->verbose) printf("\n");
+  fflush(stdout);
+
+  STDIO_STREAM s;
+  s.brick = brick;
+  s.nwin = conf->nwin;
+  s.subid = (conf->subid) ? true : false;
+  s.ntot = s.nproc = 0;
+  if (!(s.data = data_init(conf))) return BRICKMASK_ERR_MEMORY;
+  if (!(s.fp = ostream_fdopen(conf->ofd, BRICKMASK_STDOUT_NAME))) {
+    data_destroy(s.data);
+    return BRICKMASK_ERR_FILE;
+  }
+  s.data->hook = stdio_hook;
+  s.data->harg = &s;
+
+  /* Windows are processed while reading, and the rest at the end. */
+  int err = read_ascii(conf->input[0], 0, conf, s.data);
+  if (!err) err = window_flush(&s, true);
+
+  if (ostream_close(s.fp) && !err) err = BRICKMASK_ERR_FILE;
+  data_destroy(s.data);
+  if (err) return err;
+
+  if (conf->verbose) {
+    printf("  %zu objects written to the standard output in %zu windows\n",
+        s.ntot, s.nproc);
+  }
+  printf(FMT_DONE);
+  return 0;
+}
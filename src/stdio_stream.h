@@ -0,0 +1,54 @@
+/*******************************************************************************
+* stdio_stream.h: this file is part of the brickmask program.
+
+* brickmask: assign bit codes defined on Legacy Survey brick pixels
+             to a catalogue with sky coordinates.
+
+* Github repository:
+        https://github.com/cheng-zhao/brickmask
+
+* Copyright (c) 2020 -- 2021 Cheng Zhao <zhaocheng03@gmail.com>
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+
+*******************************************************************************/
+
+#ifndef __STDIO_STREAM_H__
+#define __STDIO_STREAM_H__
+
+#include "load_conf.h"
+#include "get_brick.h"
+
+/*============================================================================*\
+            Interface for filtering objects from the standard input
+\*============================================================================*/
+
+/******************************************************************************
+Function `stdio_stream`:
+  Read ASCII-format objects from the standard input by windows, and write
+  them with maskbits to the standard output, in the original order.
+Arguments:
+  * `conf`:     structure for storing configurations;
+  * `brick`:    structure for bricks.
+Return:
+  Zero on success; non-zero on error.
+******************************************************************************/
+int stdio_stream(const CONF *conf, const BRICK *brick);
+
+#endif